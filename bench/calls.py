@@ -0,0 +1,17 @@
+def inc(x):
+    return x + 1
+
+def add(a, b):
+    return a + b
+
+def calls(n, acc):
+    if n == 0:
+        return acc
+    return calls(n - 1, add(inc(acc), inc(0)))
+
+def outer(n, acc):
+    if n == 0:
+        return acc
+    return outer(n - 1, calls(800, acc))
+
+print(outer(25, 0))
@@ -0,0 +1,27 @@
+def triangle(n):
+    total = 0
+    for i in range(n):
+        total = total + i
+    return total
+
+def collatz_steps(n):
+    steps = 0
+    while n > 1:
+        if n % 2 == 0:
+            n = n // 2
+        else:
+            n = 3 * n + 1
+        steps = steps + 1
+    return steps
+
+def spin(n):
+    for _ in range(n):
+        n = n
+    return n
+
+longest = 0
+for k in range(1, 3000):
+    steps = collatz_steps(k)
+    if steps > longest:
+        longest = steps
+print(longest, triangle(200000), spin(200000))
@@ -0,0 +1,13 @@
+def lines(n, m):
+    if n == 0:
+        return 0
+    print(n, m * n, "line", n == m)
+    return lines(n - 1, m)
+
+def rounds(n):
+    if n == 0:
+        return 0
+    lines(800, n)
+    return rounds(n - 1)
+
+rounds(60)
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""Benchmark runner for spython.
+
+Runs every bench/*.py script, plus a few generated ones, under the given
+interpreter and reports wall time (mean, stdev, min), peak RSS and bytecode
+instructions per second (the count comes from one extra `--stats` run). If a
+python3 is on the PATH the same scripts are timed under it for comparison,
+and its output is used to check ours.
+
+    python3 bench/run.py [-n RUNS] [-a ARG]... [--no-python] [--filter NAME] [--keep DIR] SPYTHON
+"""
+
+import argparse
+import os
+import re
+import shutil
+import statistics
+import sys
+import tempfile
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+
+def generate_if_chain(depth=40, calls=600):
+    """A function that is one long nested if/else, called from a recursive driver."""
+    lines = ["def classify(n):"]
+    indent = "    "
+    for i in range(depth):
+        lines.append(f"{indent}if n == {i}:")
+        lines.append(f"{indent}    return {i * 3}")
+        lines.append(f"{indent}else:")
+        indent += "    "
+    lines.append(f"{indent}return 0 - 1")
+    lines += [
+        "",
+        "def drive(n, total):",
+        "    if n == 0:",
+        "        return total",
+        f"    return drive(n - 1, total + classify(n % {depth + 1}))",
+        "",
+        "def rounds(n, total):",
+        "    if n == 0:",
+        "        return total",
+        f"    return rounds(n - 1, drive({calls}, total))",
+        "",
+        "print(rounds(20, 0))",
+    ]
+    return "\n".join(lines) + "\n"
+
+
+def generate_large_module(functions=2000):
+    """Lots of top-level definitions and statements - mostly front-end work."""
+    lines = []
+    for i in range(functions):
+        lines.append(f"def f_{i}(x):")
+        lines.append(f"    return x * 3 + {i} - x * 2")
+        lines.append("")
+    lines.append("v_0 = 0")
+    for i in range(functions):
+        lines.append(f"v_{i + 1} = f_{i}(v_{i}) % 1000003")
+    lines.append(f"print(v_{functions})")
+    return "\n".join(lines) + "\n"
+
+
+GENERATED = {
+    "gen_if_chain": generate_if_chain,
+    "gen_large_module": generate_large_module,
+}
+
+
+def run_measured(argv):
+    """Run argv to completion, returning (wall seconds, peak rss KB, stdout, stderr, status)."""
+    start = time.perf_counter()
+    with tempfile.TemporaryFile() as out, tempfile.TemporaryFile() as err:
+        pid = os.fork()
+        if pid == 0:
+            os.dup2(out.fileno(), 1)
+            os.dup2(err.fileno(), 2)
+            try:
+                os.execvp(argv[0], argv)
+            finally:
+                os._exit(127)
+        _, status, usage = os.wait4(pid, 0)
+        elapsed = time.perf_counter() - start
+        out.seek(0)
+        err.seek(0)
+        stdout = out.read().decode(errors="replace")
+        stderr = err.read().decode(errors="replace")
+    return elapsed, usage.ru_maxrss, stdout, stderr, os.waitstatus_to_exitcode(status)
+
+
+def count_instructions(interpreter, options, script):
+    _, _, _, stderr, _ = run_measured([interpreter, *options, "--stats", script])
+    match = re.search(r"stats: (\d+) instructions", stderr)
+    return int(match.group(1)) if match else None
+
+
+def measure(argv, runs):
+    times = []
+    peak_rss = 0
+    output = None
+    for _ in range(runs):
+        elapsed, rss, stdout, stderr, status = run_measured(argv)
+        if status != 0:
+            return None, f"exit status {status}: {(stdout + stderr).strip()[-200:]}"
+        times.append(elapsed)
+        peak_rss = max(peak_rss, rss)
+        output = stdout
+    return (times, peak_rss, output), None
+
+
+def format_time(seconds):
+    if seconds < 1:
+        return f"{seconds * 1000:8.1f}ms"
+    return f"{seconds:8.3f}s "
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("interpreter", help="path to the spython binary")
+    parser.add_argument("-n", "--runs", type=int, default=5, help="timed runs per script (default 5)")
+    parser.add_argument("-a", "--arg", action="append", default=[], dest="options",
+                        help="pass an option to spython, e.g. -a=--tail-calls (repeatable)")
+    parser.add_argument("--no-python", action="store_true", help="don't compare against python3")
+    parser.add_argument("--filter", default="", help="only run scripts whose name contains this")
+    parser.add_argument("--keep", metavar="DIR", help="write generated scripts here instead of a temp dir")
+    args = parser.parse_args()
+
+    interpreter = os.path.abspath(args.interpreter)
+    if not os.access(interpreter, os.X_OK):
+        sys.exit(f"error: {args.interpreter} is not an executable")
+    python = None if args.no_python else shutil.which("python3")
+
+    gen_dir = args.keep or tempfile.mkdtemp(prefix="spython-bench-")
+    os.makedirs(gen_dir, exist_ok=True)
+    scripts = []
+    for name in sorted(os.listdir(BENCH_DIR)):
+        if name.endswith(".py") and name != "run.py":
+            scripts.append((name[:-3], os.path.join(BENCH_DIR, name)))
+    for name, generate in GENERATED.items():
+        path = os.path.join(gen_dir, name + ".py")
+        with open(path, "w") as f:
+            f.write(generate())
+        scripts.append((name, path))
+    scripts = [(name, path) for name, path in scripts if args.filter in name]
+
+    header = f"{'script':<18} {'mean':>10} {'stdev':>7} {'min':>10} {'peak rss':>10} {'insns/s':>10}"
+    if python:
+        header += f" {'python3':>10} {'ratio':>7}"
+    print(f"{' '.join([interpreter, *args.options])}, {args.runs} runs per script")
+    print(header)
+    print("-" * len(header))
+
+    failed = False
+    for name, path in scripts:
+        result, error = measure([interpreter, *args.options, path], args.runs)
+        if error:
+            print(f"{name:<18} FAILED ({error})")
+            failed = True
+            continue
+        times, peak_rss, output = result
+        mean = statistics.mean(times)
+        stdev = statistics.stdev(times) if len(times) > 1 else 0.0
+        instructions = count_instructions(interpreter, args.options, path)
+        rate = f"{instructions / mean / 1e6:8.1f}M" if instructions else f"{'-':>9}"
+        line = (f"{name:<18} {format_time(mean)} {100 * stdev / mean:6.1f}% {format_time(min(times))}"
+                f" {peak_rss / 1024:8.1f}MB {rate:>10}")
+        if python:
+            py_result, py_error = measure([python, path], args.runs)
+            if py_error:
+                line += f" {'error':>10}"
+            else:
+                py_times, _, py_output = py_result
+                py_mean = statistics.mean(py_times)
+                line += f" {format_time(py_mean)} {mean / py_mean:6.1f}x"
+                if py_output != output:
+                    line += "  (output differs!)"
+                    failed = True
+        print(line)
+
+    if not args.keep:
+        shutil.rmtree(gen_dir)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
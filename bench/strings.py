@@ -0,0 +1,16 @@
+def build(s, n):
+    if n == 0:
+        return s
+    return build(s + "abcdefghij", n - 1)
+
+def repeat(s, n):
+    if n == 0:
+        return s
+    return repeat(s + "xy" * 40, n - 1)
+
+def rounds(n, total):
+    if n == 0:
+        return total
+    return rounds(n - 1, total + len(build("", 800)) + len(repeat("", 200)))
+
+print(rounds(40, 0))
@@ -0,0 +1,50 @@
+#include <stdlib.h>
+
+#include "bool.h"
+#include "type.h"
+#include "int.h"
+#include "bytes.h"
+#include "tuple.h"
+#include "list.h"
+#include "dict.h"
+
+PyTypeObject py_type_bool = {
+  .base = { .type = &py_type_type },
+  .name = "bool",
+  .basic_size = sizeof(PyBoolObject),
+  .item_size = 0,
+  .methods = NULL,
+};
+
+// NOTE: True and False are singletons - comparisons never allocate
+PyBoolObject py_true = {
+  .base = { .type = &py_type_bool },
+  .value = 1
+};
+
+PyBoolObject py_false = {
+  .base = { .type = &py_type_bool },
+  .value = 0
+};
+
+PyObject *py_bool_from_int(int value) {
+  return (PyObject *) (value ? &py_true : &py_false);
+}
+
+int py_object_is_true(PyObject *obj) {
+  if (obj->type == &py_type_bool) {
+    return ((PyBoolObject *) obj)->value != 0;
+  } else if (obj->type == &py_type_int) {
+    // a bignum is never zero - int_from_digits demotes anything that fits
+    return ((PyIntObject *) obj)->value != 0 || ((PyIntObject *) obj)->digits != NULL;
+  } else if (obj->type == &py_type_bytes) {
+    return ((PyBytesObject *) obj)->size != 0;
+  } else if (obj->type == &py_type_tuple) {
+    return ((PyTupleObject *) obj)->size != 0;
+  } else if (obj->type == &py_type_list) {
+    return ((PyListObject *) obj)->size != 0;
+  } else if (obj->type == &py_type_dict) {
+    return ((PyDictObject *) obj)->table.itemCount != 0;
+  }
+  return 1;
+}
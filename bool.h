@@ -0,0 +1,14 @@
+#ifndef BOOL_H
+#define BOOL_H
+
+#include "type.h"
+
+extern PyTypeObject py_type_bool;
+extern PyBoolObject py_true;
+extern PyBoolObject py_false;
+
+PyObject *py_bool_from_int(int value);
+// what `if obj:` sees - zero and empty containers are false, anything else true
+int py_object_is_true(PyObject *obj);
+
+#endif
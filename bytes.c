@@ -2,66 +2,276 @@
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <limits.h>
 
 #include "bytes.h"
 #include "type.h"
+#include "cfunc.h"
 #include "int.h"
+#include "bool.h"
+#include "error.h"
+#include "simd.h"
+
+// NOTE: `+` is lazy once the result gets big enough - the new object is a
+// rope node that just points at its two halves, and the bytes are copied
+// once, when someone first needs them contiguous. so building a string with
+// `s = s + piece` in a loop is O(n) rather than O(n^2). len() and print()
+// walk the rope without flattening it.
+//
+// data lives inline after the header, so a rope node can't be flattened in
+// place - instead it keeps the flat copy in `left` and sets `right` to NULL:
+//   left == NULL                  -> flat, bytes in data[]
+//   left != NULL, right == NULL   -> flattened rope, bytes in left->data
+//   left != NULL, right != NULL   -> rope, bytes are left + right
+#define ROPE_MIN_SIZE 64 // below this a plain copy is cheaper than a node
+
+// NOTE: shared - every zero-length bytes is this one (the data is just the
+// null terminator)
+static PyBytesObject empty_bytes = {
+  .base = { .type = &py_type_bytes },
+  .size = 0,
+  .left = NULL,
+  .right = NULL,
+  .data = ""
+};
+
+// flat bytes with room for `size` bytes plus the null terminator
+static PyBytesObject *bytes_alloc(int size) {
+  PyBytesObject *result = (PyBytesObject *) py_type_alloc_var(&py_type_bytes, size + 1);
+  result->size = size;
+  result->left = NULL;
+  result->right = NULL;
+  result->data[size] = '\0';
+  return result;
+}
+
+PyObject *py_bytes_empty(void) {
+  return (PyObject *) &empty_bytes;
+}
+
+PyObject *py_bytes_from_string(const char *data, int size) {
+  if (size == 0) {
+    return py_bytes_empty();
+  }
+  PyBytesObject *result = bytes_alloc(size);
+  memcpy(result->data, data, size);
+  return (PyObject *) result;
+}
+
+// in-order walk over the flat leaves of a (possibly) rope bytes object
+// NOTE: iterative - `s = s + piece` loops build very deep left spines
+void py_bytes_for_each_chunk(PyObject *a, BytesChunkFunc f, void *arg) {
+  int capacity = 16;
+  int top = 0;
+  PyBytesObject **stack = malloc(capacity * sizeof(PyBytesObject *));
+  stack[top++] = (PyBytesObject *) a;
+  while (top > 0) {
+    PyBytesObject *node = stack[--top];
+    if (node->left == NULL) {
+      if (node->size > 0) {
+        f(node->data, node->size, arg);
+      }
+      continue;
+    }
+    if (top + 2 > capacity) {
+      capacity *= 2;
+      stack = realloc(stack, capacity * sizeof(PyBytesObject *));
+    }
+    if (node->right != NULL) {
+      stack[top++] = node->right;
+    }
+    stack[top++] = node->left;
+  }
+  free(stack);
+}
+
+static void copy_chunk(const char *data, int size, void *arg) {
+  char **cursor = arg;
+  memcpy(*cursor, data, size);
+  *cursor += size;
+}
+
+const char *py_bytes_data(PyObject *a) {
+  PyBytesObject *bytes = (PyBytesObject *) a;
+  if (bytes->left == NULL) {
+    return bytes->data;
+  }
+  if (bytes->right != NULL) {
+    // flatten once - the node keeps the flat copy from now on
+    PyBytesObject *flat = bytes_alloc(bytes->size);
+    char *cursor = flat->data;
+    py_bytes_for_each_chunk(a, copy_chunk, &cursor);
+    bytes->left = flat;
+    bytes->right = NULL;
+  }
+  return bytes->left->data;
+}
 
 PyObject *py_bytes_add(PyObject *a, PyObject *b) {
-  PyBytesObject *result = malloc(sizeof(PyBytesObject));
-  result->base.type = &py_type_bytes;
+  if (b->type != &py_type_bytes) {
+    py_error("TypeError: can only concatenate str (not \"%s\") to str", b->type->name);
+  }
   int a_size = ((PyBytesObject *) a)->size;
   int b_size = ((PyBytesObject *) b)->size;
-  result->size = a_size + b_size;
-  result->data = malloc(result->size + 1);
-  memcpy(result->data, ((PyBytesObject *) a)->data, a_size);
-  strcpy(result->data + a_size, ((PyBytesObject *) b)->data);
+  if (a_size == 0) {
+    return b;
+  } else if (b_size == 0) {
+    return a;
+  }
+  int size;
+  if (__builtin_add_overflow(a_size, b_size, &size)) {
+    py_error("OverflowError: concatenated string is too long");
+  }
+  if (size < ROPE_MIN_SIZE) {
+    // small - just copy both halves
+    PyBytesObject *result = bytes_alloc(size);
+    memcpy(result->data, py_bytes_data(a), a_size);
+    memcpy(result->data + a_size, py_bytes_data(b), b_size);
+    return (PyObject *) result;
+  }
+  PyBytesObject *result = (PyBytesObject *) py_type_alloc(&py_type_bytes);
+  result->size = size;
+  result->left = (PyBytesObject *) a;
+  result->right = (PyBytesObject *) b;
   return (PyObject *) result;
 }
 
 PyObject *py_bytes_multiply(PyObject *a, PyObject *b) {
   assert(b->type == &py_type_int);
   int a_size = ((PyBytesObject *) a)->size;
-  int b_value = ((PyIntObject *) b)->value;
-  PyBytesObject *result = malloc(sizeof(PyBytesObject));
-  result->base.type = &py_type_bytes;
-  result->size = ((PyBytesObject *) a)->size * b_value;
-  char *data = malloc(result->size + 1);
-  if (data == NULL) {
-    printf("MemoryError\n");
-    exit(1);
-  }
-  result->data = data;
-  // do memcpy (n - 1) times
-  for (int i=0; i<b_value-1; i++) {
-    memcpy(result->data + i*a_size, ((PyBytesObject *) a)->data, a_size); 
-  }
-  // and a strcpy to null-terminate
-  if (b_value != 0) {
-    strcpy(result->data + (b_value-1)*a_size, ((PyBytesObject *) a)->data);
-  } else {
-    result->data[0] = '\0'; 
+  long long b_value = py_int_as_long(b);
+  if (b_value <= 0 || a_size == 0) {
+    return py_bytes_empty();
+  }
+  if (b_value > INT_MAX / a_size) {
+    py_error("OverflowError: repeated string is too long");
+  }
+  int size = a_size * b_value;
+  PyBytesObject *result = bytes_alloc(size);
+  // one copy of `a`, then keep doubling what's there - log2(b) copies,
+  // each bigger than the last (bytes_alloc null-terminates)
+  memcpy(result->data, py_bytes_data(a), a_size);
+  int filled = a_size;
+  while (filled < size) {
+    int chunk = filled < size - filled ? filled : size - filled;
+    memcpy(result->data + filled, result->data, chunk);
+    filled += chunk;
   }
   return (PyObject *) result;
 }
 
 PyObject *py_bytes_length(PyObject *a, PyObject *b) {
-  PyIntObject *result = malloc(sizeof(PyIntObject));
-  result->base.type = &py_type_int;
-  result->value = ((PyBytesObject *) b)->size;
-  return (PyObject *) result;
+  // NOTE: size is kept on rope nodes, no need to flatten
+  return py_int_from_long(((PyBytesObject *) b)->size);
+}
+
+PyObject *py_bytes_equals(PyObject *a, PyObject *b) {
+  if (b->type != &py_type_bytes) {
+    return py_bool_from_int(0);
+  }
+  // different sizes can't be equal - decide without touching the data
+  int size = ((PyBytesObject *) a)->size;
+  if (size != ((PyBytesObject *) b)->size) {
+    return py_bool_from_int(0);
+  }
+  if (a == b) {
+    return py_bool_from_int(1);
+  }
+  return py_bool_from_int(simd_mismatch(py_bytes_data(a), py_bytes_data(b), size) == (size_t) size);
+}
+
+// <0, 0 or >0 as a sorts before, with or after b - byte by byte, unsigned
+static int bytes_compare(PyObject *a, PyObject *b, const char *op) {
+  if (b->type != &py_type_bytes) {
+    py_error("TypeError: '%s' not supported between instances of 'str' and '%s'", op, b->type->name);
+  }
+  int a_size = ((PyBytesObject *) a)->size;
+  int b_size = ((PyBytesObject *) b)->size;
+  if (a == b) {
+    return 0;
+  }
+  const char *a_data = py_bytes_data(a);
+  const char *b_data = py_bytes_data(b);
+  size_t common = a_size < b_size ? a_size : b_size;
+  size_t i = simd_mismatch(a_data, b_data, common);
+  if (i < common) {
+    return (unsigned char) a_data[i] - (unsigned char) b_data[i];
+  }
+  return a_size - b_size;
+}
+
+static PyObject *bytes_less_than(PyObject *a, PyObject *b) {
+  return py_bool_from_int(bytes_compare(a, b, "<") < 0);
+}
+
+static PyObject *bytes_greater_than(PyObject *a, PyObject *b) {
+  return py_bool_from_int(bytes_compare(a, b, ">") > 0);
+}
+
+static PyObject *bytes_less_equal(PyObject *a, PyObject *b) {
+  return py_bool_from_int(bytes_compare(a, b, "<=") <= 0);
+}
+
+static PyObject *bytes_greater_equal(PyObject *a, PyObject *b) {
+  return py_bool_from_int(bytes_compare(a, b, ">=") >= 0);
+}
+
+static PyBytesObject *bytes_arg(PyObject *arg, const char *method) {
+  if (arg->type != &py_type_bytes) {
+    py_error("TypeError: %s() argument must be str, not '%s'", method, arg->type->name);
+  }
+  return (PyBytesObject *) arg;
+}
+
+// s.find(sub) - index of the first occurrence, -1 if there isn't one
+static PyObject *bytes_find(PyObject *a, PyObject *sub) {
+  int sub_size = bytes_arg(sub, "find")->size;
+  int a_size = ((PyBytesObject *) a)->size;
+  if (sub_size > a_size) {
+    return py_int_from_long(-1);
+  }
+  return py_int_from_long(simd_find(py_bytes_data(a), a_size, py_bytes_data(sub), sub_size));
+}
+
+// s.count(sub) - non-overlapping occurrences
+static PyObject *bytes_count(PyObject *a, PyObject *sub) {
+  int sub_size = bytes_arg(sub, "count")->size;
+  int a_size = ((PyBytesObject *) a)->size;
+  if (sub_size == 0) {
+    return py_int_from_long(a_size + 1); // as in python: every gap matches
+  } else if (sub_size > a_size) {
+    return py_int_from_long(0);
+  }
+  return py_int_from_long(simd_count(py_bytes_data(a), a_size, py_bytes_data(sub), sub_size));
+}
+
+// NOTE: only the prefix of a rope needs to be flat, but we flatten the lot
+static PyObject *bytes_startswith(PyObject *a, PyObject *prefix) {
+  int prefix_size = bytes_arg(prefix, "startswith")->size;
+  if (prefix_size > ((PyBytesObject *) a)->size) {
+    return py_bool_from_int(0);
+  }
+  return py_bool_from_int(simd_mismatch(py_bytes_data(a), py_bytes_data(prefix), prefix_size) == (size_t) prefix_size);
 }
 
-PyMethodDef bytes_method_defs[] = {
-  { "__add__", py_bytes_add },
-  { "__mult__", py_bytes_multiply },
-  { "__len__", py_bytes_length },
-  { NULL, NULL }
+static const PyCFuncObject bytes_methods[NUM_METHOD_SLOTS] = {
+  PY_METHOD(ADD, "__add__", py_bytes_add),
+  PY_METHOD(MULT, "__mult__", py_bytes_multiply),
+  PY_METHOD(LEN, "__len__", py_bytes_length),
+  PY_METHOD(EQ, "__eq__", py_bytes_equals),
+  PY_METHOD(LT, "__lt__", bytes_less_than),
+  PY_METHOD(GT, "__gt__", bytes_greater_than),
+  PY_METHOD(LE, "__le__", bytes_less_equal),
+  PY_METHOD(GE, "__ge__", bytes_greater_equal),
+  PY_METHOD(FIND, "find", bytes_find),
+  PY_METHOD(COUNT, "count", bytes_count),
+  PY_METHOD(STARTSWITH, "startswith", bytes_startswith),
 };
 
 PyTypeObject py_type_bytes = {
   .base = { .type = &py_type_type },
   .name = "str",
-  .method_defs = bytes_method_defs,
-  .methods = NULL
+  .basic_size = sizeof(PyBytesObject),
+  .item_size = sizeof(char),
+  .methods = bytes_methods
 };
@@ -5,4 +5,13 @@
 
 extern PyTypeObject py_type_bytes;
 
+typedef void (*BytesChunkFunc)(const char *data, int size, void *arg);
+
+PyObject *py_bytes_empty(void); // shared, never mutated
+PyObject *py_bytes_from_string(const char *data, int size);
+const char *py_bytes_data(PyObject *a); // flattens a rope if needed
+void py_bytes_for_each_chunk(PyObject *a, BytesChunkFunc f, void *arg);
+PyObject *py_bytes_add(PyObject *a, PyObject *b);
+PyObject *py_bytes_multiply(PyObject *a, PyObject *b); // b must be an int
+
 #endif
@@ -6,6 +6,7 @@
 PyTypeObject py_type_cfunc = {
   .base = { .type = &py_type_type },
   .name = "cfunc",
-  .method_defs = NULL,
+  .basic_size = sizeof(PyCFuncObject),
+  .item_size = 0,
   .methods = NULL,
 };
@@ -5,4 +5,17 @@
 
 extern PyTypeObject py_type_cfunc;
 
+// a method table entry, for a `static const PyCFuncObject t[NUM_METHOD_SLOTS]`
+// - the whole table is built by the compiler and lives in read-only data
+#define PY_METHOD(slot, method_name, method) \
+  PY_METHOD_FLAGS(slot, method_name, method, METH_O)
+
+#define PY_METHOD_FLAGS(slot, method_name, method, method_flags) \
+  [SLOT_##slot] = { \
+    .base = { .type = &py_type_cfunc }, \
+    .function = (PyCFunction) (method), \
+    .flags = method_flags, \
+    .name = method_name \
+  }
+
 #endif
@@ -1,10 +1,105 @@
 #include <stdlib.h>
+#include <string.h>
 
+#include "code.h"
 #include "type.h"
 
 PyTypeObject py_type_code = {
   .base = { .type = &py_type_type },
   .name = "code",
-  .method_defs = NULL,
+  .basic_size = sizeof(PyCodeObject),
+  .item_size = sizeof(char *),
   .methods = NULL
 };
+
+// NOTE: the line table is a run of (offset delta, line delta) byte pairs
+// starting from (0, first_line) - the line for a bytecode offset is the one
+// in effect after the last entry at or before it. deltas that don't fit in
+// a byte (unsigned offset, signed line) are split over several entries.
+
+void linetable_init(LineTable *lines) {
+  lines->data = NULL;
+  lines->length = 0;
+  lines->size = 0;
+  lines->first_line = 0;
+  lines->last_offset = 0;
+  lines->last_line = 0;
+}
+
+static void linetable_push(LineTable *lines, int offset_delta, int line_delta) {
+  if (lines->length + 2 > lines->size) {
+    lines->size = lines->size == 0 ? 16 : 2 * lines->size;
+    lines->data = realloc(lines->data, lines->size);
+  }
+  lines->data[lines->length++] = (unsigned char) offset_delta;
+  lines->data[lines->length++] = (unsigned char) (signed char) line_delta;
+}
+
+void linetable_add(LineTable *lines, int offset, int line) {
+  if (line <= 0) {
+    return;
+  }
+  if (lines->first_line == 0) {
+    lines->first_line = line;
+    lines->last_line = line;
+    return;
+  }
+  if (line == lines->last_line) {
+    return;
+  }
+  int offset_delta = offset - lines->last_offset;
+  int line_delta = line - lines->last_line;
+  while (offset_delta > 255) {
+    linetable_push(lines, 255, 0);
+    offset_delta -= 255;
+  }
+  while (line_delta > 127 || line_delta < -128) {
+    int step = line_delta > 0 ? 127 : -128;
+    linetable_push(lines, offset_delta, step);
+    offset_delta = 0;
+    line_delta -= step;
+  }
+  linetable_push(lines, offset_delta, line_delta);
+  lines->last_offset = offset;
+  lines->last_line = line;
+}
+
+// NOTE: async-signal-safe - the profiler calls this from SIGPROF
+int py_code_line(PyCodeObject *code, int offset) {
+  int current_offset = 0;
+  int line = code->first_line;
+  for (int i=0; i+1 < code->linetable_length; i += 2) {
+    current_offset += code->linetable[i];
+    if (current_offset > offset) {
+      break;
+    }
+    line += (signed char) code->linetable[i+1];
+  }
+  return line;
+}
+
+// dis-style listing: line (when it changes), offset, instruction - then the
+// same for every code object this one loads as a constant
+void py_code_dump(Writer *w, PyCodeObject *code) {
+  writer_printf(w, "%s:\n", code->name);
+  int last_line = -1;
+  for (int k=0; code->bytecode[k] != NULL; k++) {
+    int line = py_code_line(code, k);
+    if (line != last_line) {
+      writer_printf(w, "%4d %6d %s\n", line, k, code->bytecode[k]);
+      last_line = line;
+    } else {
+      writer_printf(w, "     %6d %s\n", k, code->bytecode[k]);
+    }
+  }
+  for (int k=0; code->bytecode[k] != NULL; k++) {
+    if (strncmp(code->bytecode[k], "LOAD_CONST,", 11) != 0) {
+      continue;
+    }
+    PyObject *value = code->consts[atoi(code->bytecode[k] + 11)];
+    if (value->type == &py_type_code) {
+      writer_puts(w, "\n");
+      py_code_dump(w, (PyCodeObject *) value);
+    }
+  }
+}
@@ -2,7 +2,23 @@
 #define CODE_H
 
 #include "type.h"
+#include "writer.h"
 
 extern PyTypeObject py_type_code;
 
+// builds a code object's line table while we walk the AST
+typedef struct {
+  unsigned char *data;
+  int length;
+  int size;
+  int first_line;
+  int last_offset;
+  int last_line;
+} LineTable;
+
+void linetable_init(LineTable *lines);
+void linetable_add(LineTable *lines, int offset, int line);
+int py_code_line(PyCodeObject *code, int offset);
+void py_code_dump(Writer *w, PyCodeObject *code);
+
 #endif
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dict.h"
+#include "list.h"
+#include "type.h"
+#include "cfunc.h"
+#include "int.h"
+#include "bool.h"
+#include "bytes.h"
+#include "repr.h"
+#include "error.h"
+
+// NOTE: a dict is a HashTable (see hash-table.h) keyed by objects. ints,
+// bools and strs are hashed and compared by value - a bool is the int it
+// stands for, so {1: x} and {True: x} are the same key - anything else by
+// identity, except a dict or a list, which can't be keys at all
+
+#define KEY_REPR_SIZE 128 // of a key in a KeyError
+
+static unsigned int hash_mix(unsigned int h, unsigned long long value) {
+  value *= 0x9e3779b97f4a7c15ULL;
+  return (h ^ (unsigned int) (value >> 32)) * 16777619u;
+}
+
+static void hash_chunk(const char *data, int size, void *arg) {
+  unsigned int *h = arg;
+  for (int i=0; i<size; i++) {
+    *h = (*h ^ (unsigned char) data[i]) * 16777619u;
+  }
+}
+
+static unsigned int key_hash(PyObject *key) {
+  unsigned int h = 2166136261u;
+  if (key->type == &py_type_int) {
+    PyIntObject *n = (PyIntObject *) key;
+    if (n->digits == NULL) {
+      return hash_mix(h, n->value);
+    }
+    h = hash_mix(h, n->size);
+    int num_digits = n->size < 0 ? -n->size : n->size;
+    for (int d=0; d<num_digits; d++) {
+      h = hash_mix(h, n->digits[d]);
+    }
+    return h;
+  } else if (key->type == &py_type_bool) {
+    return hash_mix(h, ((PyBoolObject *) key)->value);
+  } else if (key->type == &py_type_bytes) {
+    // ropes are hashed chunk by chunk - no need to flatten
+    py_bytes_for_each_chunk(key, hash_chunk, &h);
+    return h;
+  } else if (key->type == &py_type_dict || key->type == &py_type_list) {
+    py_error("TypeError: unhashable type: '%s'", key->type->name);
+  }
+  return hash_mix(h, (unsigned long long) (size_t) key);
+}
+
+// a small int or a bool, as a plain C integer - 0 if it's neither
+static int small_int_value(PyObject *obj, long long *value) {
+  if (obj->type == &py_type_int && ((PyIntObject *) obj)->digits == NULL) {
+    *value = ((PyIntObject *) obj)->value;
+    return 1;
+  } else if (obj->type == &py_type_bool) {
+    *value = ((PyBoolObject *) obj)->value;
+    return 1;
+  }
+  return 0;
+}
+
+static int key_equals(const void *stored, const void *key) {
+  PyObject *a = (PyObject *) stored;
+  PyObject *b = (PyObject *) key;
+  if (a == b) {
+    return 1;
+  }
+  long long a_value, b_value;
+  if (small_int_value(a, &a_value) && small_int_value(b, &b_value)) {
+    return a_value == b_value;
+  }
+  if (a->type != b->type) {
+    return 0;
+  }
+  if (a->type == &py_type_int) {
+    // NOTE: ints are normalised, so a bignum never equals a small int
+    PyIntObject *ia = (PyIntObject *) a;
+    PyIntObject *ib = (PyIntObject *) b;
+    int num_digits = ia->size < 0 ? -ia->size : ia->size;
+    return ia->digits != NULL && ib->digits != NULL && ia->size == ib->size
+      && memcmp(ia->digits, ib->digits, num_digits * sizeof(ia->digits[0])) == 0;
+  } else if (a->type == &py_type_bytes) {
+    int size = ((PyBytesObject *) a)->size;
+    return size == ((PyBytesObject *) b)->size && memcmp(py_bytes_data(a), py_bytes_data(b), size) == 0;
+  }
+  return 0;
+}
+
+static void key_error(PyObject *key) {
+  char formatted[KEY_REPR_SIZE];
+  py_object_repr_buffer(key, formatted, sizeof(formatted));
+  py_error("KeyError: %s", formatted);
+}
+
+PyObject *py_dict_new(int size_hint) {
+  PyDictObject *dict = (PyDictObject *) py_type_alloc(&py_type_dict);
+  hashtable_init(&dict->table);
+  dict->table.owns_keys = 0;
+  if (size_hint > 0) {
+    hashtable_reserve(&dict->table, size_hint);
+  }
+  return (PyObject *) dict;
+}
+
+PyObject *py_dict_get_item(PyObject *dict, PyObject *key) {
+  Entry *entry = hashtable_lookup(&((PyDictObject *) dict)->table, key_hash(key), key, key_equals);
+  return entry != NULL ? entry->object : NULL;
+}
+
+void py_dict_set_item(PyObject *dict, PyObject *key, PyObject *value) {
+  HashTable *table = &((PyDictObject *) dict)->table;
+  unsigned int h = key_hash(key);
+  Entry *entry = hashtable_lookup(table, h, key, key_equals);
+  if (entry != NULL) {
+    // NOTE: the key that was there first stays, as in python
+    entry->object = value;
+    return;
+  }
+  hashtable_add(table, h, key, value);
+}
+
+// METHODS
+
+static PyObject *dict_length(PyObject *self, PyObject *dict) {
+  return py_int_from_long(((PyDictObject *) dict)->table.itemCount);
+}
+
+static PyObject *dict_getitem(PyObject *dict, PyObject *key) {
+  PyObject *value = py_dict_get_item(dict, key);
+  if (value == NULL) {
+    key_error(key);
+  }
+  return value;
+}
+
+// d[key] = value - args are the key and the value
+static PyObject *dict_setitem(PyObject *dict, PyObject *const *args, size_t nargs) {
+  if (nargs != 2) {
+    py_error("TypeError: __setitem__ expected 2 arguments, got %zu", nargs);
+  }
+  py_dict_set_item(dict, args[0], args[1]);
+  return NULL;
+}
+
+static PyObject *dict_delitem(PyObject *dict, PyObject *key) {
+  if (!hashtable_delete(&((PyDictObject *) dict)->table, key_hash(key), key, key_equals)) {
+    key_error(key);
+  }
+  return NULL;
+}
+
+// NOTE: there's no None yet, so the default isn't optional
+static PyObject *dict_get(PyObject *dict, PyObject *const *args, size_t nargs) {
+  if (nargs != 2) {
+    py_error("TypeError: get() takes exactly 2 arguments (%zu given)", nargs);
+  }
+  PyObject *value = py_dict_get_item(dict, args[0]);
+  return value != NULL ? value : args[1];
+}
+
+static PyObject *dict_iter(PyObject *dict, PyObject *unused) {
+  PyDictIterObject *iter = (PyDictIterObject *) py_type_alloc(&py_type_dict_iterator);
+  iter->dict = (PyDictObject *) dict;
+  iter->pos = 0;
+  iter->size = iter->dict->table.itemCount;
+  return (PyObject *) iter;
+}
+
+// the keys, in the order they went in
+static PyObject *dict_iter_next(PyObject *self, PyObject *unused) {
+  PyDictIterObject *iter = (PyDictIterObject *) self;
+  HashTable *table = &iter->dict->table;
+  if (table->itemCount != iter->size) {
+    py_error("RuntimeError: dictionary changed size during iteration");
+  }
+  Entry *entry;
+  return hashtable_next(table, &iter->pos, &entry) ? entry->key : NULL;
+}
+
+static PyObject *dict_iter_self(PyObject *self, PyObject *unused) {
+  return self;
+}
+
+static const PyCFuncObject dict_methods[NUM_METHOD_SLOTS] = {
+  PY_METHOD(LEN, "__len__", dict_length),
+  PY_METHOD(GETITEM, "__getitem__", dict_getitem),
+  PY_METHOD_FLAGS(SETITEM, "__setitem__", dict_setitem, METH_FASTCALL),
+  PY_METHOD(DELITEM, "__delitem__", dict_delitem),
+  PY_METHOD_FLAGS(ITER, "__iter__", dict_iter, METH_NOARGS),
+  PY_METHOD_FLAGS(GET, "get", dict_get, METH_FASTCALL),
+};
+
+static const PyCFuncObject dict_iter_methods[NUM_METHOD_SLOTS] = {
+  PY_METHOD_FLAGS(ITER, "__iter__", dict_iter_self, METH_NOARGS),
+  PY_METHOD_FLAGS(NEXT, "__next__", dict_iter_next, METH_NOARGS),
+};
+
+PyTypeObject py_type_dict = {
+  .base = { .type = &py_type_type },
+  .name = "dict",
+  .basic_size = sizeof(PyDictObject),
+  .item_size = 0,
+  .methods = dict_methods
+};
+
+PyTypeObject py_type_dict_iterator = {
+  .base = { .type = &py_type_type },
+  .name = "dict_keyiterator",
+  .basic_size = sizeof(PyDictIterObject),
+  .item_size = 0,
+  .methods = dict_iter_methods
+};
@@ -0,0 +1,13 @@
+#ifndef DICT_H
+#define DICT_H
+
+#include "type.h"
+
+extern PyTypeObject py_type_dict;
+extern PyTypeObject py_type_dict_iterator;
+
+PyObject *py_dict_new(int size_hint); // room for size_hint keys up front
+PyObject *py_dict_get_item(PyObject *dict, PyObject *key); // NULL if it isn't there
+void py_dict_set_item(PyObject *dict, PyObject *key, PyObject *value);
+
+#endif
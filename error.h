@@ -0,0 +1,10 @@
+#ifndef ERROR_H
+#define ERROR_H
+
+// raise an error in the interpreter running on this thread: "TypeError:
+// ...", no trailing newline. it unwinds to py_interp_run/py_interp_exec,
+// which hand the message back to the host. with no interpreter running
+// (e.g. compiling for --dis) the message is printed and we exit(1)
+void py_error(const char *fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+#endif
@@ -0,0 +1,1180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "eval.h"
+#include "error.h"
+#include "hash-table.h"
+#include "parser.h"
+#include "type.h"
+#include "cfunc.h"
+#include "func.h"
+#include "int.h"
+#include "tuple.h"
+#include "bytes.h"
+#include "bool.h"
+#include "range.h"
+#include "frame.h"
+#include "opcode.h"
+#include "stats.h"
+#include "jit.h"
+#include "quicken.h"
+#include "memo.h"
+#include "gen.h"
+#include "dict.h"
+#include "list.h"
+#include "memstats.h"
+
+#define MAX_RECURSION_DEPTH 1000
+#define DEADLINE_INTERVAL 4096 // backward jumps and calls between clock reads
+
+void stack_init(Stack *s) {
+  s->top = -1;
+}
+
+int stack_is_empty(Stack *s) {
+  return s->top == -1;
+}
+
+int stack_is_full(Stack *s) {
+  return s->top == MAX_STACK_SIZE - 1;
+}
+
+void stack_push(Stack *s, PyObject *object) {
+  if (stack_is_full(s)) {
+    py_error("Stack overflow!");
+  } else
+    s->data[++s->top] = object;
+}
+
+PyObject *stack_pop(Stack *s) {
+  if (stack_is_empty(s)) {
+    py_error("Stack underflow!");
+  } else
+    return s->data[s->top--];
+}
+
+// pop n items at once, without looking at them
+void stack_drop(Stack *s, int n) {
+  if (s->top + 1 < n) {
+    py_error("Stack underflow!");
+  }
+  s->top -= n;
+}
+
+/* TODO: fix after breaking with PyObjects
+void stack_print(Stack *s) {
+  if (stack_is_empty(s))
+    printf("[]\n");
+  else {
+    int i;
+    printf("[%d", *s->data[0]); 
+    for (i = 1; i <= s->top; i++)
+      printf(", %d", *s->data[i]);
+    printf("]\n");
+  }
+}
+*/
+
+
+void py_frame_object_init(PyFrameObject *frame, HashTable *locals) {
+  frame->code = NULL;
+  frame->bytecode_offset = 0;
+  frame->prev = NULL;
+  frame->memo = NULL;
+  frame->gen = NULL;
+  frame->temps = NULL;
+  frame->num_temps = 0;
+  frame->value_stack = malloc(sizeof(Stack));
+  stack_init(frame->value_stack);
+  // in module-level frame we pass in our own locals (pointer to module dict)
+  if (locals == NULL) {
+    frame->locals = malloc(sizeof(HashTable));
+    hashtable_init(frame->locals);
+  } else {
+    frame->locals = locals; 
+  }
+}
+
+PyFrameObject *py_frame_new(void) {
+  PyFrameObject *frame = malloc(sizeof(PyFrameObject));
+  py_frame_object_init(frame, NULL);
+  if (memstats_enabled) {
+    memstats_record("frame", 1, sizeof(PyFrameObject) + sizeof(Stack) + sizeof(HashTable));
+  }
+  return frame;
+}
+
+
+
+
+// indexed by BinOp
+static const MethodSlot binary_op_slot_table[] = {
+  SLOT_ADD,
+  SLOT_SUB,
+  SLOT_MULT,
+  SLOT_DIV,
+  SLOT_EQ,
+  SLOT_LT,
+  SLOT_GT,
+  SLOT_LE,
+  SLOT_GE,
+  SLOT_FLOORDIV,
+  SLOT_MOD
+};
+
+static const int num_binary_op_methods = sizeof(binary_op_slot_table) / sizeof(binary_op_slot_table[0]);
+
+int equals_opcode(const char *input, size_t len, const char *cmd) {
+  return (strlen(cmd) == len) && (strncmp(input, cmd, len) == 0);
+}
+
+OpCode get_opcode(const char *input) {
+  int i = 0;
+  while (input[i] != ',' && input[i] != '\0')
+    i++;
+  
+  // TODO: use get_opcode and switch-case
+  if (equals_opcode(input, i, "LOAD_CONST"))
+    return OP_LOAD_CONST;
+  else if (equals_opcode(input, i, "BINARY_OP"))
+    return OP_BINARY_OP;
+  else if (equals_opcode(input, i, "BINARY_ADD_INT"))
+    return OP_BINARY_ADD_INT;
+  else if (equals_opcode(input, i, "BINARY_ADD_BYTES"))
+    return OP_BINARY_ADD_BYTES;
+  else if (equals_opcode(input, i, "BINARY_MULT_BYTES_INT"))
+    return OP_BINARY_MULT_BYTES_INT;
+  else if (equals_opcode(input, i, "RETURN"))
+    return OP_RETURN;
+  else if (equals_opcode(input, i, "LOAD_NAME"))
+    return OP_LOAD_NAME;
+  else if (equals_opcode(input, i, "STORE_NAME"))
+    return OP_STORE_NAME;
+  else if (equals_opcode(input, i, "MAKE_FUNCTION"))
+    return OP_MAKE_FUNCTION;
+  else if (equals_opcode(input, i, "CALL_FUNCTION"))
+    return OP_CALL_FUNCTION;
+  else if (equals_opcode(input, i, "TAIL_CALL"))
+    return OP_TAIL_CALL;
+  else if (equals_opcode(input, i, "POP_TOP"))
+    return OP_POP_TOP;
+  else if (equals_opcode(input, i, "COMPARE"))
+    return OP_COMPARE;
+  else if (equals_opcode(input, i, "POP_JUMP_IF_FALSE"))
+    return OP_POP_JUMP_IF_FALSE;
+  else if (equals_opcode(input, i, "COMPARE_AND_JUMP"))
+    return OP_COMPARE_AND_JUMP;
+  else if (equals_opcode(input, i, "JUMP"))
+    return OP_JUMP;
+  else if (equals_opcode(input, i, "JUMP_BACKWARD"))
+    return OP_JUMP_BACKWARD;
+  else if (equals_opcode(input, i, "GET_RANGE"))
+    return OP_GET_RANGE;
+  else if (equals_opcode(input, i, "FOR_RANGE"))
+    return OP_FOR_RANGE;
+  else if (equals_opcode(input, i, "INLINE_GUARD"))
+    return OP_INLINE_GUARD;
+  else if (equals_opcode(input, i, "YIELD_VALUE"))
+    return OP_YIELD_VALUE;
+  else if (equals_opcode(input, i, "RESUME"))
+    return OP_RESUME;
+  else if (equals_opcode(input, i, "CALL_METHOD"))
+    return OP_CALL_METHOD;
+  else if (equals_opcode(input, i, "BUILD_MAP"))
+    return OP_BUILD_MAP;
+  else if (equals_opcode(input, i, "MAP_ADD"))
+    return OP_MAP_ADD;
+  else if (equals_opcode(input, i, "BUILD_LIST"))
+    return OP_BUILD_LIST;
+  else if (equals_opcode(input, i, "LIST_APPEND"))
+    return OP_LIST_APPEND;
+  else if (equals_opcode(input, i, "BINARY_SUBSCR"))
+    return OP_BINARY_SUBSCR;
+  else if (equals_opcode(input, i, "STORE_SUBSCR"))
+    return OP_STORE_SUBSCR;
+  else if (equals_opcode(input, i, "DELETE_SUBSCR"))
+    return OP_DELETE_SUBSCR;
+  else if (equals_opcode(input, i, "GET_ITER"))
+    return OP_GET_ITER;
+  else if (equals_opcode(input, i, "STORE_TEMP"))
+    return OP_STORE_TEMP;
+  else if (equals_opcode(input, i, "LOAD_TEMP"))
+    return OP_LOAD_TEMP;
+  else
+    return OP_UNKNOWN;
+}
+
+int get_operand(const char *input) {
+  int c;
+  int i = 0;
+  while ((c = input[i]) != ',') {
+    if (c == '\0')
+      return -1; // no operand
+    i++;
+  }
+
+  return atoi(input + i + 1);
+}
+
+// e.g. 1 for "FOR_RANGE,12,1"
+int get_second_operand(const char *input) {
+  const char *first = strchr(input, ',');
+  const char *second = first != NULL ? strchr(first + 1, ',') : NULL;
+  if (second == NULL)
+    return -1; // no operand
+  return atoi(second + 1);
+}
+
+char *get_string_operand(const char *input) {
+
+  int c;
+  int i = 0;
+  while ((c = input[i]) != ',') {
+    if (c == '\0')
+      return NULL;
+    i++;
+  }
+
+  // now strip name from '---' bit
+  char *operand = malloc(strlen(input) - i);
+  int j = 0;
+  i++; i++;
+  while ((c = input[i]) != '\'') {
+    operand[j] = c;
+    j++;
+    i++;
+  }
+  operand[j] = '\0';
+
+  return operand;  
+}
+
+// call a builtin with its arguments in place, following its METH_* flags
+// NOTE: only METH_VARARGS builtins cost a tuple allocation
+static PyObject *cfunc_call(PyCFuncObject *cfunc, PyObject *const *args, int nargs) {
+  switch (cfunc->flags) {
+    case METH_FASTCALL:
+      return ((PyCFunctionFast) cfunc->function)(NULL, args, nargs);
+    case METH_NOARGS:
+      if (nargs != 0) {
+        py_error("TypeError: %s() takes no arguments (%d given)", cfunc->name, nargs);
+      }
+      return cfunc->function(NULL, NULL);
+    case METH_O:
+      if (nargs != 1) {
+        py_error("TypeError: %s() takes exactly one argument (%d given)", cfunc->name, nargs);
+      }
+      return cfunc->function(NULL, args[0]);
+    default: {
+      PyTupleObject *py_args = (PyTupleObject *) py_tuple_new(nargs);
+      for (int j=0; j < nargs; j++) {
+        py_args->elements[j] = args[j];
+      }
+      return cfunc->function(NULL, (PyObject *) py_args);
+    }
+  }
+}
+
+// NOTE: eval_* do one instruction's work on operands that are already
+// decoded. handle_bytecode decodes the bytecode string and calls them, the
+// JIT calls them straight from native code (see jit.c)
+
+void eval_load_const(PyState *state, int idx) {
+  // get obj from pre-compiled consts array
+  PyObject *constant = state->current_frame->code->consts[idx];
+  stack_push(state->current_frame->value_stack, constant);
+  state->current_frame->bytecode_offset += 1; // move us forward one instruction
+}
+
+void eval_store_name(PyState *state, const char *varname) {
+  // save stack[-1] to variable named operand
+  PyObject *top = stack_pop(state->current_frame->value_stack);
+  hashtable_insert(state->current_frame->locals, varname, top); // in bottom frame this points to globals
+  state->current_frame->bytecode_offset += 1;
+}
+
+// NOTE: temps hold an inlined call's arguments, so they're the frame's own
+// and never go near the globals. a frame reused by TAIL_CALL may be running
+// code that wants more of them, hence the check against the code
+void eval_store_temp(PyState *state, int slot) {
+  PyFrameObject *frame = state->current_frame;
+  if (frame->num_temps < frame->code->num_temps) {
+    size_t old_size = frame->num_temps * sizeof(PyObject *);
+    frame->num_temps = frame->code->num_temps;
+    frame->temps = realloc(frame->temps, frame->num_temps * sizeof(PyObject *));
+    if (frame->temps == NULL) {
+      py_error("MemoryError");
+    }
+    if (memstats_enabled) {
+      memstats_record("frame", 0, (long long) (frame->num_temps * sizeof(PyObject *) - old_size));
+    }
+  }
+  frame->temps[slot] = stack_pop(frame->value_stack);
+  frame->bytecode_offset += 1;
+}
+
+void eval_load_temp(PyState *state, int slot) {
+  PyFrameObject *frame = state->current_frame;
+  stack_push(frame->value_stack, frame->temps[slot]);
+  frame->bytecode_offset += 1;
+}
+
+void eval_load_name(PyState *state, const char *varname) {
+  // lookup in locals then globals
+  PyObject *localobject = hashtable_get(state->current_frame->locals, varname);
+  if (localobject != NULL) {
+    stack_push(state->current_frame->value_stack, localobject);
+  } else {
+    PyObject *globalobject = hashtable_get(state->globals, varname); 
+    if (globalobject != NULL) {
+      stack_push(state->current_frame->value_stack, globalobject);
+    } else {
+      py_error("NameError: name '%s' is not defined", varname);
+    }
+  }
+  state->current_frame->bytecode_offset += 1;
+}
+
+void eval_binary_op(PyState *state, int bin_op) {
+  // get binary operator and map it to the dunder method on `type(a)`
+  if (bin_op < 0 || bin_op >= num_binary_op_methods) {
+    py_error("OperatorError: unhandled operator %d", bin_op);
+  }
+  MethodSlot slot = binary_op_slot_table[bin_op];
+  PyObject *b = stack_pop(state->current_frame->value_stack);
+  PyObject *a = stack_pop(state->current_frame->value_stack);
+  if (state->quicken) {
+    quicken_binary_op(state->current_frame->code, state->current_frame->bytecode_offset, bin_op, a, b);
+  }
+  // assume all dunder methods are builtins
+  const PyCFuncObject *_method = py_type_method(a->type, slot);
+  if (_method == NULL) {
+    py_error("AttributeError: %s", py_method_names[slot]);
+  }
+  PyObject *result = _method->function(a, b);
+  stack_push(state->current_frame->value_stack, result);
+  state->current_frame->bytecode_offset += 1;
+}
+
+// NOTE: specialised forms of BINARY_OP, written over it by quicken.c. each
+// checks the operand types it was specialised for - if they've changed the
+// instruction goes back to BINARY_OP, which runs this time round too
+
+static int binary_guard_failed(PyState *state, OpCode opcode, int bin_op, PyTypeObject *type_a, PyTypeObject *type_b) {
+  Stack *value_stack = state->current_frame->value_stack;
+  if (value_stack->data[value_stack->top - 1]->type == type_a && value_stack->data[value_stack->top]->type == type_b) {
+    return 0;
+  }
+  quicken_deopt(state->current_frame->code, state->current_frame->bytecode_offset, opcode);
+  eval_binary_op(state, bin_op);
+  return 1;
+}
+
+// replace the two operands with the result
+static void binary_result(PyState *state, PyObject *result) {
+  Stack *value_stack = state->current_frame->value_stack;
+  value_stack->data[--value_stack->top] = result;
+  state->current_frame->bytecode_offset += 1;
+}
+
+void eval_binary_add_int(PyState *state) {
+  if (binary_guard_failed(state, OP_BINARY_ADD_INT, ADD, &py_type_int, &py_type_int))
+    return;
+  Stack *value_stack = state->current_frame->value_stack;
+  PyIntObject *a = (PyIntObject *) value_stack->data[value_stack->top - 1];
+  PyIntObject *b = (PyIntObject *) value_stack->data[value_stack->top];
+  long long value;
+  if (a->digits == NULL && b->digits == NULL && !__builtin_add_overflow(a->value, b->value, &value)) {
+    binary_result(state, py_int_from_long(value));
+  } else {
+    binary_result(state, py_int_add((PyObject *) a, (PyObject *) b));
+  }
+}
+
+void eval_binary_add_bytes(PyState *state) {
+  if (binary_guard_failed(state, OP_BINARY_ADD_BYTES, ADD, &py_type_bytes, &py_type_bytes))
+    return;
+  Stack *value_stack = state->current_frame->value_stack;
+  binary_result(state, py_bytes_add(value_stack->data[value_stack->top - 1], value_stack->data[value_stack->top]));
+}
+
+void eval_binary_mult_bytes_int(PyState *state) {
+  if (binary_guard_failed(state, OP_BINARY_MULT_BYTES_INT, MULT, &py_type_bytes, &py_type_int))
+    return;
+  Stack *value_stack = state->current_frame->value_stack;
+  binary_result(state, py_bytes_multiply(value_stack->data[value_stack->top - 1], value_stack->data[value_stack->top]));
+}
+
+void eval_make_function(PyState *state) {
+  // make func obj
+  PyFuncObject *new_func = (PyFuncObject *) py_type_alloc(&py_type_func);
+  new_func->code = (PyCodeObject *) stack_pop(state->current_frame->value_stack); 
+  // push to stack - next opcode will be STORE_NAME...
+  stack_push(state->current_frame->value_stack, (PyObject *) new_func);
+  state->current_frame->bytecode_offset += 1;
+}
+
+// call a python function with its arguments in place on the value stack -
+// returns the new frame, which is now the current one
+static PyFrameObject *push_frame(PyState *state, PyFuncObject *func, PyObject **args, int arg_count) {
+  if (state->recursion_depth == MAX_RECURSION_DEPTH) {
+    py_error("RecursionError: maximum recursion depth exceeded");
+  }
+  // init new frame and populate locals
+  PyFrameObject *new_frame = py_frame_new();
+  for (int j=0; j < arg_count; j++) {
+    hashtable_insert(new_frame->locals, func->code->argnames[j], args[j]);
+  }
+  stack_drop(state->current_frame->value_stack, arg_count + 1);
+  new_frame->prev = state->current_frame;
+  new_frame->code = func->code;
+  // increment pc on the current frame so we pop back to the next instruction
+  state->current_frame->bytecode_offset += 1;
+  state->current_frame = new_frame;
+  state->recursion_depth += 1;
+  return new_frame;
+}
+
+// switch to a generator's frame, to run until YIELD_VALUE or RETURN
+// switches back. the resumer's pc has already moved on
+static void resume_generator(PyState *state, PyGenObject *gen, int on_finish) {
+  if (gen->running) {
+    py_error("ValueError: generator already executing");
+  }
+  if (state->recursion_depth == MAX_RECURSION_DEPTH) {
+    py_error("RecursionError: maximum recursion depth exceeded");
+  }
+  gen->running = 1;
+  gen->on_finish = on_finish;
+  gen->frame->prev = state->current_frame;
+  state->current_frame = gen->frame;
+  state->recursion_depth += 1;
+}
+
+// sum(gen[, start]), min(gen) or max(gen) on a live generator? builtins
+// can't resume one, so we run it and fold each yield in - see
+// eval_call_function
+static int folds_generator(PyCFuncObject *f, PyObject **args, int arg_count) {
+  int takes_start = f->function == (PyCFunction) py_builtin_sum;
+  if (!takes_start && f->function != (PyCFunction) py_builtin_min && f->function != (PyCFunction) py_builtin_max) {
+    return 0;
+  }
+  return (arg_count == 1 || (arg_count == 2 && takes_start))
+    && args[0]->type == &py_type_generator && ((PyGenObject *) args[0])->frame != NULL;
+}
+
+// can a TAIL_CALL to `f` run in the current frame? not if either side is
+// a generator - its frame has to outlive the call
+static int reuses_frame(PyState *state, PyObject *f) {
+  return state->tail_calls && f->type == &py_type_func
+    && !((PyFuncObject *) f)->code->is_generator
+    && state->current_frame->prev != NULL && state->current_frame->gen == NULL;
+}
+
+long long eval_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// NOTE: a script can only keep running by jumping back or calling, so
+// those are the two places the deadline is checked
+static void check_deadline(PyState *state) {
+  if (state->deadline == 0 || --state->deadline_countdown > 0) {
+    return;
+  }
+  state->deadline_countdown = DEADLINE_INTERVAL;
+  if (eval_clock() >= state->deadline) {
+    py_error("RuntimeError: time limit exceeded");
+  }
+}
+
+int eval_call_function(PyState *state, int arg_count, int tail) {
+  check_deadline(state);
+  // push a new frame to callstack, remembering our
+  // current bytecode offset in the current frame
+  // NOTE: top of value stack needs to be a function lol
+  // NOTE: args are read in place from the value stack, [callable, *args]
+  Stack *value_stack = state->current_frame->value_stack;
+  if (value_stack->top < arg_count) {
+    py_error("Stack underflow!");
+  }
+  PyObject **args = &value_stack->data[value_stack->top - arg_count + 1];
+  PyObject *f = args[-1];
+  if (tail && reuses_frame(state, f)) {
+    // NOTE: nothing in this frame is needed after the call, so run the
+    // callee in it - rebind locals, drop the stack, restart the pc
+    PyFuncObject *func = (PyFuncObject *) f;
+    PyFrameObject *frame = state->current_frame;
+    hashtable_clear(frame->locals);
+    for (int j=0; j < arg_count; j++) {
+      hashtable_insert(frame->locals, func->code->argnames[j], args[j]);
+    }
+    stack_init(value_stack);
+    frame->code = func->code;
+    frame->bytecode_offset = 0;
+    return 1;
+  } else if (f->type == &py_type_func && ((PyFuncObject *) f)->code->is_generator) {
+    // NOTE: none of the body runs until the generator is first resumed
+    PyObject *gen = py_gen_new(((PyFuncObject *) f)->code, args, arg_count);
+    stack_drop(value_stack, arg_count + 1);
+    stack_push(value_stack, gen);
+    state->current_frame->bytecode_offset += 1;
+    return 0;
+  } else if (f->type == &py_type_func) {
+    // python functions
+    push_frame(state, (PyFuncObject *) f, args, arg_count);
+    return 1;
+  } else if (f->type == &py_type_memo) {
+    // memoize() wrappers - a hit never gets as far as the function
+    PyMemoObject *memo = (PyMemoObject *) f;
+    MemoKey key;
+    int cacheable = py_memo_key(&key, args, arg_count);
+    PyObject *result = cacheable ? py_memo_lookup(memo, &key) : NULL;
+    if (result == NULL && memo->func->type == &py_type_func) {
+      PyFrameObject *new_frame = push_frame(state, (PyFuncObject *) memo->func, args, arg_count);
+      if (cacheable) {
+        // RETURN fills the entry in
+        new_frame->memo = memo;
+        new_frame->memo_key = key;
+      }
+      return 1;
+    }
+    if (result == NULL) {
+      result = cfunc_call((PyCFuncObject *) memo->func, args, arg_count);
+      if (cacheable) {
+        py_memo_insert(memo, &key, result);
+      }
+    }
+    stack_drop(value_stack, arg_count + 1);
+    stack_push(value_stack, result);
+    state->current_frame->bytecode_offset += 1;
+    return 0;
+  } else if (f->type == &py_type_cfunc) {
+    if (((PyCFuncObject *) f)->function == (PyCFunction) py_builtin_next
+        && (arg_count == 1 || arg_count == 2) && args[0]->type == &py_type_generator
+        && ((PyGenObject *) args[0])->frame != NULL) {
+      // next() on a live generator - its YIELD_VALUE pushes our result
+      PyGenObject *gen = (PyGenObject *) args[0];
+      if (arg_count == 2) {
+        gen->default_value = args[1];
+      }
+      stack_drop(value_stack, arg_count + 1);
+      state->current_frame->bytecode_offset += 1;
+      resume_generator(state, gen, arg_count == 2 ? GEN_NEXT_DEFAULT : GEN_NEXT);
+      return 1;
+    }
+    if (folds_generator((PyCFuncObject *) f, args, arg_count)) {
+      // run it to the end with each yield folded into the result, which
+      // it pushes when it's finished - nothing's kept but the running value
+      PyGenObject *gen = (PyGenObject *) args[0];
+      py_builtin_fold_start(&gen->fold, (PyCFuncObject *) f, args, arg_count);
+      stack_drop(value_stack, arg_count + 1);
+      state->current_frame->bytecode_offset += 1;
+      resume_generator(state, gen, GEN_FOLD);
+      return 1;
+    }
+    PyObject *result = cfunc_call((PyCFuncObject *) f, args, arg_count);
+    stack_drop(value_stack, arg_count + 1);
+    stack_push(value_stack, result);
+    state->current_frame->bytecode_offset += 1; 
+    return 0;
+  } else {
+    py_error("TypeError: '%s' object is not callable", f->type->name);
+  }
+}
+
+// a generator's RETURN: whatever it returns is dropped, and whoever
+// resumed it finds out it's finished instead of getting a value
+static void finish_generator(PyState *state, PyGenObject *gen) {
+  state->current_frame = gen->frame->prev;
+  state->recursion_depth -= 1;
+  gen->frame = NULL;
+  gen->running = 0;
+  Stack *value_stack = state->current_frame->value_stack;
+  switch (gen->on_finish) {
+    case GEN_NEXT:
+      py_error("StopIteration");
+    case GEN_NEXT_DEFAULT:
+      stack_push(value_stack, gen->default_value);
+      break;
+    case GEN_FOLD:
+      stack_push(value_stack, py_builtin_fold_end(&gen->fold));
+      break;
+    default:
+      // leave the loop RESUME is in
+      stack_drop(value_stack, 1);
+      state->current_frame->bytecode_offset = gen->on_finish;
+  }
+}
+
+// CALL_METHOD - slot is -1 if no type has a method called `name`
+// NOTE: methods are builtins, so they never push a frame
+void eval_call_method(PyState *state, int slot, int arg_count, const char *name) {
+  Stack *value_stack = state->current_frame->value_stack;
+  PyObject **args = &value_stack->data[value_stack->top - arg_count + 1];
+  PyObject *receiver = args[-1];
+  const PyCFuncObject *method = slot >= 0 ? py_type_method(receiver->type, slot) : NULL;
+  if (method == NULL) {
+    py_error("AttributeError: '%s' object has no attribute '%s'", receiver->type->name, name);
+  }
+  PyObject *result;
+  switch (method->flags) {
+    case METH_FASTCALL:
+      result = ((PyCFunctionFast) method->function)(receiver, args, arg_count);
+      break;
+    case METH_O:
+      if (arg_count != 1) {
+        py_error("TypeError: %s() takes exactly one argument (%d given)", name, arg_count);
+      }
+      result = method->function(receiver, args[0]);
+      break;
+    default:
+      if (arg_count != 0) {
+        py_error("TypeError: %s() takes no arguments (%d given)", name, arg_count);
+      }
+      result = method->function(receiver, NULL);
+  }
+  stack_drop(value_stack, arg_count + 1);
+  stack_push(value_stack, result);
+  state->current_frame->bytecode_offset += 1;
+}
+
+void eval_return(PyState *state) {
+  // pop a frame from the callstack, return to the
+  // bytecode instruction referenced in the caller frame
+  // (and push the return'd value to the value stack of
+  // of the frame below)
+  PyFrameObject *old_frame = state->current_frame;
+  if (old_frame->gen != NULL) {
+    finish_generator(state, old_frame->gen);
+    return;
+  }
+  PyObject *return_value = stack_pop(state->current_frame->value_stack);
+  if (old_frame->memo != NULL) {
+    py_memo_insert(old_frame->memo, &old_frame->memo_key, return_value);
+  }
+  // jump to prev frame and push the return value
+  state->current_frame = old_frame->prev;
+  stack_push(state->current_frame->value_stack, return_value);
+  state->recursion_depth -= 1;
+  // TODO: deallocate old frame!
+}
+
+// hand the top of the stack to whoever resumed us, with our pc left on
+// the instruction to carry on from next time
+void eval_yield_value(PyState *state) {
+  PyFrameObject *frame = state->current_frame;
+  PyObject *value = stack_pop(frame->value_stack);
+  frame->bytecode_offset += 1;
+  if (frame->gen->fold.builtin != NULL) {
+    // being run to the end for sum/min/max - keep going
+    py_builtin_fold(&frame->gen->fold, value);
+    return;
+  }
+  frame->gen->running = 0;
+  state->current_frame = frame->prev;
+  state->recursion_depth -= 1;
+  stack_push(state->current_frame->value_stack, value);
+}
+
+// push the next value of the iterator on top of the stack - a generator is
+// run to its next yield, which pushes it. once the iterator is exhausted,
+// it's popped and we go to `end`. returns 1 if we're now running a generator
+int eval_resume(PyState *state, int end) {
+  Stack *value_stack = state->current_frame->value_stack;
+  PyObject *top = value_stack->data[value_stack->top];
+  if (top->type != &py_type_generator) {
+    PyObject *value;
+    if (top->type == &py_type_list_iterator) {
+      value = py_list_iter_next(top); // no call through the slot
+    } else {
+      const PyCFuncObject *_next = py_type_method(top->type, SLOT_NEXT);
+      if (_next == NULL) {
+        py_error("TypeError: '%s' object is not an iterator", top->type->name);
+      }
+      value = _next->function(top, NULL);
+    }
+    if (value == NULL) {
+      stack_drop(value_stack, 1);
+      state->current_frame->bytecode_offset = end;
+    } else {
+      stack_push(value_stack, value);
+      state->current_frame->bytecode_offset += 1;
+    }
+    return 0;
+  }
+  PyGenObject *gen = (PyGenObject *) top;
+  if (gen->frame == NULL) {
+    stack_drop(value_stack, 1);
+    state->current_frame->bytecode_offset = end;
+    return 0;
+  }
+  state->current_frame->bytecode_offset += 1;
+  resume_generator(state, gen, end);
+  return 1;
+}
+
+// GET_ITER: generators are their own iterators, anything else with an
+// __iter__ makes one
+void eval_get_iter(PyState *state) {
+  Stack *value_stack = state->current_frame->value_stack;
+  PyObject *top = value_stack->data[value_stack->top];
+  const PyCFuncObject *_iter = py_type_method(top->type, SLOT_ITER);
+  if (_iter == NULL) {
+    py_error("TypeError: '%s' object is not iterable", top->type->name);
+  }
+  value_stack->data[value_stack->top] = _iter->function(top, NULL);
+  state->current_frame->bytecode_offset += 1;
+}
+
+// SUBSCRIPTS
+// NOTE: the container's __getitem__ etc. are called directly - their
+// flags are fixed (METH_O, except __setitem__'s METH_FASTCALL)
+
+static const PyCFuncObject *subscript_method(PyObject *container, MethodSlot slot, const char *error) {
+  const PyCFuncObject *_method = py_type_method(container->type, slot);
+  if (_method == NULL) {
+    py_error("TypeError: '%s' object %s", container->type->name, error);
+  }
+  return _method;
+}
+
+void eval_binary_subscr(PyState *state) {
+  Stack *value_stack = state->current_frame->value_stack;
+  PyObject *container = value_stack->data[value_stack->top - 1];
+  PyObject *index = value_stack->data[value_stack->top];
+  const PyCFuncObject *_getitem = subscript_method(container, SLOT_GETITEM, "is not subscriptable");
+  binary_result(state, _getitem->function(container, index));
+}
+
+void eval_store_subscr(PyState *state) {
+  Stack *value_stack = state->current_frame->value_stack;
+  PyObject *container = value_stack->data[value_stack->top - 1];
+  PyObject *args[2] = { value_stack->data[value_stack->top], value_stack->data[value_stack->top - 2] };
+  const PyCFuncObject *_setitem = subscript_method(container, SLOT_SETITEM, "does not support item assignment");
+  ((PyCFunctionFast) _setitem->function)(container, args, 2);
+  stack_drop(value_stack, 3);
+  state->current_frame->bytecode_offset += 1;
+}
+
+void eval_delete_subscr(PyState *state) {
+  Stack *value_stack = state->current_frame->value_stack;
+  PyObject *container = value_stack->data[value_stack->top - 1];
+  PyObject *index = value_stack->data[value_stack->top];
+  const PyCFuncObject *_delitem = subscript_method(container, SLOT_DELITEM, "doesn't support item deletion");
+  _delitem->function(container, index);
+  stack_drop(value_stack, 2);
+  state->current_frame->bytecode_offset += 1;
+}
+
+// BUILD_MAP,n then n MAP_ADDs, one per key - so a big literal never needs
+// more than three stack slots
+void eval_build_map(PyState *state, int size_hint) {
+  stack_push(state->current_frame->value_stack, py_dict_new(size_hint));
+  state->current_frame->bytecode_offset += 1;
+}
+
+void eval_map_add(PyState *state) {
+  Stack *value_stack = state->current_frame->value_stack;
+  PyObject *value = stack_pop(value_stack);
+  PyObject *key = stack_pop(value_stack);
+  py_dict_set_item(value_stack->data[value_stack->top], key, value);
+  state->current_frame->bytecode_offset += 1;
+}
+
+// BUILD_LIST,n then n LIST_APPENDs, as for dicts
+void eval_build_list(PyState *state, int size_hint) {
+  stack_push(state->current_frame->value_stack, py_list_new(size_hint));
+  state->current_frame->bytecode_offset += 1;
+}
+
+void eval_list_append(PyState *state) {
+  Stack *value_stack = state->current_frame->value_stack;
+  PyObject *item = stack_pop(value_stack);
+  py_list_append(value_stack->data[value_stack->top], item);
+  state->current_frame->bytecode_offset += 1;
+}
+
+void eval_pop_top(PyState *state) {
+  stack_pop(state->current_frame->value_stack);
+  state->current_frame->bytecode_offset += 1;
+}
+
+// COMPARISONS
+// NOTE: two small ints are compared unboxed, right here - anything else
+// goes through the left operand's slot (__eq__, __lt__, ...), which
+// returns True or False
+
+static void check_comparison(int comparison) {
+  if (comparison < EQ || comparison > GTE) {
+    py_error("OperatorError: unhandled comparison %d", comparison);
+  }
+}
+
+static inline int compare_longs(int comparison, long long a, long long b) {
+  switch (comparison) {
+    case EQ: return a == b;
+    case LT: return a < b;
+    case GT: return a > b;
+    case LTE: return a <= b;
+    default: return a >= b;
+  }
+}
+
+// 0 or 1 for two small ints, -1 if the slot has to decide
+static inline int compare_small_ints(int comparison, PyObject *a, PyObject *b) {
+  if (a->type != &py_type_int || b->type != &py_type_int
+      || ((PyIntObject *) a)->digits != NULL || ((PyIntObject *) b)->digits != NULL) {
+    return -1;
+  }
+  return compare_longs(comparison, ((PyIntObject *) a)->value, ((PyIntObject *) b)->value);
+}
+
+static const char *comparison_symbols[] = {
+  [EQ] = "==",
+  [LT] = "<",
+  [GT] = ">",
+  [LTE] = "<=",
+  [GTE] = ">="
+};
+
+static PyObject *compare_objects(int comparison, PyObject *a, PyObject *b) {
+  const PyCFuncObject *_method = py_type_method(a->type, binary_op_slot_table[comparison]);
+  if (_method != NULL) {
+    return _method->function(a, b);
+  } else if (comparison == EQ) {
+    return py_bool_from_int(a == b); // no __eq__ - the same object or not
+  }
+  py_error("TypeError: '%s' not supported between instances of '%s' and '%s'",
+           comparison_symbols[comparison], a->type->name, b->type->name);
+}
+
+// COMPARE,op: replace the two operands with a bool
+void eval_compare(PyState *state, int comparison) {
+  check_comparison(comparison);
+  Stack *value_stack = state->current_frame->value_stack;
+  PyObject *a = value_stack->data[value_stack->top - 1];
+  PyObject *b = value_stack->data[value_stack->top];
+  int result = compare_small_ints(comparison, a, b);
+  binary_result(state, result >= 0 ? py_bool_from_int(result) : compare_objects(comparison, a, b));
+}
+
+// COMPARE_AND_JUMP,op,target: pop the two operands and compare them -
+// returns 1 if the comparison is false, and the caller should jump. no
+// bool is looked at for two small ints. the caller moves the pc
+int eval_compare_and_jump(PyState *state, int comparison) {
+  check_comparison(comparison);
+  Stack *value_stack = state->current_frame->value_stack;
+  PyObject *a = value_stack->data[value_stack->top - 1];
+  PyObject *b = value_stack->data[value_stack->top];
+  value_stack->top -= 2;
+  int result = compare_small_ints(comparison, a, b);
+  if (result < 0) {
+    result = ((PyBoolObject *) compare_objects(comparison, a, b))->value;
+  }
+  return !result;
+}
+
+// has the function an inlined call site was compiled from been rebound?
+// the check is cached against the globals' version, so it's usually one
+// comparison. returns 0 if the site has to make the call after all - the
+// caller moves the pc
+int eval_inline_guard(PyState *state, int idx) {
+  PyCodeObject *inlined = (PyCodeObject *) state->current_frame->code->consts[idx];
+  if (inlined->inline_version == state->globals->version) {
+    return 1;
+  }
+  PyObject *f = hashtable_get(state->globals, inlined->name);
+  if (f != NULL && f->type == &py_type_func && ((PyFuncObject *) f)->code == inlined) {
+    inlined->inline_version = state->globals->version;
+    return 1;
+  }
+  return 0;
+}
+
+// pops the condition - the caller moves the pc
+int eval_pop_is_false(PyState *state) {
+  return !py_object_is_true(stack_pop(state->current_frame->value_stack));
+}
+
+void eval_get_range(PyState *state, int nargs) {
+  Stack *value_stack = state->current_frame->value_stack;
+  PyObject *iter = py_range_iter_new(&value_stack->data[value_stack->top - nargs + 1], nargs);
+  stack_drop(value_stack, nargs);
+  stack_push(value_stack, iter);
+  state->current_frame->bytecode_offset += 1;
+}
+
+// advance the iterator on top of the stack - returns 0 (having popped the
+// iterator) once it's exhausted. the caller moves the pc
+int eval_for_range(PyState *state, int store) {
+  Stack *value_stack = state->current_frame->value_stack;
+  long long value;
+  if (py_range_iter_next(value_stack->data[value_stack->top], &value)) {
+    if (store) {
+      stack_push(value_stack, py_int_from_long(value));
+    }
+    return 1;
+  }
+  stack_drop(value_stack, 1);
+  return 0;
+}
+
+void handle_bytecode(PyState *state, const char *input) {
+  // take a bytecode instruction and mutate frame and/or its stack
+  OpCode opcode = get_opcode(input); 
+  char *varname;
+  int slot;
+  // printf("DEBUG: handling bytecode %s\n", input);
+  switch (opcode) { 
+    case OP_LOAD_CONST:
+      eval_load_const(state, get_operand(input));
+      break;
+    case OP_STORE_NAME:
+      varname = get_string_operand(input);
+      eval_store_name(state, varname);
+      free(varname);
+      break;
+    case OP_LOAD_NAME:
+      // get variable name
+      varname = get_string_operand(input); 
+      if (varname == NULL) {
+        py_error("error: bad operand");
+      }
+      eval_load_name(state, varname);
+      free(varname);
+      break;
+    case OP_BINARY_OP:
+      eval_binary_op(state, get_operand(input));
+      break;
+    case OP_INLINE_GUARD:
+      if (eval_inline_guard(state, get_operand(input))) {
+        state->current_frame->bytecode_offset += 1;
+      } else {
+        state->current_frame->bytecode_offset = get_second_operand(input);
+      }
+      break;
+    case OP_BINARY_ADD_INT:
+      eval_binary_add_int(state);
+      break;
+    case OP_BINARY_ADD_BYTES:
+      eval_binary_add_bytes(state);
+      break;
+    case OP_BINARY_MULT_BYTES_INT:
+      eval_binary_mult_bytes_int(state);
+      break;
+    case OP_MAKE_FUNCTION:
+      eval_make_function(state);
+      break;
+    case OP_CALL_FUNCTION:
+    case OP_TAIL_CALL:
+      eval_call_function(state, get_operand(input), opcode == OP_TAIL_CALL);
+      break;
+    case OP_RETURN:
+      eval_return(state);
+      break;
+    case OP_POP_TOP:
+      eval_pop_top(state);
+      break;
+    case OP_COMPARE:
+      eval_compare(state, get_operand(input));
+      break;
+    case OP_COMPARE_AND_JUMP:
+      if (eval_compare_and_jump(state, get_operand(input))) {
+        state->current_frame->bytecode_offset = get_second_operand(input);
+      } else {
+        state->current_frame->bytecode_offset += 1;
+      }
+      break;
+    case OP_POP_JUMP_IF_FALSE:
+      if (eval_pop_is_false(state)) {
+        state->current_frame->bytecode_offset = get_operand(input); // jump target offset
+      } else {
+        state->current_frame->bytecode_offset += 1;
+      }
+      break;
+    case OP_JUMP:
+      state->current_frame->bytecode_offset = get_operand(input);
+      break;
+    case OP_JUMP_BACKWARD:
+      // NOTE: kept separate from JUMP so hot loops have one place to hook
+      check_deadline(state);
+      state->current_frame->bytecode_offset = get_operand(input);
+      break;
+    case OP_GET_RANGE:
+      eval_get_range(state, get_operand(input));
+      break;
+    case OP_YIELD_VALUE:
+      eval_yield_value(state);
+      break;
+    case OP_RESUME:
+      eval_resume(state, get_operand(input));
+      break;
+    case OP_CALL_METHOD:
+      slot = get_operand(input);
+      if (slot >= 0) {
+        eval_call_method(state, slot, get_second_operand(input), py_method_names[slot]);
+        break;
+      }
+      // raises AttributeError - the name is the last operand
+      varname = get_string_operand(strrchr(input, ','));
+      eval_call_method(state, -1, get_second_operand(input), varname);
+      free(varname);
+      break;
+    case OP_GET_ITER:
+      eval_get_iter(state);
+      break;
+    case OP_STORE_TEMP:
+      eval_store_temp(state, get_operand(input));
+      break;
+    case OP_LOAD_TEMP:
+      eval_load_temp(state, get_operand(input));
+      break;
+    case OP_BINARY_SUBSCR:
+      eval_binary_subscr(state);
+      break;
+    case OP_STORE_SUBSCR:
+      eval_store_subscr(state);
+      break;
+    case OP_DELETE_SUBSCR:
+      eval_delete_subscr(state);
+      break;
+    case OP_BUILD_MAP:
+      eval_build_map(state, get_operand(input));
+      break;
+    case OP_MAP_ADD:
+      eval_map_add(state);
+      break;
+    case OP_BUILD_LIST:
+      eval_build_list(state, get_operand(input));
+      break;
+    case OP_LIST_APPEND:
+      eval_list_append(state);
+      break;
+    case OP_FOR_RANGE:
+      if (eval_for_range(state, get_second_operand(input))) {
+        state->current_frame->bytecode_offset += 1;
+      } else {
+        state->current_frame->bytecode_offset = get_operand(input);
+      }
+      break;
+    default:
+      py_error("error: bad opcode %s", input);
+  }
+}
+
+static void run(PyState *state) {
+  int i = state->current_frame->bytecode_offset;
+  while (state->current_frame->code->bytecode[i] != NULL) {
+    handle_bytecode(state, state->current_frame->code->bytecode[i]);
+    i = state->current_frame->bytecode_offset; // current_frame may have changed!
+  }
+}
+
+// run() for --jit: interpret until a code object gets hot, then run it
+// natively from then on. code is hot after `threshold` entries or backward
+// jumps - the two ways the interpreter ends up running it again
+static void run_jit(PyState *state, int threshold) {
+  while (1) {
+    PyFrameObject *frame = state->current_frame;
+    PyCodeObject *code = frame->code;
+    int i = frame->bytecode_offset;
+    if (code->bytecode[i] == NULL) {
+      break;
+    }
+    if (code->jit != NULL) {
+      jit_run(state, code->jit);
+      continue;
+    }
+    handle_bytecode(state, code->bytecode[i]);
+    if (state->current_frame != frame || state->current_frame->code != code
+        || state->current_frame->bytecode_offset <= i) {
+      PyCodeObject *next = state->current_frame->code;
+      if (next->jit == NULL && ++next->hotness >= threshold) {
+        next->jit = jit_compile(next);
+      }
+    }
+  }
+}
+
+// look at an instruction before it runs and record what --stats wants
+// to know about it (hash-table probes are counted by replaying the lookup)
+static void stats_inspect(PyState *state, OpCode opcode, const char *input) {
+  Stack *value_stack = state->current_frame->value_stack;
+  switch (opcode) {
+    case OP_LOAD_NAME: {
+      char *varname = get_string_operand(input);
+      HashTable *locals = state->current_frame->locals;
+      int probes = hashtable_count_probes(locals, varname);
+      if (hashtable_get(locals, varname) == NULL) {
+        probes += hashtable_count_probes(state->globals, varname);
+      }
+      stats_count_probes(probes);
+      free(varname);
+      break;
+    }
+    case OP_STORE_NAME: {
+      char *varname = get_string_operand(input);
+      stats_count_probes(hashtable_count_probes(state->current_frame->locals, varname));
+      free(varname);
+      break;
+    }
+    case OP_CALL_FUNCTION:
+    case OP_TAIL_CALL: {
+      PyObject *f = value_stack->data[value_stack->top - get_operand(input)];
+      if (f->type == &py_type_func) {
+        int reused = opcode == OP_TAIL_CALL && reuses_frame(state, f);
+        stats_count_call(((PyFuncObject *) f)->code->name, !reused);
+      } else if (f->type == &py_type_cfunc) {
+        stats_count_call(((PyCFuncObject *) f)->name, 0);
+      } else if (f->type == &py_type_memo) {
+        // only a miss on a python function makes a frame
+        PyMemoObject *memo = (PyMemoObject *) f;
+        int nargs = get_operand(input);
+        MemoKey key;
+        int hit = py_memo_key(&key, &value_stack->data[value_stack->top - nargs + 1], nargs)
+          && py_memo_contains(memo, &key);
+        stats_count_call(py_memo_name(memo), !hit && memo->func->type == &py_type_func);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// instrumented copy of run() for --stats - chosen once at startup so the
+// plain loop doesn't pay anything for it
+static void run_with_stats(PyState *state) {
+  int i = state->current_frame->bytecode_offset;
+  while (state->current_frame->code->bytecode[i] != NULL) {
+    const char *input = state->current_frame->code->bytecode[i];
+    OpCode opcode = get_opcode(input);
+    stats_count_instruction(opcode);
+    stats_inspect(state, opcode, input);
+    if (stats_timing) {
+      unsigned long long start = stats_clock();
+      handle_bytecode(state, input);
+      stats_add_time(opcode, stats_clock() - start);
+    } else {
+      handle_bytecode(state, input);
+    }
+    i = state->current_frame->bytecode_offset;
+  }
+}
+
+
+// run from the current frame's pc until the bottom frame's code is done
+void eval_run(PyState *state) {
+  if (stats_enabled) {
+    run_with_stats(state);
+  } else if (state->jit_threshold > 0) {
+    run_jit(state, state->jit_threshold);
+  } else {
+    run(state);
+  }
+}
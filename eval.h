@@ -0,0 +1,49 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "frame.h"
+#include "opcode.h"
+
+// decoding "OPNAME,operand" bytecode strings
+OpCode get_opcode(const char *input);
+int get_operand(const char *input);
+int get_second_operand(const char *input);
+char *get_string_operand(const char *input); // malloc'd
+
+// one instruction each, on decoded operands - see eval.c
+void eval_load_const(PyState *state, int idx);
+void eval_store_name(PyState *state, const char *varname);
+void eval_load_name(PyState *state, const char *varname);
+void eval_store_temp(PyState *state, int slot);
+void eval_load_temp(PyState *state, int slot);
+void eval_binary_op(PyState *state, int bin_op);
+void eval_binary_add_int(PyState *state);
+void eval_binary_add_bytes(PyState *state);
+void eval_binary_mult_bytes_int(PyState *state);
+void eval_make_function(PyState *state);
+int eval_call_function(PyState *state, int arg_count, int tail);
+void eval_call_method(PyState *state, int slot, int arg_count, const char *name);
+void eval_return(PyState *state);
+void eval_pop_top(PyState *state);
+void eval_compare(PyState *state, int comparison);
+int eval_compare_and_jump(PyState *state, int comparison);
+int eval_inline_guard(PyState *state, int idx);
+int eval_pop_is_false(PyState *state);
+void eval_get_range(PyState *state, int nargs);
+int eval_for_range(PyState *state, int store);
+void eval_yield_value(PyState *state);
+int eval_resume(PyState *state, int end);
+void eval_get_iter(PyState *state);
+void eval_binary_subscr(PyState *state);
+void eval_store_subscr(PyState *state);
+void eval_delete_subscr(PyState *state);
+void eval_build_map(PyState *state, int size_hint);
+void eval_map_add(PyState *state);
+void eval_build_list(PyState *state, int size_hint);
+void eval_list_append(PyState *state);
+void handle_bytecode(PyState *state, const char *input);
+long long eval_clock(void); // CLOCK_MONOTONIC ns, for PyState.deadline
+// run from the current frame until the bottom frame's code is done
+void eval_run(PyState *state);
+
+#endif
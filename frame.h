@@ -0,0 +1,42 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "hash-table.h"
+
+#define MAX_STACK_SIZE 100 
+
+// NOTE: value stack (each frame has one)
+typedef struct {
+  PyObject *data[MAX_STACK_SIZE];
+  int top;
+} Stack; 
+
+typedef struct PyFrameObject {
+  struct PyCodeObject *code; // bytecode being executed
+  int bytecode_offset; // program counter
+  struct PyFrameObject *prev; // previous frame
+  HashTable *locals;
+  Stack *value_stack;
+  struct PyMemoObject *memo; // memoize() wrapper waiting for our return value
+  MemoKey memo_key;
+  struct PyGenObject *gen; // the generator that owns us, if any
+  PyObject **temps; // STORE_TEMP's slots - NULL until the first one
+  int num_temps;
+} PyFrameObject;
+
+typedef struct PyState {
+  PyFrameObject *current_frame;
+  int recursion_depth;
+  HashTable *globals;
+  int tail_calls; // reuse the frame for TAIL_CALL (--tail-calls)
+  int quicken; // specialise BINARY_OPs as they run (off with --no-quicken)
+  int jit_threshold; // compile code this hot (--jit), 0 to never compile
+  long long deadline; // CLOCK_MONOTONIC ns to give up at, 0 for never
+  int deadline_countdown; // backward jumps and calls until we next look
+} PyState;  
+
+// locals == NULL gives the frame its own (module frames share globals)
+void py_frame_object_init(PyFrameObject *frame, HashTable *locals);
+PyFrameObject *py_frame_new(void); // with its own locals
+
+#endif
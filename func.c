@@ -6,6 +6,7 @@
 PyTypeObject py_type_func = {
   .base = { .type = &py_type_type },
   .name = "function",
-  .method_defs = NULL,
+  .basic_size = sizeof(PyFuncObject),
+  .item_size = 0,
   .methods = NULL,
 };
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gen.h"
+#include "type.h"
+#include "frame.h"
+#include "cfunc.h"
+#include "error.h"
+
+// NOTE: the frame is the only allocation a generator makes after the call
+// that creates it - next() and RESUME link it under the caller and switch
+// to it, YIELD_VALUE switches back, and the frame's locals and value stack
+// stay where they are in between
+
+static PyObject *gen_iter(PyObject *self, PyObject *unused) {
+  return self;
+}
+
+// NOTE: no __next__ - running a generator means switching frames, which
+// only the interpreter can do. RESUME and next() check for generators first
+static const PyCFuncObject gen_methods[NUM_METHOD_SLOTS] = {
+  PY_METHOD_FLAGS(ITER, "__iter__", gen_iter, METH_NOARGS),
+};
+
+PyTypeObject py_type_generator = {
+  .base = { .type = &py_type_type },
+  .name = "generator",
+  .basic_size = sizeof(PyGenObject),
+  .item_size = 0,
+  .methods = gen_methods,
+};
+
+PyObject *py_gen_new(PyCodeObject *code, PyObject *const *args, int nargs) {
+  PyGenObject *gen = (PyGenObject *) py_type_alloc(&py_type_generator);
+  PyFrameObject *frame = py_frame_new();
+  for (int j=0; j < nargs; j++) {
+    hashtable_insert(frame->locals, code->argnames[j], args[j]);
+  }
+  frame->code = code;
+  frame->gen = gen;
+  gen->frame = frame;
+  gen->running = 0;
+  gen->on_finish = GEN_NEXT;
+  gen->default_value = NULL;
+  gen->fold.builtin = NULL;
+  return (PyObject *) gen;
+}
+
+PyObject *py_builtin_next(PyObject *self, PyObject *const *args, size_t nargs) {
+  // NOTE: expect self == NULL
+  if (nargs < 1 || nargs > 2) {
+    py_error("TypeError: next expected 1 or 2 arguments, got %zu", nargs);
+  }
+  const PyCFuncObject *_next = py_type_method(args[0]->type, SLOT_NEXT);
+  if (_next != NULL) {
+    PyObject *value = _next->function(args[0], NULL);
+    if (value != NULL) {
+      return value;
+    }
+  } else if (args[0]->type != &py_type_generator) {
+    py_error("TypeError: '%s' object is not an iterator", args[0]->type->name);
+  } else if (((PyGenObject *) args[0])->frame != NULL) {
+    // e.g. memoize(next, n) - there's no frame to switch from in here
+    py_error("TypeError: next() can't resume a generator from a builtin");
+  }
+  if (nargs == 2) {
+    return args[1];
+  }
+  py_error("StopIteration");
+  return NULL;
+}
@@ -0,0 +1,24 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include <stddef.h>
+
+#include "type.h"
+
+extern PyTypeObject py_type_generator;
+
+// PyGenObject.on_finish, for a generator resumed by next() rather than by
+// a for loop's RESUME (which leaves its exit offset there)
+#define GEN_NEXT -1 // raise StopIteration
+#define GEN_NEXT_DEFAULT -2 // push default_value
+#define GEN_FOLD -3 // run by sum/min/max - push what `fold` comes to
+
+// a suspended frame with the arguments bound, at the start of the body
+PyObject *py_gen_new(PyCodeObject *code, PyObject *const *args, int nargs);
+
+// next(it[, default]) - eval.c resumes live generators itself, without
+// getting this far. this is everything else: iterators with a __next__, a
+// finished generator, or something that isn't an iterator
+PyObject *py_builtin_next(PyObject *self, PyObject *const *args, size_t nargs);
+
+#endif
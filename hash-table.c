@@ -3,6 +3,8 @@
 #include <string.h>
 
 #include "hash-table.h"
+#include "type.h"
+#include "dict.h"
 
 // djb2 hash
 unsigned int hash(const char *str) {
@@ -15,65 +17,250 @@ unsigned int hash(const char *str) {
   return hash;
 }
 
-void entry_init(Entry *entry, char *key, PyObject *object) {
-  entry->key = key;
-  entry->object = object;
-  entry->next = NULL;
+#define EMPTY -1
+#define DELETED -2
+#define MIN_INDEX_SIZE 8
+#define PERTURB_SHIFT 5
+
+#define USABLE HASHTABLE_USABLE
+
+static int index_width(int index_size) {
+  if (index_size <= 0x80) {
+    return 1;
+  } else if (index_size <= 0x8000) {
+    return 2;
+  }
+  return 4; // entries are counted with ints, so that's always enough
+}
+
+static inline long index_get(const HashTable *htable, size_t i) {
+  switch (htable->index_width) {
+    case 1: return ((const signed char *) htable->index)[i];
+    case 2: return ((const short *) htable->index)[i];
+    default: return ((const int *) htable->index)[i];
+  }
+}
+
+static inline void index_set(HashTable *htable, size_t i, long ix) {
+  switch (htable->index_width) {
+    case 1: ((signed char *) htable->index)[i] = ix; break;
+    case 2: ((short *) htable->index)[i] = ix; break;
+    default: ((int *) htable->index)[i] = ix; break;
+  }
+}
+
+// the index slot `hash` probes first, then the next one, and so on -
+// CPython's sequence, which mixes in the high bits as it goes
+#define FOR_EACH_PROBE(htable, hash, i) \
+  for (size_t perturb = (hash), mask = (htable)->index_size - 1, i = (hash) & mask; ; \
+       perturb >>= PERTURB_SHIFT, i = (i * 5 + perturb + 1) & mask)
+
+// the entry number for `key`, or -1. probes counts the entries compared
+static long find(HashTable *htable, unsigned int hash, const void *key, KeyEquals equals,
+                 size_t *slot, int *probes) {
+  if (htable->index_size == 0) {
+    return -1;
+  }
+  FOR_EACH_PROBE(htable, hash, i) {
+    long ix = index_get(htable, i);
+    if (ix == EMPTY) {
+      return -1;
+    }
+    if (ix >= 0) {
+      (*probes)++;
+      Entry *entry = &htable->entries[ix];
+      if (entry->hash == hash && equals(entry->key, key)) {
+        *slot = i;
+        return ix;
+      }
+    }
+  }
+}
+
+static size_t find_empty_slot(HashTable *htable, unsigned int hash) {
+  FOR_EACH_PROBE(htable, hash, i) {
+    if (index_get(htable, i) == EMPTY) {
+      return i;
+    }
+  }
+}
+
+// the index and entries share one allocation. NOTE: namespaces are the same
+// tables as dicts, so --memstats counts them as dict memory too
+static size_t table_bytes(int index_size, int width) {
+  return (size_t) index_size * width + USABLE(index_size) * sizeof(Entry);
+}
+
+// a new index (and entries) with room for `count` more, dropping holes
+static void resize(HashTable *htable, int count) {
+  int index_size = MIN_INDEX_SIZE;
+  while (USABLE(index_size) < htable->itemCount + count) {
+    index_size <<= 1;
+  }
+  int width = index_width(index_size);
+  void *index = py_type_realloc_data(&py_type_dict, NULL, 0, table_bytes(index_size, width));
+  memset(index, 0xff, (size_t) index_size * width); // EMPTY at any width
+  Entry *entries = (Entry *) ((char *) index + (size_t) index_size * width);
+
+  void *old_index = htable->index;
+  size_t old_bytes = table_bytes(htable->index_size, htable->index_width);
+  Entry *old_entries = htable->entries;
+  int old_used = htable->used;
+  htable->index = index;
+  htable->entries = entries;
+  htable->index_size = index_size;
+  htable->index_width = width;
+  htable->used = 0;
+  for (int j=0; j<old_used; j++) {
+    if (old_entries[j].key != NULL) {
+      index_set(htable, find_empty_slot(htable, old_entries[j].hash), htable->used);
+      entries[htable->used++] = old_entries[j];
+    }
+  }
+  if (old_index != NULL && !htable->in_image) {
+    py_type_realloc_data(&py_type_dict, old_index, old_bytes, 0);
+  }
+  htable->in_image = 0;
 }
 
 void hashtable_init(HashTable *htable) {
-  htable->size = 8; // fixed
+  htable->index = NULL;
+  htable->entries = NULL;
+  htable->index_size = 0;
+  htable->index_width = 0;
+  htable->used = 0;
   htable->itemCount = 0;
-  // initialise pre-head nodes
-  int i;
-  for (i = 0; i < htable->size; i++) {
-    Entry *preHead = malloc(sizeof(Entry));
-    entry_init(preHead, NULL, NULL);
-    htable->data[i] = preHead;
+  htable->owns_keys = 1;
+  htable->in_image = 0;
+  htable->version = 1;
+}
+
+// make room for `count` more keys up front, e.g. for a dict literal
+void hashtable_reserve(HashTable *htable, int count) {
+  if (htable->used + count > USABLE(htable->index_size)) {
+    resize(htable, count);
   }
 }
 
-void hashtable_insert(HashTable *htable, const char *key, PyObject *object) {
+Entry *hashtable_lookup(HashTable *htable, unsigned int hash, const void *key, KeyEquals equals) {
+  size_t slot;
+  int probes = 0;
+  long ix = find(htable, hash, key, equals, &slot, &probes);
+  return ix >= 0 ? &htable->entries[ix] : NULL;
+}
 
-  // figure out bucket
-  unsigned int index = hash(key) % htable->size;
-  
-  // find tail of that list
-  Entry *tail = htable->data[index];  
-  while (tail->next != NULL) 
-    tail = tail->next;
+// the caller has checked `key` isn't there
+void hashtable_add(HashTable *htable, unsigned int hash, void *key, PyObject *object) {
+  if (htable->used == USABLE(htable->index_size)) {
+    // NOTE: growing by the live count, not `used`, so a table that has
+    // keys deleted and added in turn stays the same size
+    resize(htable, htable->itemCount + 1);
+  }
+  index_set(htable, find_empty_slot(htable, hash), htable->used);
+  Entry *entry = &htable->entries[htable->used++];
+  entry->hash = hash;
+  entry->key = key;
+  entry->object = object;
+  htable->itemCount++;
+  htable->version++;
+}
+
+// returns 0 if `key` wasn't there
+int hashtable_delete(HashTable *htable, unsigned int hash, const void *key, KeyEquals equals) {
+  size_t slot;
+  int probes = 0;
+  long ix = find(htable, hash, key, equals, &slot, &probes);
+  if (ix < 0) {
+    return 0;
+  }
+  index_set(htable, slot, DELETED);
+  if (htable->owns_keys) {
+    free(htable->entries[ix].key);
+  }
+  htable->entries[ix].key = NULL;
+  htable->entries[ix].object = NULL;
+  htable->itemCount--;
+  htable->version++;
+  return 1;
+}
+
+// the next live entry from *pos on - returns 0 once there are no more
+int hashtable_next(HashTable *htable, int *pos, Entry **entry) {
+  while (*pos < htable->used) {
+    Entry *candidate = &htable->entries[(*pos)++];
+    if (candidate->key != NULL) {
+      *entry = candidate;
+      return 1;
+    }
+  }
+  return 0;
+}
 
-  // malloc a new node and attach
-  Entry *entry = malloc(sizeof(Entry));
-  char *keyCopy = strdup(key);
-  entry_init(entry, keyCopy, object);
+// NAMES
 
-  tail->next = entry;
+static int name_equals(const void *stored, const void *key) {
+  return strcmp(stored, key) == 0;
+}
+
+void hashtable_insert(HashTable *htable, const char *key, PyObject *object) {
+  unsigned int h = hash(key);
+  Entry *entry = hashtable_lookup(htable, h, key, name_equals);
+  if (entry != NULL) {
+    if (entry->object != object) {
+      entry->object = object;
+      htable->version++;
+    }
+    return;
+  }
+  hashtable_add(htable, h, strdup(key), object);
 }
 
 PyObject *hashtable_get(HashTable *htable, const char *key) {
-  unsigned int index = hash(key) % htable->size;
-  Entry *current = htable->data[index]->next;
-  while (current != NULL) {
-    if (strcmp(current->key, key) == 0)
-      return current->object;
-    current = current->next; 
+  Entry *entry = hashtable_lookup(htable, hash(key), key, name_equals);
+  return entry != NULL ? entry->object : NULL;
+}
+
+// number of entries hashtable_get compares `key` against
+int hashtable_count_probes(HashTable *htable, const char *key) {
+  size_t slot;
+  int probes = 0;
+  find(htable, hash(key), key, name_equals, &slot, &probes);
+  return probes;
+}
+
+// drop every entry but keep the index, ready for reuse
+void hashtable_clear(HashTable *htable) {
+  if (htable->owns_keys) {
+    for (int j=0; j<htable->used; j++) {
+      free(htable->entries[j].key);
+    }
+  }
+  if (htable->index != NULL) {
+    memset(htable->index, 0xff, (size_t) htable->index_size * htable->index_width);
+  }
+  htable->used = 0;
+  htable->itemCount = 0;
+  htable->version++;
+}
+
+// entries and index - the objects they point at aren't ours
+void hashtable_free(HashTable *htable) {
+  hashtable_clear(htable);
+  if (htable->index != NULL && !htable->in_image) {
+    py_type_realloc_data(&py_type_dict, htable->index, table_bytes(htable->index_size, htable->index_width), 0);
   }
-  return NULL;
+  htable->index = NULL;
+  htable->entries = NULL;
+  htable->index_size = 0;
 }
 
 void hashtable_print(HashTable *htable) {
-  // print all keys and values
-  int idx;
-  Entry *current;
+  // print all keys and values, in insertion order
+  int pos = 0;
+  Entry *entry;
   printf("{");
-  for (idx = 0; idx < htable->size; idx++) {
-    // iterate over bucket printing nodes we find
-    current = htable->data[idx]->next;
-    while (current != NULL) {
-      printf("'%s':address='%p',", current->key, current->object);
-      current = current->next;
-    }
+  while (hashtable_next(htable, &pos, &entry)) {
+    printf("'%s':address='%p',", (char *) entry->key, entry->object);
   }
   printf("}\n");
 }
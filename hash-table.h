@@ -1,25 +1,68 @@
 #ifndef HASH_TABLE_H
 #define HASH_TABLE_H
 
+#include <stddef.h>
+
 // forward declare so we can define PyObject
 struct PyTypeObject;
 struct HashTable;
-struct PyMethodDef;
+struct PyCFuncObject;
 
 typedef struct PyObject {
   struct PyTypeObject *type;
 } PyObject;
 
+// NOTE: the methods a built-in type can have - dunders for the operators,
+// len(), subscripts and iteration, then ones scripts call by name
+// (`s.find(x)`). __next__ returns NULL once it's exhausted. each has a fixed
+// index in every type's method table, so finding one is an array index
+// known at compile time rather than a hash of its name at run time
+#define PY_METHOD_SLOTS(X) \
+  X(ADD, "__add__") \
+  X(SUB, "__sub__") \
+  X(MULT, "__mult__") \
+  X(DIV, "__div__") \
+  X(EQ, "__eq__") \
+  X(LT, "__lt__") \
+  X(GT, "__gt__") \
+  X(LE, "__le__") \
+  X(GE, "__ge__") \
+  X(FLOORDIV, "__floordiv__") \
+  X(MOD, "__mod__") \
+  X(LEN, "__len__") \
+  X(GETITEM, "__getitem__") \
+  X(SETITEM, "__setitem__") \
+  X(DELITEM, "__delitem__") \
+  X(ITER, "__iter__") \
+  X(NEXT, "__next__") \
+  X(FIND, "find") \
+  X(COUNT, "count") \
+  X(STARTSWITH, "startswith") \
+  X(GET, "get") \
+  X(APPEND, "append")
+
+#define PY_METHOD_SLOT_ENUM(slot, name) SLOT_##slot,
+typedef enum MethodSlot {
+  PY_METHOD_SLOTS(PY_METHOD_SLOT_ENUM)
+  NUM_METHOD_SLOTS
+} MethodSlot;
+#undef PY_METHOD_SLOT_ENUM
+
 typedef struct PyTypeObject {
   PyObject base;
   char *name;
-  struct PyMethodDef *method_defs;
-  struct HashTable *methods; // constructed at startup from method_defs
+  int basic_size; // bytes for the fixed part of an instance
+  int item_size; // bytes per trailing inline item, 0 if fixed-size
+  // NUM_METHOD_SLOTS entries, indexed by MethodSlot - a NULL function
+  // means no such method. static and const, see PY_METHOD
+  const struct PyCFuncObject *methods;
 } PyTypeObject;
 
 typedef struct PyIntObject {
   PyObject base;
-  int value;
+  long long value; // fast path - used when digits == NULL
+  int size; // number of bignum digits, negative for negative ints
+  unsigned int *digits; // bignum magnitude, base 2^30 little-endian
 } PyIntObject;
 
 typedef struct PyBoolObject {
@@ -30,22 +73,113 @@ typedef struct PyBoolObject {
 typedef struct PyTupleObject {
   PyObject base;
   int size;
-  PyObject **elements; // TODO: allocate inline with the [] trick
+  PyObject *elements[]; // allocated inline
 } PyTupleObject;
 
+// NOTE: items is a separate block so it can grow - geometrically, so n
+// appends cost O(n) in all. allocated is 0 with items set if they're part
+// of a snapshot image (see put_list), and have to be copied out to grow
+typedef struct PyListObject {
+  PyObject base;
+  int size;
+  int allocated; // room in items
+  PyObject **items;
+} PyListObject;
+
+typedef struct PyListIterObject {
+  PyObject base;
+  PyListObject *list;
+  int index; // next item
+} PyListIterObject;
+
+// NOTE: the counter is a plain C integer - FOR_RANGE only boxes it when
+// the loop variable is actually stored
+typedef struct PyRangeIterObject {
+  PyObject base;
+  long long next;
+  long long stop;
+  long long step;
+} PyRangeIterObject;
+
+// NOTE: memoize(f, maxsize) - see memo.c
+#define MEMO_MAX_ARGS 5 // calls with more arguments aren't cached
+
+typedef struct MemoKey {
+  unsigned int hash;
+  int nargs;
+  PyObject *args[MEMO_MAX_ARGS]; // ints and bytes only
+} MemoKey;
+
+typedef struct MemoEntry {
+  MemoKey key;
+  PyObject *value;
+  int prev; // LRU list, most recently used first
+  int next;
+} MemoEntry;
+
+typedef struct PyMemoObject {
+  PyObject base;
+  PyObject *func;
+  int maxsize;
+  MemoEntry *entries; // packed, `count` in use
+  int count;
+  int capacity;
+  int *index; // open addressing into entries, -1 for an empty slot
+  int index_mask;
+  int in_image; // entries and index are part of a snapshot image - never freed
+  int head; // most recently used entry, -1 when empty
+  int tail; // least recently used
+  long hits;
+  long misses;
+  struct PyMemoObject *next_memo; // every wrapper ever made, for --stats
+} PyMemoObject;
+
 typedef struct PyBytesObject {
   PyObject base;
   int size;
-  char *data;
+  struct PyBytesObject *left; // rope halves (NULL when flat) - see bytes.c
+  struct PyBytesObject *right;
+  char data[]; // size + 1 bytes, null-terminated - empty for rope nodes
 } PyBytesObject;
 
 typedef struct PyCodeObject {
   PyObject base;
   char **bytecode; // array of bytecode instructions
   PyObject **consts;  // e.g. literals, compiled function/code objects
-  char **argnames; // TODO: allocate inline
+  int num_consts;
+  char *name; // function name, "<module>" for module-level code
+  int first_line;
+  unsigned char *linetable; // bytecode offset -> source line, see code.c
+  int linetable_length;
+  int hotness; // calls + loop back-edges seen by --jit
+  struct JitCode *jit; // native code, once hot
+  struct QuickenCounter *quicken; // per instruction, see quicken.c
+  unsigned int inline_version; // globals version INLINE_GUARD last passed at
+  int is_generator; // has a yield - calling it makes a generator
+  int num_temps; // slots STORE_TEMP uses, for inlined calls' arguments
+  char *argnames[]; // allocated inline, NULL-terminated
 } PyCodeObject;
 
+// sum/min/max running over a generator, a yield at a time - see
+// py_builtin_fold
+typedef struct {
+  const struct PyCFuncObject *builtin; // NULL unless one's running it
+  PyObject *value; // the total or best item so far - NULL before min/max's
+                   // first item, or while sum's total is a small int
+  long long small; // ...which is kept here, unboxed
+} GenFold;
+
+// NOTE: a generator owns its frame from the call that made it until it
+// returns - resuming it just switches to that frame. see gen.c
+typedef struct PyGenObject {
+  PyObject base;
+  struct PyFrameObject *frame; // NULL once it's finished
+  int running;
+  int on_finish; // RESUME's exit offset, or GEN_NEXT/GEN_NEXT_DEFAULT/GEN_FOLD
+  PyObject *default_value; // next(gen, default)'s
+  GenFold fold;
+} PyGenObject;
+
 typedef struct PyFuncObject {
   PyObject base;
   PyCodeObject *code;
@@ -54,31 +188,78 @@ typedef struct PyFuncObject {
 // args should be a tuple
 typedef PyObject *(*PyCFunction)(PyObject *self, PyObject *args);
 
-typedef struct PyMethodDef {
-  char *name;
-  PyCFunction method; 
-} PyMethodDef;
+// args points straight into the caller's value stack - don't hold on to it
+typedef PyObject *(*PyCFunctionFast)(PyObject *self, PyObject *const *args, size_t nargs);
+
+// calling conventions for PyCFuncObject.flags
+#define METH_VARARGS 0x0 // PyCFunction, args packed into a tuple
+#define METH_FASTCALL 0x1 // PyCFunctionFast (cast to PyCFunction)
+#define METH_NOARGS 0x2 // PyCFunction, args is NULL
+#define METH_O 0x4 // PyCFunction, args is the single argument
 
 typedef struct PyCFuncObject {
   PyObject base;
   PyCFunction function; // pointer to a C function
+  int flags; // METH_* calling convention of `function`
+  const char *name;
 } PyCFuncObject;
 
+// NOTE: the compact layout CPython has used since 3.6. entries sit in a
+// dense array in insertion order, so iterating is a walk along it, and a
+// separate sparse index maps a hash to an entry's position. index slots are
+// 1, 2 or 4 bytes - just wide enough to number the entries - so a small
+// table costs a byte per slot rather than a pointer per bucket. deleting
+// leaves a hole (key == NULL) and a DELETED slot, until the next resize.
+// both names (locals, globals) and dicts are kept this way - see
+// hash-table.c
 typedef struct Entry {
-  char *key; // NOTE: points to first char
-  PyObject *object; 
-  struct Entry *next;
+  unsigned int hash;
+  void *key; // a char * name, or a PyObject * in a dict - NULL once deleted
+  PyObject *object;
 } Entry;
 
 typedef struct HashTable {
-  Entry *data[8]; // fixed size - TODO: resize depending on load factor
-  int size;
-  int itemCount;
+  void *index; // index_size slots, with the entries after them
+  Entry *entries; // `used` of them so far, holes included
+  int index_size; // a power of two, 0 until something is inserted
+  int index_width; // bytes per index slot
+  int used;
+  int itemCount; // live entries
+  int owns_keys; // names are copied in, and freed with the table
+  int in_image; // the index is part of a snapshot image - never freed
+  unsigned int version; // changes whenever a key is added, rebound or removed
 } HashTable;
 
+// entries fit in 2/3 of the index, so a probe always ends at an EMPTY slot
+#define HASHTABLE_USABLE(index_size) (((index_size) << 1) / 3)
+
+// keys other than names: the caller hashes and compares them, and keeps
+// them alive
+typedef int (*KeyEquals)(const void *stored, const void *key);
+
 void hashtable_init(HashTable *htable);
+void hashtable_reserve(HashTable *htable, int count);
 void hashtable_insert(HashTable *htable, const char *key, PyObject *object);
 PyObject *hashtable_get(HashTable *htable, const char *key);
+int hashtable_count_probes(HashTable *htable, const char *key);
+Entry *hashtable_lookup(HashTable *htable, unsigned int hash, const void *key, KeyEquals equals);
+void hashtable_add(HashTable *htable, unsigned int hash, void *key, PyObject *object); // a new key
+int hashtable_delete(HashTable *htable, unsigned int hash, const void *key, KeyEquals equals);
+int hashtable_next(HashTable *htable, int *pos, Entry **entry); // in insertion order
+void hashtable_clear(HashTable *htable);
+void hashtable_free(HashTable *htable);
 void hashtable_print(HashTable *htable);
 
+typedef struct PyDictObject {
+  PyObject base;
+  HashTable table; // PyObject * keys
+} PyDictObject;
+
+typedef struct PyDictIterObject {
+  PyObject base;
+  PyDictObject *dict;
+  int pos; // next entry to look at
+  int size; // the dict's, when iteration started
+} PyDictIterObject;
+
 #endif
@@ -1,25 +1,599 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
 
 #include "int.h"
+#include "bool.h"
 #include "type.h"
+#include "cfunc.h"
 #include "hash-table.h"
+#include "error.h"
+#include "memstats.h"
 
-PyObject *py_int_add(PyObject *a, PyObject *b) {
-  PyIntObject *result = malloc(sizeof(PyIntObject));
-  result->base.type = &py_type_int;
-  result->value = ((PyIntObject *) a)->value + ((PyIntObject *) b)->value;
+// NOTE: ints that fit in a long long live inline in `value` (digits == NULL)
+// and every op tries that first with the __builtin_*_overflow checks. only
+// on overflow do we fall back to a bignum: sign + magnitude, with the
+// magnitude stored little-endian in base 2^30 digits (as in CPython) so a
+// digit product plus carries always fits in 64 bits.
+#define DIGIT_BITS 30
+#define DIGIT_BASE ((digit) 1 << DIGIT_BITS)
+#define DIGIT_MASK (DIGIT_BASE - 1)
+#define SMALL_DIGITS 3 // a long long needs at most 3 digits
+#define KARATSUBA_CUTOFF 40 // below this many digits schoolbook is faster
+#define DECIMAL_BASE 1000000000 // 10^9 - used for string conversion
+#define DECIMAL_BASE_DIGITS 9
+
+typedef unsigned int digit;
+typedef unsigned long long twodigits;
+typedef long long stwodigits;
+
+static void int_error(const char *message) {
+  py_error("%s", message);
+}
+
+static digit *digits_alloc(int n) {
+  digit *d = calloc(n > 0 ? n : 1, sizeof(digit));
+  if (d == NULL)
+    int_error("MemoryError");
+  return d;
+}
+
+// strip leading zero digits
+static int digits_trim(const digit *d, int n) {
+  while (n > 0 && d[n-1] == 0)
+    n--;
+  return n;
+}
+
+PyObject *py_int_from_long(long long value) {
+  PyIntObject *result = (PyIntObject *) py_type_alloc(&py_type_int);
+  result->value = value;
+  result->size = 0;
+  result->digits = NULL;
+  return (PyObject *) result;
+}
+
+// build an int from a magnitude - takes ownership of `digits` and
+// demotes to the inline fast path if the result fits in a long long
+static PyObject *int_from_digits(digit *digits, int n, int negative) {
+  n = digits_trim(digits, n);
+  if (n <= SMALL_DIGITS) {
+    // top digit only has 4 usable bits in a 64-bit word
+    if (n < SMALL_DIGITS || digits[SMALL_DIGITS-1] < (1u << (64 - 2*DIGIT_BITS))) {
+      unsigned long long mag = 0;
+      for (int i=n-1; i>=0; i--)
+        mag = (mag << DIGIT_BITS) | digits[i];
+      if (mag <= LLONG_MAX || (negative && mag == (unsigned long long) LLONG_MAX + 1)) {
+        free(digits);
+        return py_int_from_long(negative ? (long long) (0ULL - mag) : (long long) mag);
+      }
+    }
+  }
+  PyIntObject *result = (PyIntObject *) py_type_alloc(&py_type_int);
+  if (memstats_enabled) {
+    memstats_record(py_type_int.name, 0, (long long) n * sizeof(digit));
+  }
+  result->value = 0;
+  result->size = negative ? -n : n;
+  result->digits = digits;
   return (PyObject *) result;
 }
 
-PyMethodDef int_method_defs[] = {
-    { "__add__", py_int_add },
-    { NULL, NULL }
+// uniform view of an int's magnitude, small ints are unpacked into `small`
+typedef struct {
+  digit *digits;
+  int n;
+  int negative;
+  digit small[SMALL_DIGITS];
+} IntView;
+
+static void int_view(PyObject *a, IntView *v) {
+  PyIntObject *i = (PyIntObject *) a;
+  if (i->digits == NULL) {
+    unsigned long long mag = i->value < 0 ? 0ULL - (unsigned long long) i->value : (unsigned long long) i->value;
+    v->n = 0;
+    while (mag != 0) {
+      v->small[v->n++] = mag & DIGIT_MASK;
+      mag >>= DIGIT_BITS;
+    }
+    v->digits = v->small;
+    v->negative = i->value < 0;
+  } else {
+    v->digits = i->digits;
+    v->n = i->size < 0 ? -i->size : i->size;
+    v->negative = i->size < 0;
+  }
+}
+
+// magnitude helpers ----------------------------------------------------
+
+static int mag_cmp(const digit *a, int na, const digit *b, int nb) {
+  if (na != nb)
+    return na < nb ? -1 : 1;
+  for (int i=na-1; i>=0; i--) {
+    if (a[i] != b[i])
+      return a[i] < b[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+// out = a + b, out needs max(na, nb) + 1 digits
+static int mag_add(const digit *a, int na, const digit *b, int nb, digit *out) {
+  if (na < nb) {
+    const digit *t = a; a = b; b = t;
+    int tn = na; na = nb; nb = tn;
+  }
+  digit carry = 0;
+  int i;
+  for (i=0; i<nb; i++) {
+    carry += a[i] + b[i];
+    out[i] = carry & DIGIT_MASK;
+    carry >>= DIGIT_BITS;
+  }
+  for (; i<na; i++) {
+    carry += a[i];
+    out[i] = carry & DIGIT_MASK;
+    carry >>= DIGIT_BITS;
+  }
+  out[i] = carry;
+  return digits_trim(out, na + 1);
+}
+
+// out = a - b, requires a >= b; out may alias a
+static int mag_sub(const digit *a, int na, const digit *b, int nb, digit *out) {
+  digit borrow = 0;
+  int i;
+  for (i=0; i<nb; i++) {
+    borrow = a[i] - b[i] - borrow;
+    out[i] = borrow & DIGIT_MASK;
+    borrow = (borrow >> DIGIT_BITS) & 1;
+  }
+  for (; i<na; i++) {
+    borrow = a[i] - borrow;
+    out[i] = borrow & DIGIT_MASK;
+    borrow = (borrow >> DIGIT_BITS) & 1;
+  }
+  return digits_trim(out, na);
+}
+
+// z += a in place, propagating the carry through the rest of z
+static void mag_add_into(digit *z, int nz, const digit *a, int na) {
+  digit carry = 0;
+  int i;
+  for (i=0; i<na; i++) {
+    carry += z[i] + a[i];
+    z[i] = carry & DIGIT_MASK;
+    carry >>= DIGIT_BITS;
+  }
+  for (; carry != 0 && i<nz; i++) {
+    carry += z[i];
+    z[i] = carry & DIGIT_MASK;
+    carry >>= DIGIT_BITS;
+  }
+}
+
+// out (zeroed, na + nb digits) = a * b
+static void mag_mul_schoolbook(const digit *a, int na, const digit *b, int nb, digit *out) {
+  for (int i=0; i<na; i++) {
+    twodigits carry = 0;
+    twodigits ai = a[i];
+    if (ai == 0)
+      continue;
+    for (int j=0; j<nb; j++) {
+      carry += out[i+j] + ai * b[j];
+      out[i+j] = carry & DIGIT_MASK;
+      carry >>= DIGIT_BITS;
+    }
+    out[i+nb] = (digit) carry;
+  }
+}
+
+static void mag_mul(const digit *a, int na, const digit *b, int nb, digit *out);
+
+// out (zeroed, na + nb digits) = a * b, splitting both at m digits:
+//   a*b = a1*b1 * B^2m + ((a0+a1)(b0+b1) - a0*b0 - a1*b1) * B^m + a0*b0
+static void mag_mul_karatsuba(const digit *a, int na, const digit *b, int nb, digit *out) {
+  if (na < nb) {
+    const digit *t = a; a = b; b = t;
+    int tn = na; na = nb; nb = tn;
+  }
+  int m = na / 2;
+  if (nb <= m) {
+    // lopsided - b has no high half, so just split a
+    digit *hi = digits_alloc(na - m + nb);
+    mag_mul(a, digits_trim(a, m), b, nb, out);
+    mag_mul(a + m, na - m, b, nb, hi);
+    mag_add_into(out + m, na + nb - m, hi, na - m + nb);
+    free(hi);
+    return;
+  }
+  const digit *a0 = a, *a1 = a + m;
+  const digit *b0 = b, *b1 = b + m;
+  int na0 = digits_trim(a0, m), na1 = na - m;
+  int nb0 = digits_trim(b0, m), nb1 = nb - m;
+
+  // z0 and z2 go straight into their (non-overlapping) slots of out
+  mag_mul(a0, na0, b0, nb0, out);
+  mag_mul(a1, na1, b1, nb1, out + 2*m);
+
+  digit *ta = digits_alloc((na0 > na1 ? na0 : na1) + 1);
+  digit *tb = digits_alloc((nb0 > nb1 ? nb0 : nb1) + 1);
+  int nta = mag_add(a0, na0, a1, na1, ta);
+  int ntb = mag_add(b0, nb0, b1, nb1, tb);
+  int nz1 = nta + ntb;
+  digit *z1 = digits_alloc(nz1);
+  mag_mul(ta, nta, tb, ntb, z1);
+  nz1 = digits_trim(z1, nz1);
+  nz1 = mag_sub(z1, nz1, out, digits_trim(out, na0 + nb0), z1);
+  nz1 = mag_sub(z1, nz1, out + 2*m, digits_trim(out + 2*m, na1 + nb1), z1);
+  mag_add_into(out + m, na + nb - m, z1, nz1);
+  free(ta);
+  free(tb);
+  free(z1);
+}
+
+static void mag_mul(const digit *a, int na, const digit *b, int nb, digit *out) {
+  if (na < KARATSUBA_CUTOFF || nb < KARATSUBA_CUTOFF)
+    mag_mul_schoolbook(a, na, b, nb, out);
+  else
+    mag_mul_karatsuba(a, na, b, nb, out);
+}
+
+// in-place a /= d for a single digit d, returns the remainder
+static digit mag_divrem_digit(digit *a, int na, digit d) {
+  twodigits rem = 0;
+  for (int i=na-1; i>=0; i--) {
+    rem = (rem << DIGIT_BITS) | a[i];
+    a[i] = (digit) (rem / d);
+    rem %= d;
+  }
+  return (digit) rem;
+}
+
+// q (na - nb + 1 digits) = a / b, r (nb digits) = a % b, for nb >= 2
+// Knuth's algorithm D (TAOCP vol. 2, 4.3.1)
+static void mag_divrem(const digit *a, int na, const digit *b, int nb, digit *q, digit *r) {
+  // normalise so the top digit of the divisor has its high bit set
+  int shift = 0;
+  while ((b[nb-1] << shift) < (DIGIT_BASE >> 1))
+    shift++;
+  digit *v = digits_alloc(nb);
+  digit *u = digits_alloc(na + 1);
+  for (int i=nb-1; i>=0; i--)
+    v[i] = ((b[i] << shift) | (i > 0 ? b[i-1] >> (DIGIT_BITS - shift) : 0)) & DIGIT_MASK;
+  u[na] = shift ? a[na-1] >> (DIGIT_BITS - shift) : 0;
+  for (int i=na-1; i>=0; i--)
+    u[i] = ((a[i] << shift) | (i > 0 ? a[i-1] >> (DIGIT_BITS - shift) : 0)) & DIGIT_MASK;
+
+  twodigits vtop = v[nb-1], vnext = v[nb-2];
+  for (int j=na-nb; j>=0; j--) {
+    // estimate the quotient digit from the top two digits
+    twodigits top = ((twodigits) u[j+nb] << DIGIT_BITS) | u[j+nb-1];
+    twodigits qhat = top / vtop;
+    twodigits rhat = top - qhat * vtop;
+    while (qhat >= DIGIT_BASE || qhat * vnext > ((rhat << DIGIT_BITS) | u[j+nb-2])) {
+      qhat--;
+      rhat += vtop;
+      if (rhat >= DIGIT_BASE)
+        break;
+    }
+    // multiply and subtract (carry is signed - relies on arithmetic >>)
+    stwodigits carry = 0;
+    for (int i=0; i<nb; i++) {
+      stwodigits z = (stwodigits) u[i+j] + carry - (stwodigits) (qhat * v[i]);
+      u[i+j] = (digit) (z & DIGIT_MASK);
+      carry = z >> DIGIT_BITS;
+    }
+    if ((stwodigits) u[j+nb] + carry < 0) {
+      // qhat was one too big - add the divisor back
+      digit c = 0;
+      for (int i=0; i<nb; i++) {
+        c += u[i+j] + v[i];
+        u[i+j] = c & DIGIT_MASK;
+        c >>= DIGIT_BITS;
+      }
+      qhat--;
+    }
+    u[j+nb] = 0;
+    q[j] = (digit) qhat;
+  }
+
+  // un-normalise the remainder
+  for (int i=0; i<nb; i++)
+    r[i] = ((u[i] >> shift) | (i+1 < nb && shift ? u[i+1] << (DIGIT_BITS - shift) : 0)) & DIGIT_MASK;
+  free(u);
+  free(v);
+}
+
+// slow paths -----------------------------------------------------------
+
+static void int_check_operand(PyObject *b, const char *op) {
+  if (b->type != &py_type_int) {
+    py_error("TypeError: unsupported operand type(s) for %s: 'int' and '%s'", op, b->type->name);
+  }
+}
+
+// signed add of two views, `negate_b` turns it into a subtraction
+static PyObject *int_add_slow(PyObject *a, PyObject *b, int negate_b) {
+  IntView va, vb;
+  int_view(a, &va);
+  int_view(b, &vb);
+  int b_negative = vb.negative ^ negate_b;
+  int n = (va.n > vb.n ? va.n : vb.n) + 1;
+  digit *out = digits_alloc(n);
+  if (va.negative == b_negative) {
+    n = mag_add(va.digits, va.n, vb.digits, vb.n, out);
+    return int_from_digits(out, n, va.negative);
+  }
+  if (mag_cmp(va.digits, va.n, vb.digits, vb.n) >= 0) {
+    n = mag_sub(va.digits, va.n, vb.digits, vb.n, out);
+    return int_from_digits(out, n, va.negative);
+  }
+  n = mag_sub(vb.digits, vb.n, va.digits, va.n, out);
+  return int_from_digits(out, n, b_negative);
+}
+
+static PyObject *int_mul_slow(PyObject *a, PyObject *b) {
+  IntView va, vb;
+  int_view(a, &va);
+  int_view(b, &vb);
+  digit *out = digits_alloc(va.n + vb.n);
+  if (va.n != 0 && vb.n != 0) {
+    if (va.n >= vb.n)
+      mag_mul(va.digits, va.n, vb.digits, vb.n, out);
+    else
+      mag_mul(vb.digits, vb.n, va.digits, va.n, out);
+  }
+  return int_from_digits(out, va.n + vb.n, va.negative != vb.negative);
+}
+
+// floor division and modulo together - either result pointer may be NULL
+static void int_divmod_slow(PyObject *a, PyObject *b, PyObject **quotient, PyObject **remainder) {
+  IntView va, vb;
+  int_view(a, &va);
+  int_view(b, &vb);
+  if (vb.n == 0)
+    int_error("ZeroDivisionError: integer division or modulo by zero");
+
+  int nq = va.n >= vb.n ? va.n - vb.n + 1 : 1;
+  digit *q = digits_alloc(nq + 1);
+  digit *r = digits_alloc(vb.n + 1);
+  int nr;
+  if (va.n < vb.n) {
+    memcpy(r, va.digits, va.n * sizeof(digit));
+    nr = va.n;
+  } else if (vb.n == 1) {
+    memcpy(q, va.digits, va.n * sizeof(digit));
+    r[0] = mag_divrem_digit(q, va.n, vb.digits[0]);
+    nr = 1;
+  } else {
+    mag_divrem(va.digits, va.n, vb.digits, vb.n, q, r);
+    nr = vb.n;
+  }
+  nq = digits_trim(q, nq);
+  nr = digits_trim(r, nr);
+
+  // truncated -> floored: round the quotient away from zero and take the
+  // remainder's complement whenever the signs differ and it's inexact
+  int negative = va.negative != vb.negative;
+  if (negative && nr != 0) {
+    digit one = 1;
+    nq = mag_add(q, nq, &one, 1, q);
+    nr = mag_sub(vb.digits, vb.n, r, nr, r);
+  }
+  if (quotient != NULL)
+    *quotient = int_from_digits(q, nq, negative);
+  else
+    free(q);
+  if (remainder != NULL)
+    *remainder = int_from_digits(r, nr, vb.negative);
+  else
+    free(r);
+}
+
+static int int_compare(PyObject *a, PyObject *b) {
+  PyIntObject *ia = (PyIntObject *) a;
+  PyIntObject *ib = (PyIntObject *) b;
+  if (ia->digits == NULL && ib->digits == NULL)
+    return (ia->value > ib->value) - (ia->value < ib->value);
+  IntView va, vb;
+  int_view(a, &va);
+  int_view(b, &vb);
+  if (va.negative != vb.negative)
+    return va.negative ? -1 : 1;
+  int c = mag_cmp(va.digits, va.n, vb.digits, vb.n);
+  return va.negative ? -c : c;
+}
+
+// slots ----------------------------------------------------------------
+
+PyObject *py_int_add(PyObject *a, PyObject *b) {
+  int_check_operand(b, "+");
+  PyIntObject *ia = (PyIntObject *) a;
+  PyIntObject *ib = (PyIntObject *) b;
+  long long result;
+  if (ia->digits == NULL && ib->digits == NULL && !__builtin_add_overflow(ia->value, ib->value, &result))
+    return py_int_from_long(result);
+  return int_add_slow(a, b, 0);
+}
+
+PyObject *py_int_subtract(PyObject *a, PyObject *b) {
+  int_check_operand(b, "-");
+  PyIntObject *ia = (PyIntObject *) a;
+  PyIntObject *ib = (PyIntObject *) b;
+  long long result;
+  if (ia->digits == NULL && ib->digits == NULL && !__builtin_sub_overflow(ia->value, ib->value, &result))
+    return py_int_from_long(result);
+  return int_add_slow(a, b, 1);
+}
+
+PyObject *py_int_multiply(PyObject *a, PyObject *b) {
+  int_check_operand(b, "*");
+  PyIntObject *ia = (PyIntObject *) a;
+  PyIntObject *ib = (PyIntObject *) b;
+  long long result;
+  if (ia->digits == NULL && ib->digits == NULL && !__builtin_mul_overflow(ia->value, ib->value, &result))
+    return py_int_from_long(result);
+  return int_mul_slow(a, b);
+}
+
+PyObject *py_int_floordiv(PyObject *a, PyObject *b) {
+  int_check_operand(b, "//");
+  PyIntObject *ia = (PyIntObject *) a;
+  PyIntObject *ib = (PyIntObject *) b;
+  // LLONG_MIN // -1 is the only small overflow
+  if (ia->digits == NULL && ib->digits == NULL && ib->value != 0 && !(ia->value == LLONG_MIN && ib->value == -1)) {
+    long long q = ia->value / ib->value;
+    if (ia->value % ib->value != 0 && ((ia->value < 0) != (ib->value < 0)))
+      q--;
+    return py_int_from_long(q);
+  }
+  PyObject *result;
+  int_divmod_slow(a, b, &result, NULL);
+  return result;
+}
+
+PyObject *py_int_modulo(PyObject *a, PyObject *b) {
+  int_check_operand(b, "%");
+  PyIntObject *ia = (PyIntObject *) a;
+  PyIntObject *ib = (PyIntObject *) b;
+  if (ia->digits == NULL && ib->digits == NULL && ib->value != 0) {
+    if (ib->value == -1)
+      return py_int_from_long(0);
+    long long r = ia->value % ib->value;
+    if (r != 0 && ((r < 0) != (ib->value < 0)))
+      r += ib->value;
+    return py_int_from_long(r);
+  }
+  PyObject *result;
+  int_divmod_slow(a, b, NULL, &result);
+  return result;
+}
+
+// NOTE: an int never equals a non-int, but ordering one against an int is
+// an error, with the message python gives for comparisons
+static void int_check_ordering(PyObject *b, const char *op) {
+  if (b->type != &py_type_int) {
+    py_error("TypeError: '%s' not supported between instances of 'int' and '%s'", op, b->type->name);
+  }
+}
+
+PyObject *py_int_equals(PyObject *a, PyObject *b) {
+  if (b->type != &py_type_int) {
+    return py_bool_from_int(0);
+  }
+  return py_bool_from_int(int_compare(a, b) == 0);
+}
+
+PyObject *py_int_less_than(PyObject *a, PyObject *b) {
+  int_check_ordering(b, "<");
+  return py_bool_from_int(int_compare(a, b) < 0);
+}
+
+PyObject *py_int_greater_than(PyObject *a, PyObject *b) {
+  int_check_ordering(b, ">");
+  return py_bool_from_int(int_compare(a, b) > 0);
+}
+
+PyObject *py_int_less_equal(PyObject *a, PyObject *b) {
+  int_check_ordering(b, "<=");
+  return py_bool_from_int(int_compare(a, b) <= 0);
+}
+
+PyObject *py_int_greater_equal(PyObject *a, PyObject *b) {
+  int_check_ordering(b, ">=");
+  return py_bool_from_int(int_compare(a, b) >= 0);
+}
+
+// conversions ----------------------------------------------------------
+
+long long py_int_as_long(PyObject *a) {
+  PyIntObject *i = (PyIntObject *) a;
+  if (i->digits != NULL)
+    int_error("OverflowError: int too large to convert");
+  return i->value;
+}
+
+PyObject *py_int_from_string(const char *s) {
+  size_t length = strlen(s);
+  if (length < 19) // always fits
+    return py_int_from_long(strtoll(s, NULL, 10));
+
+  // accumulate 9 decimal digits at a time: mag = mag * 10^k + chunk
+  int capacity = (int) (length / 9) + 2;
+  digit *mag = digits_alloc(capacity);
+  int n = 0;
+  size_t i = 0;
+  while (i < length) {
+    digit chunk = 0, scale = 1;
+    for (int k=0; k<DECIMAL_BASE_DIGITS && i < length; k++, i++) {
+      chunk = chunk * 10 + (s[i] - '0');
+      scale *= 10;
+    }
+    twodigits carry = chunk;
+    for (int j=0; j<n; j++) {
+      carry += (twodigits) mag[j] * scale;
+      mag[j] = carry & DIGIT_MASK;
+      carry >>= DIGIT_BITS;
+    }
+    while (carry != 0) {
+      mag[n++] = carry & DIGIT_MASK;
+      carry >>= DIGIT_BITS;
+    }
+  }
+  return int_from_digits(mag, n, 0);
+}
+
+char *py_int_format(PyObject *a) {
+  PyIntObject *i = (PyIntObject *) a;
+  if (i->digits == NULL) {
+    char *buf = malloc(21);
+    sprintf(buf, "%lld", i->value);
+    return buf;
+  }
+  // peel off base 10^9 chunks, least significant first
+  IntView v;
+  int_view(a, &v);
+  digit *mag = digits_alloc(v.n);
+  memcpy(mag, v.digits, v.n * sizeof(digit));
+  int n = v.n;
+  int capacity = n * 10 / 9 + 2;
+  digit *chunks = digits_alloc(capacity);
+  int num_chunks = 0;
+  while (n > 0) {
+    chunks[num_chunks++] = mag_divrem_digit(mag, n, DECIMAL_BASE);
+    n = digits_trim(mag, n);
+  }
+  // the sign and top chunk (unpadded) first, then the rest a full chunk each
+  char head[16];
+  int length = snprintf(head, sizeof(head), "%s%u", v.negative ? "-" : "", chunks[num_chunks-1]);
+  char *buf = malloc(length + (num_chunks - 1) * DECIMAL_BASE_DIGITS + 1);
+  memcpy(buf, head, length + 1);
+  for (int k=num_chunks-2; k>=0; k--)
+    length += sprintf(buf + length, "%09u", chunks[k]);
+  free(mag);
+  free(chunks);
+  return buf;
+}
+
+static const PyCFuncObject int_methods[NUM_METHOD_SLOTS] = {
+  PY_METHOD(ADD, "__add__", py_int_add),
+  PY_METHOD(SUB, "__sub__", py_int_subtract),
+  PY_METHOD(MULT, "__mult__", py_int_multiply),
+  PY_METHOD(FLOORDIV, "__floordiv__", py_int_floordiv),
+  PY_METHOD(MOD, "__mod__", py_int_modulo),
+  PY_METHOD(EQ, "__eq__", py_int_equals),
+  PY_METHOD(LT, "__lt__", py_int_less_than),
+  PY_METHOD(GT, "__gt__", py_int_greater_than),
+  PY_METHOD(LE, "__le__", py_int_less_equal),
+  PY_METHOD(GE, "__ge__", py_int_greater_equal),
 };
 
 PyTypeObject py_type_int = {
   .base = { .type = &py_type_type },
   .name = "int",
-  .method_defs = int_method_defs,
-  .methods = NULL
+  .basic_size = sizeof(PyIntObject),
+  .item_size = 0,
+  .methods = int_methods
 };
-
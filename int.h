@@ -5,4 +5,11 @@
 
 extern PyTypeObject py_type_int;
 
+PyObject *py_int_from_long(long long value);
+PyObject *py_int_from_string(const char *s); // decimal digits, any length
+long long py_int_as_long(PyObject *a); // OverflowError if it's a bignum
+char *py_int_format(PyObject *a); // malloc'd decimal string
+// slots the interpreter calls directly once it knows both sides are ints
+PyObject *py_int_add(PyObject *a, PyObject *b);
+
 #endif
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "interp.h"
+#include "error.h"
+#include "parser.h"
+#include "eval.h"
+#include "type.h"
+#include "cfunc.h"
+#include "func.h"
+#include "int.h"
+#include "bytes.h"
+#include "bool.h"
+#include "memo.h"
+#include "gen.h"
+#include "list.h"
+#include "repr.h"
+
+// NOTE: the interpreter whose py_interp_run/py_interp_exec is on this
+// thread's stack, if any - py_error() and the builtins find it here
+static __thread PyInterp *current_interp = NULL;
+
+// BUILT-INS
+
+static PyObject *py_builtin_print(PyObject *self, PyObject *const *args, size_t nargs) {
+  // NOTE: expect self == NULL
+  Writer *out = &current_interp->out;
+  for (int i = 0; i < nargs; i++) {
+    if (i > 0) {
+      writer_write(out, " ", 1);
+    }
+    py_object_str(out, args[i]);
+  }
+  writer_write(out, "\n", 1);
+  if (out->overflowed) {
+    py_error("RuntimeError: output limit of %d bytes exceeded", out->limit);
+  }
+  return NULL;
+}
+
+static PyObject *py_builtin_len(PyObject *self, PyObject *arg) {
+  // NOTE: expect self == NULL
+  // we just return `type(arg).__len__(arg)`
+  const PyCFuncObject *_len = py_type_method(arg->type, SLOT_LEN);
+  if (_len == NULL) {
+    py_error("TypeError: object of type '%s' has no len()", arg->type->name);
+  }
+  return _len->function(self, arg);
+}
+
+// memoize(f, maxsize) - see memo.c
+static PyObject *py_builtin_memoize(PyObject *self, PyObject *const *args, size_t nargs) {
+  if (nargs != 2) {
+    py_error("TypeError: memoize() takes exactly 2 arguments (%zu given)", nargs);
+  }
+  PyObject *f = args[0];
+  if (f->type != &py_type_func && f->type != &py_type_cfunc) {
+    py_error("TypeError: memoize() needs a function, not '%s'", f->type->name);
+  }
+  if (f->type == &py_type_func && ((PyFuncObject *) f)->code->is_generator) {
+    py_error("TypeError: memoize() can't wrap a generator function");
+  }
+  if (args[1]->type != &py_type_int || py_int_as_long(args[1]) < 1) {
+    py_error("ValueError: memoize() maxsize must be a positive int");
+  }
+  long long maxsize = py_int_as_long(args[1]);
+  return py_memo_new(f, maxsize > INT_MAX / 4 ? INT_MAX / 4 : (int) maxsize);
+}
+
+// NOTE: one set of builtin function objects, shared by every interpreter
+static const PyCFuncObject py_builtins[] = {
+  { .base = { .type = &py_type_cfunc }, .function = (PyCFunction) py_builtin_print, .flags = METH_FASTCALL, .name = "print" },
+  { .base = { .type = &py_type_cfunc }, .function = py_builtin_len, .flags = METH_O, .name = "len" },
+  { .base = { .type = &py_type_cfunc }, .function = (PyCFunction) py_builtin_memoize, .flags = METH_FASTCALL, .name = "memoize" },
+  { .base = { .type = &py_type_cfunc }, .function = (PyCFunction) py_builtin_next, .flags = METH_FASTCALL, .name = "next" },
+  { .base = { .type = &py_type_cfunc }, .function = (PyCFunction) py_builtin_sum, .flags = METH_FASTCALL, .name = "sum" },
+  { .base = { .type = &py_type_cfunc }, .function = (PyCFunction) py_builtin_min, .flags = METH_FASTCALL, .name = "min" },
+  { .base = { .type = &py_type_cfunc }, .function = (PyCFunction) py_builtin_max, .flags = METH_FASTCALL, .name = "max" },
+};
+static const int num_builtins = sizeof(py_builtins) / sizeof(py_builtins[0]);
+
+const PyCFuncObject *py_interp_builtins(int *count) {
+  *count = num_builtins;
+  return py_builtins;
+}
+
+// ERRORS
+
+void py_error(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  PyInterp *interp = current_interp;
+  if (interp == NULL || interp->on_error == NULL) {
+    vprintf(fmt, args);
+    va_end(args);
+    printf("\n");
+    exit(1);
+  }
+  vsnprintf(interp->error, sizeof(interp->error), fmt, args);
+  va_end(args);
+  longjmp(*interp->on_error, 1);
+}
+
+// INSTANCES
+
+void py_interp_config_init(PyInterpConfig *config) {
+  config->tail_calls = 0;
+  config->quicken = 1;
+  config->inline_functions = 1;
+  config->jit_threshold = 0;
+  config->out_fd = STDOUT_FILENO;
+  config->output_buffer_size = OUTPUT_BUFFER_SIZE;
+  config->output_limit = 0;
+  config->timeout_ms = 0;
+}
+
+static void add_builtins(HashTable *globals) {
+  for (int i=0; i<num_builtins; i++) {
+    hashtable_insert(globals, py_builtins[i].name, (PyObject *) &py_builtins[i]);
+  }
+}
+
+PyInterp *py_interp_new(const PyInterpConfig *config) {
+  PyInterp *interp = malloc(sizeof(PyInterp));
+  if (config != NULL) {
+    interp->config = *config;
+  } else {
+    py_interp_config_init(&interp->config);
+  }
+  hashtable_init(&interp->globals);
+  add_builtins(&interp->globals);
+  py_frame_object_init(&interp->bottom_frame, &interp->globals);
+
+  PyState *state = &interp->state;
+  state->current_frame = &interp->bottom_frame;
+  state->recursion_depth = 0;
+  state->globals = &interp->globals;
+  state->tail_calls = interp->config.tail_calls;
+  state->quicken = interp->config.quicken;
+  state->jit_threshold = interp->config.jit_threshold;
+  state->deadline = 0;
+
+  if (interp->config.out_fd < 0) {
+    writer_init_capture(&interp->out, interp->config.output_buffer_size, interp->config.output_limit);
+  } else {
+    writer_init(&interp->out, interp->config.out_fd, interp->config.output_buffer_size);
+  }
+  interp->on_error = NULL;
+  interp->error[0] = '\0';
+  return interp;
+}
+
+// after an error: drop whatever frames were live and start the next run
+// from an empty module frame
+static void reset_state(PyInterp *interp) {
+  interp->state.current_frame = &interp->bottom_frame;
+  interp->state.recursion_depth = 0;
+  interp->bottom_frame.value_stack->top = -1;
+}
+
+int py_interp_exec(PyInterp *interp, PyCodeObject *code) {
+  PyInterp *prev_interp = current_interp;
+  jmp_buf *prev_on_error = interp->on_error;
+  jmp_buf on_error;
+  int status = 0;
+  current_interp = interp;
+  interp->on_error = &on_error;
+  if (interp->config.timeout_ms > 0) {
+    interp->state.deadline = eval_clock() + interp->config.timeout_ms * 1000000LL;
+    interp->state.deadline_countdown = 1;
+  }
+  if (setjmp(on_error) == 0) {
+    interp->bottom_frame.code = code;
+    interp->bottom_frame.bytecode_offset = 0;
+    eval_run(&interp->state);
+  } else {
+    reset_state(interp);
+    status = -1;
+  }
+  interp->state.deadline = 0;
+  writer_flush(&interp->out);
+  interp->on_error = prev_on_error;
+  current_interp = prev_interp;
+  return status;
+}
+
+PyCodeObject *py_interp_compile(PyInterp *interp, const char *source) {
+  PyInterp *prev_interp = current_interp;
+  jmp_buf *prev_on_error = interp->on_error;
+  jmp_buf on_error;
+  PyCodeObject *volatile code = NULL;
+  current_interp = interp;
+  interp->on_error = &on_error;
+  if (setjmp(on_error) == 0) {
+    TokenArray tokens = tokenize(source);
+    int t_idx = 0;
+    Module *module = parse(tokens.data, &t_idx);
+    code = module_walk(module, interp->config.inline_functions);
+  }
+  interp->on_error = prev_on_error;
+  current_interp = prev_interp;
+  return code;
+}
+
+int py_interp_run(PyInterp *interp, const char *source) {
+  PyCodeObject *code = py_interp_compile(interp, source);
+  if (code == NULL) {
+    return -1;
+  }
+  return py_interp_exec(interp, code);
+}
+
+// NOTE: clearing bumps the globals' version, so inlined call sites in
+// code compiled earlier check their callee again
+void py_interp_reset(PyInterp *interp) {
+  hashtable_clear(&interp->globals);
+  add_builtins(&interp->globals);
+  reset_state(interp);
+  interp->out.length = 0;
+  interp->out.overflowed = 0;
+  interp->error[0] = '\0';
+}
+
+const char *py_interp_error(PyInterp *interp) {
+  return interp->error;
+}
+
+const char *py_interp_output(PyInterp *interp, int *length) {
+  *length = interp->out.length;
+  return interp->out.data;
+}
+
+// NOTE: objects made while running aren't freed (nothing is, yet) - this
+// releases the instance itself
+void py_interp_free(PyInterp *interp) {
+  writer_free(&interp->out);
+  hashtable_free(&interp->globals);
+  free(interp->bottom_frame.value_stack);
+  free(interp);
+}
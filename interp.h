@@ -0,0 +1,61 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include <setjmp.h>
+
+#include "frame.h"
+#include "writer.h"
+
+// NOTE: an interpreter instance - its own globals, frames, output and
+// error state. instances don't share anything mutable, so a host can run
+// one per thread. what they do share is static and read-only: type objects
+// and their method tables, the builtin function objects, True/False and
+// the empty tuple/bytes.
+//
+// a code object belongs to the instance that compiled it - quickening and
+// the JIT rewrite it as it runs.
+//
+// NOTE: --stats, --memstats and --profile are process-wide, so they're for
+// the command line (one instance) only
+
+#define INTERP_ERROR_SIZE 256
+#define OUTPUT_BUFFER_SIZE (64 * 1024) // print(), see --output-buffer
+
+typedef struct PyInterpConfig {
+  int tail_calls; // --tail-calls
+  int quicken; // off with --no-quicken
+  int inline_functions; // off with --no-inline
+  int jit_threshold; // --jit-threshold, 0 to stay in the interpreter
+  int out_fd; // where print() goes - -1 keeps it, see py_interp_output()
+  int output_buffer_size;
+  int output_limit; // with out_fd -1, print() past this many bytes is an error
+  int timeout_ms; // for each run, 0 for no limit
+} PyInterpConfig;
+
+typedef struct PyInterp {
+  PyState state;
+  HashTable globals;
+  PyFrameObject bottom_frame;
+  PyInterpConfig config;
+  Writer out;
+  jmp_buf *on_error; // innermost run in progress
+  char error[INTERP_ERROR_SIZE];
+} PyInterp;
+
+void py_interp_config_init(PyInterpConfig *config); // the defaults
+PyInterp *py_interp_new(const PyInterpConfig *config); // NULL for the defaults
+// compile and run a script at module level. returns 0, or -1 with the
+// message in py_interp_error(). output is flushed either way
+int py_interp_run(PyInterp *interp, const char *source);
+// NULL on a syntax error. the code can be run again and again, but only by
+// this instance
+PyCodeObject *py_interp_compile(PyInterp *interp, const char *source);
+int py_interp_exec(PyInterp *interp, PyCodeObject *code);
+// start over with just the builtins, and no kept output
+void py_interp_reset(PyInterp *interp);
+const char *py_interp_error(PyInterp *interp);
+const char *py_interp_output(PyInterp *interp, int *length); // out_fd -1 only
+void py_interp_free(PyInterp *interp);
+const PyCFuncObject *py_interp_builtins(int *count); // print(), len() etc.
+
+#endif
@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "jit.h"
+#include "eval.h"
+#include "opcode.h"
+#include "error.h"
+#include "type.h"
+
+// NOTE: copy-and-patch. every instruction becomes a copy of one of a few
+// fixed machine-code templates ("stencils") with holes for its operands:
+//
+//   mov rdi, r12             ; r12 holds the PyState for the whole run
+//   mov rsi, <operand>       ; decoded once, here, not on every execution
+//   mov edx, <offset>        ; the instruction's own bytecode offset
+//   mov rax, <helper>
+//   call rax
+//   test eax, eax            ; only if the helper can branch or bail out:
+//   jnz <target>             ;   a jump target's code, or the exit
+//
+// helpers are thin wrappers round the interpreter's eval_* functions, so
+// the JIT can't disagree with the interpreter about what an opcode does -
+// it only removes decoding and dispatch. jumps are native jumps. anything
+// that switches frames (calls into python, returns) leaves native code with
+// the frame's pc set, and the interpreter loop takes it from there. the pc
+// isn't kept up to date in between - helpers that read it (the exits, and
+// anything that quickens) set it from their offset first.
+//
+// native code for each code object lives in its own mmapped region, written
+// while it's RW and flipped to RX before it's ever run
+
+// a CALL_METHOD's operands - the stencil has room for one, so it gets a
+// pointer to these
+typedef struct {
+  int slot;
+  int arg_count;
+} MethodCall;
+
+struct JitCode {
+  unsigned char *memory;
+  size_t size;
+  unsigned char **entries; // native address for each bytecode offset
+  MethodCall *method_calls; // by bytecode offset, for the CALL_METHODs
+};
+
+typedef struct {
+  const unsigned char *code;
+  int size;
+  int operand_hole; // imm64
+  int offset_hole; // imm32
+  int helper_hole; // imm64
+  int target_hole; // rel32, or -1
+} Stencil;
+
+#define CALL_HELPER \
+  0x4c, 0x89, 0xe7,                                           /* mov rdi, r12 */ \
+  0x48, 0xbe, 0, 0, 0, 0, 0, 0, 0, 0,                         /* mov rsi, imm64 */ \
+  0xba, 0, 0, 0, 0,                                           /* mov edx, imm32 */ \
+  0x48, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0,                         /* mov rax, imm64 */ \
+  0xff, 0xd0                                                  /* call rax */
+
+static const unsigned char call_code[] = { CALL_HELPER };
+static const unsigned char call_branch_code[] = {
+  CALL_HELPER,
+  0x85, 0xc0,                                                 // test eax, eax
+  0x0f, 0x85, 0, 0, 0, 0                                      // jnz rel32
+};
+static const unsigned char jump_code[] = {
+  0xe9, 0, 0, 0, 0                                            // jmp rel32
+};
+
+static const Stencil call_stencil = { call_code, sizeof(call_code), 5, 14, 20, -1 };
+static const Stencil call_branch_stencil = { call_branch_code, sizeof(call_branch_code), 5, 14, 20, 34 };
+static const Stencil jump_stencil = { jump_code, sizeof(jump_code), -1, -1, -1, 1 };
+
+// enter(state, target): keep state in r12 (callee-saved, so it survives the
+// helper calls) and jump into the middle of the code. the push also leaves
+// the stack 16-byte aligned for those calls
+static const unsigned char enter_code[] = {
+  0x41, 0x54,                                                 // push r12
+  0x49, 0x89, 0xfc,                                           // mov r12, rdi
+  0xff, 0xe6                                                  // jmp rsi
+};
+static const unsigned char exit_code[] = {
+  0x41, 0x5c,                                                 // pop r12
+  0xc3                                                        // ret
+};
+
+typedef int (*Helper)(PyState *state, intptr_t operand, int offset);
+
+// helpers - return nonzero to take the stencil's branch
+
+static int jit_load_const(PyState *state, intptr_t idx, int offset) {
+  eval_load_const(state, idx);
+  return 0;
+}
+
+static int jit_store_name(PyState *state, intptr_t varname, int offset) {
+  eval_store_name(state, (const char *) varname);
+  return 0;
+}
+
+static int jit_load_name(PyState *state, intptr_t varname, int offset) {
+  eval_load_name(state, (const char *) varname);
+  return 0;
+}
+
+static int jit_store_temp(PyState *state, intptr_t slot, int offset) {
+  eval_store_temp(state, slot);
+  return 0;
+}
+
+static int jit_load_temp(PyState *state, intptr_t slot, int offset) {
+  eval_load_temp(state, slot);
+  return 0;
+}
+
+static int jit_binary_op(PyState *state, intptr_t bin_op, int offset) {
+  state->current_frame->bytecode_offset = offset;
+  eval_binary_op(state, bin_op);
+  return 0;
+}
+
+static int jit_binary_add_int(PyState *state, intptr_t unused, int offset) {
+  state->current_frame->bytecode_offset = offset;
+  eval_binary_add_int(state);
+  return 0;
+}
+
+static int jit_binary_add_bytes(PyState *state, intptr_t unused, int offset) {
+  state->current_frame->bytecode_offset = offset;
+  eval_binary_add_bytes(state);
+  return 0;
+}
+
+static int jit_binary_mult_bytes_int(PyState *state, intptr_t unused, int offset) {
+  state->current_frame->bytecode_offset = offset;
+  eval_binary_mult_bytes_int(state);
+  return 0;
+}
+
+static int jit_make_function(PyState *state, intptr_t unused, int offset) {
+  eval_make_function(state);
+  return 0;
+}
+
+static int jit_pop_top(PyState *state, intptr_t unused, int offset) {
+  eval_pop_top(state);
+  return 0;
+}
+
+static int jit_compare(PyState *state, intptr_t comparison, int offset) {
+  eval_compare(state, comparison);
+  return 0;
+}
+
+// branch to the target if it's false
+static int jit_compare_and_jump(PyState *state, intptr_t comparison, int offset) {
+  return eval_compare_and_jump(state, comparison);
+}
+
+static int jit_get_range(PyState *state, intptr_t nargs, int offset) {
+  eval_get_range(state, nargs);
+  return 0;
+}
+
+static int jit_get_iter(PyState *state, intptr_t unused, int offset) {
+  eval_get_iter(state);
+  return 0;
+}
+
+static int jit_binary_subscr(PyState *state, intptr_t unused, int offset) {
+  eval_binary_subscr(state);
+  return 0;
+}
+
+static int jit_store_subscr(PyState *state, intptr_t unused, int offset) {
+  eval_store_subscr(state);
+  return 0;
+}
+
+static int jit_delete_subscr(PyState *state, intptr_t unused, int offset) {
+  eval_delete_subscr(state);
+  return 0;
+}
+
+static int jit_build_map(PyState *state, intptr_t size_hint, int offset) {
+  eval_build_map(state, size_hint);
+  return 0;
+}
+
+static int jit_map_add(PyState *state, intptr_t unused, int offset) {
+  eval_map_add(state);
+  return 0;
+}
+
+static int jit_build_list(PyState *state, intptr_t size_hint, int offset) {
+  eval_build_list(state, size_hint);
+  return 0;
+}
+
+static int jit_list_append(PyState *state, intptr_t unused, int offset) {
+  eval_list_append(state);
+  return 0;
+}
+
+// branch to the jump target
+static int jit_pop_jump_if_false(PyState *state, intptr_t unused, int offset) {
+  return eval_pop_is_false(state);
+}
+
+// branch to the ordinary call
+static int jit_inline_guard(PyState *state, intptr_t idx, int offset) {
+  return !eval_inline_guard(state, idx);
+}
+
+// branch to the loop exit
+static int jit_for_range(PyState *state, intptr_t store, int offset) {
+  return !eval_for_range(state, store);
+}
+
+// branch to the exit if we're in a new frame - builtins carry on natively
+static int jit_call_function(PyState *state, intptr_t arg_count, int offset) {
+  state->current_frame->bytecode_offset = offset;
+  return eval_call_function(state, arg_count, 0);
+}
+
+static int jit_tail_call(PyState *state, intptr_t arg_count, int offset) {
+  state->current_frame->bytecode_offset = offset;
+  return eval_call_function(state, arg_count, 1);
+}
+
+// operand is a MethodCall *
+static int jit_call_method(PyState *state, intptr_t operand, int offset) {
+  const MethodCall *call = (const MethodCall *) operand;
+  state->current_frame->bytecode_offset = offset;
+  eval_call_method(state, call->slot, call->arg_count, py_method_names[call->slot]);
+  return 0;
+}
+
+// always exit
+static int jit_return(PyState *state, intptr_t unused, int offset) {
+  state->current_frame->bytecode_offset = offset;
+  eval_return(state);
+  return 1;
+}
+
+static int jit_fallback(PyState *state, intptr_t input, int offset) {
+  state->current_frame->bytecode_offset = offset;
+  handle_bytecode(state, (const char *) input);
+  return 1;
+}
+
+static int jit_end(PyState *state, intptr_t unused, int offset) {
+  state->current_frame->bytecode_offset = offset;
+  return 1;
+}
+
+int jit_available(void) {
+#if defined(__x86_64__)
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+// a patch we can only apply once every instruction has an address
+typedef struct {
+  unsigned char *hole;
+  int target; // bytecode offset, or -1 for the exit
+} JumpFixup;
+
+static unsigned char *emit_stencil(unsigned char *out, const Stencil *stencil, intptr_t operand,
+                                   int offset, Helper helper) {
+  memcpy(out, stencil->code, stencil->size);
+  if (stencil->operand_hole >= 0) {
+    memcpy(out + stencil->operand_hole, &operand, 8);
+  }
+  if (stencil->offset_hole >= 0) {
+    int32_t imm = offset;
+    memcpy(out + stencil->offset_hole, &imm, 4);
+  }
+  if (stencil->helper_hole >= 0) {
+    uint64_t address = (uint64_t) (uintptr_t) helper;
+    memcpy(out + stencil->helper_hole, &address, 8);
+  }
+  return out + stencil->size;
+}
+
+JitCode *jit_compile(PyCodeObject *code) {
+  int n = 0;
+  while (code->bytecode[n] != NULL) n++;
+
+  // every instruction is at most one call_branch stencil, plus the final
+  // jit_end and the enter/exit stubs
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t size = sizeof(enter_code) + sizeof(exit_code) + (n + 1) * sizeof(call_branch_code);
+  size = (size + page - 1) / page * page;
+  unsigned char *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    py_error("MemoryError: can't map memory for the JIT");
+  }
+
+  JitCode *jit = malloc(sizeof(JitCode));
+  jit->memory = memory;
+  jit->size = size;
+  jit->entries = malloc((n + 1) * sizeof(unsigned char *));
+  jit->method_calls = malloc(n * sizeof(MethodCall));
+  JumpFixup *fixups = malloc((n + 1) * sizeof(JumpFixup));
+  int num_fixups = 0;
+
+  unsigned char *out = memory;
+  memcpy(out, enter_code, sizeof(enter_code));
+  out += sizeof(enter_code);
+  unsigned char *exit_stub = out;
+  memcpy(out, exit_code, sizeof(exit_code));
+  out += sizeof(exit_code);
+
+  for (int k=0; k<n; k++) {
+    const char *input = code->bytecode[k];
+    jit->entries[k] = out;
+    unsigned char *start = out;
+    int target = -2; // -2: no branch, -1: branch to the exit
+    switch (get_opcode(input)) {
+      case OP_LOAD_CONST:
+        out = emit_stencil(out, &call_stencil, get_operand(input), k, jit_load_const);
+        break;
+      case OP_STORE_NAME:
+        // NOTE: names are decoded once and live as long as the code does
+        out = emit_stencil(out, &call_stencil, (intptr_t) get_string_operand(input), k, jit_store_name);
+        break;
+      case OP_LOAD_NAME:
+        out = emit_stencil(out, &call_stencil, (intptr_t) get_string_operand(input), k, jit_load_name);
+        break;
+      case OP_STORE_TEMP:
+        out = emit_stencil(out, &call_stencil, get_operand(input), k, jit_store_temp);
+        break;
+      case OP_LOAD_TEMP:
+        out = emit_stencil(out, &call_stencil, get_operand(input), k, jit_load_temp);
+        break;
+      case OP_BINARY_OP:
+        out = emit_stencil(out, &call_stencil, get_operand(input), k, jit_binary_op);
+        break;
+      // NOTE: quickening has usually run by the time code is hot, so this
+      // picks up the specialised forms. their guards still work here, but
+      // a deopt only changes the bytecode - the native code stays as it is
+      case OP_BINARY_ADD_INT:
+        out = emit_stencil(out, &call_stencil, 0, k, jit_binary_add_int);
+        break;
+      case OP_BINARY_ADD_BYTES:
+        out = emit_stencil(out, &call_stencil, 0, k, jit_binary_add_bytes);
+        break;
+      case OP_BINARY_MULT_BYTES_INT:
+        out = emit_stencil(out, &call_stencil, 0, k, jit_binary_mult_bytes_int);
+        break;
+      case OP_MAKE_FUNCTION:
+        out = emit_stencil(out, &call_stencil, 0, k, jit_make_function);
+        break;
+      case OP_POP_TOP:
+        out = emit_stencil(out, &call_stencil, 0, k, jit_pop_top);
+        break;
+      case OP_COMPARE:
+        out = emit_stencil(out, &call_stencil, get_operand(input), k, jit_compare);
+        break;
+      case OP_GET_RANGE:
+        out = emit_stencil(out, &call_stencil, get_operand(input), k, jit_get_range);
+        break;
+      case OP_GET_ITER:
+        out = emit_stencil(out, &call_stencil, 0, k, jit_get_iter);
+        break;
+      case OP_BINARY_SUBSCR:
+        out = emit_stencil(out, &call_stencil, 0, k, jit_binary_subscr);
+        break;
+      case OP_STORE_SUBSCR:
+        out = emit_stencil(out, &call_stencil, 0, k, jit_store_subscr);
+        break;
+      case OP_DELETE_SUBSCR:
+        out = emit_stencil(out, &call_stencil, 0, k, jit_delete_subscr);
+        break;
+      case OP_BUILD_MAP:
+        out = emit_stencil(out, &call_stencil, get_operand(input), k, jit_build_map);
+        break;
+      case OP_MAP_ADD:
+        out = emit_stencil(out, &call_stencil, 0, k, jit_map_add);
+        break;
+      case OP_BUILD_LIST:
+        out = emit_stencil(out, &call_stencil, get_operand(input), k, jit_build_list);
+        break;
+      case OP_LIST_APPEND:
+        out = emit_stencil(out, &call_stencil, 0, k, jit_list_append);
+        break;
+      case OP_POP_JUMP_IF_FALSE:
+        out = emit_stencil(out, &call_branch_stencil, 0, k, jit_pop_jump_if_false);
+        target = get_operand(input);
+        break;
+      case OP_COMPARE_AND_JUMP:
+        out = emit_stencil(out, &call_branch_stencil, get_operand(input), k, jit_compare_and_jump);
+        target = get_second_operand(input);
+        break;
+      case OP_FOR_RANGE:
+        out = emit_stencil(out, &call_branch_stencil, get_second_operand(input), k, jit_for_range);
+        target = get_operand(input);
+        break;
+      case OP_INLINE_GUARD:
+        out = emit_stencil(out, &call_branch_stencil, get_operand(input), k, jit_inline_guard);
+        target = get_second_operand(input);
+        break;
+      case OP_JUMP:
+      case OP_JUMP_BACKWARD:
+        out = emit_stencil(out, &jump_stencil, 0, k, NULL);
+        target = get_operand(input);
+        break;
+      case OP_CALL_FUNCTION:
+        out = emit_stencil(out, &call_branch_stencil, get_operand(input), k, jit_call_function);
+        target = -1;
+        break;
+      case OP_TAIL_CALL:
+        out = emit_stencil(out, &call_branch_stencil, get_operand(input), k, jit_tail_call);
+        target = -1;
+        break;
+      case OP_RETURN:
+        out = emit_stencil(out, &call_branch_stencil, 0, k, jit_return);
+        target = -1;
+        break;
+      case OP_CALL_METHOD: {
+        int slot = get_operand(input);
+        if (slot >= 0) {
+          jit->method_calls[k].slot = slot;
+          jit->method_calls[k].arg_count = get_second_operand(input);
+          out = emit_stencil(out, &call_stencil, (intptr_t) &jit->method_calls[k], k, jit_call_method);
+        } else {
+          // raises AttributeError - the interpreter has the name for it
+          out = emit_stencil(out, &call_branch_stencil, (intptr_t) input, k, jit_fallback);
+          target = -1;
+        }
+        break;
+      }
+      default:
+        // not something we compile - let the interpreter run it
+        out = emit_stencil(out, &call_branch_stencil, (intptr_t) input, k, jit_fallback);
+        target = -1;
+        break;
+    }
+    if (target != -2) {
+      const Stencil *stencil = out - start == sizeof(jump_code) ? &jump_stencil : &call_branch_stencil;
+      fixups[num_fixups].hole = start + stencil->target_hole;
+      fixups[num_fixups].target = target;
+      num_fixups++;
+    }
+  }
+  // falling off the end - hand back to the interpreter, which stops there
+  jit->entries[n] = out;
+  out = emit_stencil(out, &call_branch_stencil, 0, n, jit_end);
+  fixups[num_fixups].hole = out - 4;
+  fixups[num_fixups].target = -1;
+  num_fixups++;
+
+  for (int f=0; f<num_fixups; f++) {
+    unsigned char *destination = fixups[f].target < 0 ? exit_stub : jit->entries[fixups[f].target];
+    int32_t rel = (int32_t) (destination - (fixups[f].hole + 4));
+    memcpy(fixups[f].hole, &rel, 4);
+  }
+  free(fixups);
+
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+    py_error("MemoryError: can't make JIT memory executable");
+  }
+  return jit;
+}
+
+void jit_run(PyState *state, JitCode *jit) {
+  void (*enter)(PyState *, void *) = (void (*)(PyState *, void *)) jit->memory;
+  enter(state, jit->entries[state->current_frame->bytecode_offset]);
+}
@@ -0,0 +1,20 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "frame.h"
+
+// --jit: once a code object has been entered or looped round `jit_threshold`
+// times it's compiled to x86-64 by copying machine-code stencils and
+// patching in operands - see jit.c
+typedef struct JitCode JitCode;
+
+#define JIT_THRESHOLD 16 // default for --jit-threshold=N
+
+int jit_available(void); // 0 if this isn't an x86-64 build
+JitCode *jit_compile(PyCodeObject *code);
+// run the current frame's code natively from its pc, until control has to
+// leave it (calls, returns, anything handled by the interpreter instead).
+// the frame's pc is up to date on return
+void jit_run(PyState *state, JitCode *jit);
+
+#endif
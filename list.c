@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "list.h"
+#include "type.h"
+#include "cfunc.h"
+#include "int.h"
+#include "bool.h"
+#include "bytes.h"
+#include "error.h"
+#include "gen.h"
+
+// make room for at least `needed` items
+static void list_grow(PyListObject *list, int needed) {
+  int allocated = list->allocated + (list->allocated >> 1) + 4;
+  if (allocated < needed) {
+    allocated = needed;
+  }
+  if (list->allocated == 0 && list->items != NULL) {
+    // the items are in a snapshot image - copy them out
+    PyObject **items = py_type_realloc_data(&py_type_list, NULL, 0, allocated * sizeof(PyObject *));
+    memcpy(items, list->items, list->size * sizeof(PyObject *));
+    list->items = items;
+  } else {
+    list->items = py_type_realloc_data(&py_type_list, list->items, list->allocated * sizeof(PyObject *),
+                                       allocated * sizeof(PyObject *));
+  }
+  list->allocated = allocated;
+}
+
+PyObject *py_list_new(int size_hint) {
+  PyListObject *list = (PyListObject *) py_type_alloc(&py_type_list);
+  list->size = 0;
+  list->allocated = 0;
+  list->items = NULL;
+  if (size_hint > 0) {
+    list_grow(list, size_hint);
+  }
+  return (PyObject *) list;
+}
+
+void py_list_append(PyObject *obj, PyObject *item) {
+  PyListObject *list = (PyListObject *) obj;
+  if (list->size >= list->allocated) { // > for a list in a snapshot image
+    list_grow(list, list->size + 1);
+  }
+  list->items[list->size++] = item;
+}
+
+// a small int or a bool, as a plain C integer - 0 if it's neither
+static int small_int_value(PyObject *obj, long long *value) {
+  if (obj->type == &py_type_int && ((PyIntObject *) obj)->digits == NULL) {
+    *value = ((PyIntObject *) obj)->value;
+    return 1;
+  } else if (obj->type == &py_type_bool) {
+    *value = ((PyBoolObject *) obj)->value;
+    return 1;
+  }
+  return 0;
+}
+
+// `index` as a position in the list, counting back from the end if it's
+// negative - an IndexError with `error` if it's out of range
+static int list_position(PyListObject *list, PyObject *index, const char *error) {
+  long long position;
+  if (!small_int_value(index, &position)) {
+    if (index->type == &py_type_int) {
+      py_error("IndexError: cannot fit 'int' into an index-sized integer");
+    }
+    py_error("TypeError: list indices must be integers or slices, not %s", index->type->name);
+  }
+  if (position < 0) {
+    position += list->size;
+  }
+  if (position < 0 || position >= list->size) {
+    py_error("IndexError: %s", error);
+  }
+  return (int) position;
+}
+
+// METHODS
+
+static PyObject *list_length(PyObject *self, PyObject *list) {
+  return py_int_from_long(((PyListObject *) list)->size);
+}
+
+static PyObject *list_getitem(PyObject *self, PyObject *index) {
+  PyListObject *list = (PyListObject *) self;
+  return list->items[list_position(list, index, "list index out of range")];
+}
+
+// l[index] = value - args are the index and the value
+static PyObject *list_setitem(PyObject *self, PyObject *const *args, size_t nargs) {
+  if (nargs != 2) {
+    py_error("TypeError: __setitem__ expected 2 arguments, got %zu", nargs);
+  }
+  PyListObject *list = (PyListObject *) self;
+  list->items[list_position(list, args[0], "list assignment index out of range")] = args[1];
+  return NULL;
+}
+
+static PyObject *list_delitem(PyObject *self, PyObject *index) {
+  PyListObject *list = (PyListObject *) self;
+  int position = list_position(list, index, "list assignment index out of range");
+  memmove(list->items + position, list->items + position + 1, (list->size - position - 1) * sizeof(PyObject *));
+  list->size--;
+  return NULL;
+}
+
+static PyObject *list_append(PyObject *self, PyObject *item) {
+  py_list_append(self, item);
+  return NULL;
+}
+
+static PyObject *list_iter(PyObject *self, PyObject *unused) {
+  PyListIterObject *iter = (PyListIterObject *) py_type_alloc(&py_type_list_iterator);
+  iter->list = (PyListObject *) self;
+  iter->index = 0;
+  return (PyObject *) iter;
+}
+
+// NOTE: as in python, items appended during iteration are seen, and it's
+// the length now that counts
+PyObject *py_list_iter_next(PyObject *self) {
+  PyListIterObject *iter = (PyListIterObject *) self;
+  if (iter->index >= iter->list->size) {
+    return NULL;
+  }
+  return iter->list->items[iter->index++];
+}
+
+static PyObject *list_iter_next(PyObject *self, PyObject *unused) {
+  return py_list_iter_next(self);
+}
+
+static PyObject *list_iter_self(PyObject *self, PyObject *unused) {
+  return self;
+}
+
+// BUILT-INS
+// NOTE: while the items are small ints, sum() adds them and min()/max()
+// compare them as plain C integers, boxing nothing but the result. from the
+// first item that isn't one (or a sum that overflows) the rest go through
+// the items' __add__/__lt__/__gt__
+
+typedef struct {
+  PyObject *const *items;
+  int count;
+} Items;
+
+// the items of a list as they are - anything else is run through its
+// iterator into a new list. NOTE: a live generator never gets here from a
+// call - eval_call_function folds its yields in with py_builtin_fold
+static Items iterable_items(const char *name, PyObject *iterable) {
+  if (iterable->type == &py_type_generator && ((PyGenObject *) iterable)->frame == NULL) {
+    Items finished = { NULL, 0 };
+    return finished;
+  }
+  if (iterable->type != &py_type_list) {
+    const PyCFuncObject *_iter = py_type_method(iterable->type, SLOT_ITER);
+    if (_iter == NULL) {
+      py_error("TypeError: '%s' object is not iterable", iterable->type->name);
+    }
+    PyObject *iter = _iter->function(iterable, NULL);
+    const PyCFuncObject *_next = py_type_method(iter->type, SLOT_NEXT);
+    if (_next == NULL) {
+      // e.g. memoize(sum, n)(gen) - generators only run from the eval loop
+      py_error("TypeError: %s() can't resume a '%s' from a builtin", name, iter->type->name);
+    }
+    PyObject *list = py_list_new(0);
+    PyObject *item;
+    while ((item = _next->function(iter, NULL)) != NULL) {
+      py_list_append(list, item);
+    }
+    iterable = list;
+  }
+  Items result = { ((PyListObject *) iterable)->items, ((PyListObject *) iterable)->size };
+  return result;
+}
+
+static PyObject *sum_add(PyObject *total, PyObject *item) {
+  const PyCFuncObject *_add = py_type_method(total->type, SLOT_ADD);
+  if (_add == NULL) {
+    py_error("TypeError: unsupported operand type(s) for +: '%s' and '%s'",
+             total->type->name, item->type->name);
+  }
+  return _add->function(total, item);
+}
+
+// sum's start, checked the same way for a list or a generator
+static PyObject *sum_start(PyObject *const *args, size_t nargs) {
+  if (nargs < 1 || nargs > 2) {
+    py_error("TypeError: sum() takes 1 or 2 arguments (%zu given)", nargs);
+  }
+  PyObject *total = nargs == 2 ? args[1] : py_int_from_long(0);
+  if (total->type == &py_type_bytes) {
+    py_error("TypeError: sum() can't sum strings [use ''.join(seq) instead]");
+  }
+  return total;
+}
+
+PyObject *py_builtin_sum(PyObject *self, PyObject *const *args, size_t nargs) {
+  // NOTE: expect self == NULL
+  PyObject *total = sum_start(args, nargs);
+  Items items = iterable_items("sum", args[0]);
+  int i = 0;
+  long long value, item_value;
+  if (total->type == &py_type_int && small_int_value(total, &value)) {
+    for (; i<items.count; i++) {
+      if (!small_int_value(items.items[i], &item_value)
+          || __builtin_add_overflow(value, item_value, &item_value)) {
+        break;
+      }
+      value = item_value;
+    }
+    if (i > 0) {
+      total = py_int_from_long(value);
+    }
+  }
+  for (; i<items.count; i++) {
+    total = sum_add(total, items.items[i]);
+  }
+  return total;
+}
+
+// does `item` take over from `best`? max keeps the first of equal items,
+// like min, so it only moves on when an item is strictly greater
+static int min_max_beats(int is_max, PyObject *item, PyObject *best) {
+  const PyCFuncObject *_compare = py_type_method(item->type, is_max ? SLOT_GT : SLOT_LT);
+  if (_compare == NULL) {
+    py_error("TypeError: '%s' not supported between instances of '%s' and '%s'",
+             is_max ? ">" : "<", item->type->name, best->type->name);
+  }
+  return _compare->function(item, best) == (PyObject *) &py_true;
+}
+
+static PyObject *min_max(const char *name, int is_max, PyObject *const *args, size_t nargs) {
+  if (nargs == 0) {
+    py_error("TypeError: %s expected at least 1 argument, got 0", name);
+  }
+  Items items = { args, (int) nargs };
+  if (nargs == 1) {
+    items = iterable_items(name, args[0]);
+  }
+  if (items.count == 0) {
+    py_error("ValueError: %s() arg is an empty sequence", name);
+  }
+  int best = 0;
+  int i = 1;
+  long long best_value, value;
+  if (small_int_value(items.items[0], &best_value)) {
+    for (; i<items.count && small_int_value(items.items[i], &value); i++) {
+      if (is_max ? value > best_value : value < best_value) {
+        best = i;
+        best_value = value;
+      }
+    }
+  }
+  for (; i<items.count; i++) {
+    if (min_max_beats(is_max, items.items[i], items.items[best])) {
+      best = i;
+    }
+  }
+  return items.items[best];
+}
+
+PyObject *py_builtin_min(PyObject *self, PyObject *const *args, size_t nargs) {
+  return min_max("min", 0, args, nargs);
+}
+
+PyObject *py_builtin_max(PyObject *self, PyObject *const *args, size_t nargs) {
+  return min_max("max", 1, args, nargs);
+}
+
+void py_builtin_fold_start(GenFold *fold, const PyCFuncObject *builtin, PyObject *const *args, size_t nargs) {
+  fold->builtin = builtin;
+  fold->value = NULL;
+  if (builtin->function == (PyCFunction) py_builtin_sum) {
+    PyObject *total = sum_start(args, nargs);
+    if (total->type != &py_type_int || !small_int_value(total, &fold->small)) {
+      fold->value = total;
+    }
+  }
+}
+
+void py_builtin_fold(GenFold *fold, PyObject *item) {
+  long long best_value, item_value;
+  if (fold->builtin->function == (PyCFunction) py_builtin_sum) {
+    if (fold->value == NULL) {
+      if (small_int_value(item, &item_value) && !__builtin_add_overflow(fold->small, item_value, &item_value)) {
+        fold->small = item_value;
+        return;
+      }
+      fold->value = py_int_from_long(fold->small);
+    }
+    fold->value = sum_add(fold->value, item);
+    return;
+  }
+  int is_max = fold->builtin->function == (PyCFunction) py_builtin_max;
+  if (fold->value == NULL) {
+    fold->value = item;
+  } else if (small_int_value(fold->value, &best_value) && small_int_value(item, &item_value)) {
+    if (is_max ? item_value > best_value : item_value < best_value) {
+      fold->value = item;
+    }
+  } else if (min_max_beats(is_max, item, fold->value)) {
+    fold->value = item;
+  }
+}
+
+PyObject *py_builtin_fold_end(GenFold *fold) {
+  PyObject *result = fold->value;
+  if (result == NULL && fold->builtin->function == (PyCFunction) py_builtin_sum) {
+    result = py_int_from_long(fold->small);
+  } else if (result == NULL) {
+    py_error("ValueError: %s() arg is an empty sequence", fold->builtin->name);
+  }
+  fold->builtin = NULL;
+  return result;
+}
+
+static const PyCFuncObject list_methods[NUM_METHOD_SLOTS] = {
+  PY_METHOD(LEN, "__len__", list_length),
+  PY_METHOD(GETITEM, "__getitem__", list_getitem),
+  PY_METHOD_FLAGS(SETITEM, "__setitem__", list_setitem, METH_FASTCALL),
+  PY_METHOD(DELITEM, "__delitem__", list_delitem),
+  PY_METHOD_FLAGS(ITER, "__iter__", list_iter, METH_NOARGS),
+  PY_METHOD(APPEND, "append", list_append),
+};
+
+static const PyCFuncObject list_iter_methods[NUM_METHOD_SLOTS] = {
+  PY_METHOD_FLAGS(ITER, "__iter__", list_iter_self, METH_NOARGS),
+  PY_METHOD_FLAGS(NEXT, "__next__", list_iter_next, METH_NOARGS),
+};
+
+PyTypeObject py_type_list = {
+  .base = { .type = &py_type_type },
+  .name = "list",
+  .basic_size = sizeof(PyListObject),
+  .item_size = 0,
+  .methods = list_methods
+};
+
+PyTypeObject py_type_list_iterator = {
+  .base = { .type = &py_type_type },
+  .name = "list_iterator",
+  .basic_size = sizeof(PyListIterObject),
+  .item_size = 0,
+  .methods = list_iter_methods
+};
@@ -0,0 +1,30 @@
+#ifndef LIST_H
+#define LIST_H
+
+#include <stddef.h>
+
+#include "type.h"
+
+extern PyTypeObject py_type_list;
+extern PyTypeObject py_type_list_iterator;
+
+PyObject *py_list_new(int size_hint); // empty, with room for size_hint items
+void py_list_append(PyObject *list, PyObject *item);
+// for RESUME - NULL once the iterator is exhausted
+PyObject *py_list_iter_next(PyObject *iter);
+
+// sum(iterable[, start]), min(...) and max(...) - each takes a list, a
+// generator, or anything iterable whose iterator has a __next__. min and
+// max also take two or more arguments to compare
+PyObject *py_builtin_sum(PyObject *self, PyObject *const *args, size_t nargs);
+PyObject *py_builtin_min(PyObject *self, PyObject *const *args, size_t nargs);
+PyObject *py_builtin_max(PyObject *self, PyObject *const *args, size_t nargs);
+
+// the same three over a generator the eval loop runs, a yield at a time:
+// fold_start checks the call's args, fold takes in each item, and fold_end
+// gives the result (raising if min or max never saw an item)
+void py_builtin_fold_start(GenFold *fold, const PyCFuncObject *builtin, PyObject *const *args, size_t nargs);
+void py_builtin_fold(GenFold *fold, PyObject *item);
+PyObject *py_builtin_fold_end(GenFold *fold);
+
+#endif
@@ -1,423 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <assert.h>
+#include <unistd.h>
 
 #include "hash-table.h" 
 #include "parser.h"
 
-#include "type.h"
-#include "cfunc.h"
-#include "func.h"
-#include "int.h"
-#include "tuple.h"
-#include "bytes.h"
-
-#define MAX_STACK_SIZE 100 
-#define MAX_RECURSION_DEPTH 1000
-
-// NOTE: value stack (each frame has one)
-typedef struct {
-  PyObject *data[MAX_STACK_SIZE];
-  int top;
-} Stack; 
-
-void stack_init(Stack *s) {
-  s->top = -1;
-}
-
-int stack_is_empty(Stack *s) {
-  return s->top == -1;
-}
-
-int stack_is_full(Stack *s) {
-  return s->top == MAX_STACK_SIZE - 1;
-}
-
-void stack_push(Stack *s, PyObject *object) {
-  if (stack_is_full(s)) {
-    printf("Stack overflow!\n");
-    exit(1);
-  } else
-    s->data[++s->top] = object;
-}
-
-PyObject *stack_pop(Stack *s) {
-  if (stack_is_empty(s)) {
-    printf("Stack underflow!\n");
-    exit(1);
-  } else
-    return s->data[s->top--];
-}
-
-/* TODO: fix after breaking with PyObjects
-void stack_print(Stack *s) {
-  if (stack_is_empty(s))
-    printf("[]\n");
-  else {
-    int i;
-    printf("[%d", *s->data[0]); 
-    for (i = 1; i <= s->top; i++)
-      printf(", %d", *s->data[i]);
-    printf("]\n");
-  }
-}
-*/
-
-typedef struct PyFrameObject {
-  struct PyCodeObject *code; // bytecode being executed
-  int bytecode_offset; // program counter
-  struct PyFrameObject *prev; // previous frame
-  HashTable *locals;
-  Stack *value_stack;
-} PyFrameObject;
-
-void py_frame_object_init(PyFrameObject *frame, HashTable *locals) {
-  frame->code = NULL;
-  frame->bytecode_offset = 0;
-  frame->prev = NULL;
-  frame->value_stack = malloc(sizeof(Stack));
-  stack_init(frame->value_stack);
-  // in module-level frame we pass in our own locals (pointer to module dict)
-  if (locals == NULL) {
-    frame->locals = malloc(sizeof(HashTable));
-    hashtable_init(frame->locals);
-  } else {
-    frame->locals = locals; 
-  }
-}
-
-typedef struct PyState {
-  PyFrameObject *current_frame;
-  int recursion_depth;
-  HashTable *globals;
-} PyState;  
-
-// NOTE: define opcodes
-typedef enum {
-  OP_UNKNOWN = -1,
-  OP_LOAD_CONST,
-  OP_STORE_NAME,
-  OP_LOAD_NAME,
-  OP_BINARY_OP,
-  OP_MAKE_FUNCTION,
-  OP_CALL_FUNCTION, // called with int argn, number of args to pop from stack
-  OP_RETURN,
-  OP_POP_TOP,
-  OP_COMPARE,
-  OP_JUMP, // arg: target offset
-  OP_POP_JUMP_IF_FALSE // arg: target offset
-} OpCode;
-
-
-typedef PyBoolObject *(*CompareFunc)(PyIntObject *a, PyIntObject *b);
-
-static PyBoolObject *compare_equals(PyIntObject *a, PyIntObject *b) {
-  PyBoolObject *result = malloc(sizeof(PyBoolObject));
-  if (a->value == b->value)
-    result->value = 1;
-  else
-    result->value = 0;
-
-  return result;
-}
-
-static PyBoolObject *compare_greater_than(PyIntObject *a, PyIntObject *b) {
-  PyBoolObject *result = malloc(sizeof(PyBoolObject));
-  if (a->value > b->value)
-    result->value = 1;
-  else
-    result->value = 0;
-
-  return result;
-}
-
-static PyBoolObject *compare_less_than(PyIntObject *a, PyIntObject *b) {
-  PyBoolObject *result = malloc(sizeof(PyBoolObject));
-  if (a->value > b->value)
-    result->value = 1;
-  else
-    result->value = 0;
-
-  return result;
-}
-
-static CompareFunc compare_func_table[3] = {
-  compare_equals,
-  compare_greater_than,
-  compare_less_than
-};
-
-int equals_opcode(const char *input, size_t len, const char *cmd) {
-  return (strlen(cmd) == len) && (strncmp(input, cmd, len) == 0);
-}
-
-OpCode get_opcode(const char *input) {
-  int i = 0;
-  while (input[i] != ',' && input[i] != '\0')
-    i++;
-  
-  // TODO: use get_opcode and switch-case
-  if (equals_opcode(input, i, "LOAD_CONST"))
-    return OP_LOAD_CONST;
-  else if (equals_opcode(input, i, "BINARY_OP"))
-    return OP_BINARY_OP;
-  else if (equals_opcode(input, i, "RETURN"))
-    return OP_RETURN;
-  else if (equals_opcode(input, i, "LOAD_NAME"))
-    return OP_LOAD_NAME;
-  else if (equals_opcode(input, i, "STORE_NAME"))
-    return OP_STORE_NAME;
-  else if (equals_opcode(input, i, "MAKE_FUNCTION"))
-    return OP_MAKE_FUNCTION;
-  else if (equals_opcode(input, i, "CALL_FUNCTION"))
-    return OP_CALL_FUNCTION;
-  else if (equals_opcode(input, i, "POP_TOP"))
-    return OP_POP_TOP;
-  else if (equals_opcode(input, i, "COMPARE"))
-    return OP_COMPARE;
-  else if (equals_opcode(input, i, "POP_JUMP_IF_FALSE"))
-    return OP_POP_JUMP_IF_FALSE;
-  else if (equals_opcode(input, i, "JUMP"))
-    return OP_JUMP;
-  else
-    return OP_UNKNOWN;
-}
-
-int get_operand(const char *input) {
-  int c;
-  int i = 0;
-  while ((c = input[i]) != ',') {
-    if (c == '\0')
-      return -1; // no operand
-    i++;
-  }
-   
-  char operand[5] = {0};
-  int j = 0;
-  i++;
-  while ((c = input[i]) != '\0') {
-    operand[j++] = c;
-    i++;
-  }
-
-  return atoi(operand);
-}
-
-char *get_string_operand(const char *input) {
-
-  int c;
-  int i = 0;
-  while ((c = input[i]) != ',') {
-    if (c == '\0')
-      return NULL;
-    i++;
-  }
-
-  // now strip name from '---' bit
-  char *operand = malloc(10);
-  int j = 0;
-  i++; i++;
-  while ((c = input[i]) != '\'') {
-    operand[j] = c;
-    j++;
-    i++;
-  }
-  operand[j] = '\0';
-
-  return operand;  
-}
-
-void handle_bytecode(PyState *state, const char *input) {
-  // take a bytecode instruction and mutate frame and/or its stack
-  OpCode opcode = get_opcode(input); 
-  char *varname;
-  // printf("DEBUG: handling bytecode %s\n", input);
-  switch (opcode) { 
-    case OP_LOAD_CONST: {
-      // get obj from pre-compiled consts array
-      int idx = get_operand(input); 
-      PyObject *constant = state->current_frame->code->consts[idx];
-      stack_push(state->current_frame->value_stack, constant);
-      state->current_frame->bytecode_offset += 1; // move us forward one instruction
-      break;
-    }
-    case OP_STORE_NAME: {
-      // save stack[-1] to variable named operand
-      PyObject *top = stack_pop(state->current_frame->value_stack);
-      varname = get_string_operand(input);
-      hashtable_insert(state->current_frame->locals, varname, top); // in bottom frame this points to globals
-      state->current_frame->bytecode_offset += 1;
-      break;
-    }
-    case OP_LOAD_NAME:
-      // get variable name
-      varname = get_string_operand(input); 
-      if (varname == NULL) {
-        printf("error: bad operand\n");
-        exit(1);
-      }
-      // lookup in locals then globals
-      PyObject *localobject = hashtable_get(state->current_frame->locals, varname);
-      if (localobject != NULL) {
-        stack_push(state->current_frame->value_stack, localobject);
-      } else {
-        PyObject *globalobject = hashtable_get(state->globals, varname); 
-        if (globalobject != NULL) {
-          stack_push(state->current_frame->value_stack, globalobject);
-        } else {
-          printf("NameError: name '%s' is not defined\n", varname);
-          exit(1);
-        }
-      }
-      state->current_frame->bytecode_offset += 1;
-      break;
-    case OP_BINARY_OP: {
-      // get binary operator
-      int bin_op = get_operand(input);
-      // TODO: just map bin_op to method string
-      if (bin_op == ADD) {
-        PyObject *b = stack_pop(state->current_frame->value_stack);
-        PyObject *a = stack_pop(state->current_frame->value_stack);
-        // lookup __add__ on `type(a)`
-        PyTypeObject *type_a = a->type; 
-        // assume all dunder methods are builtins
-        PyObject *_add_obj = hashtable_get(type_a->methods, "__add__");
-        if (_add_obj == NULL) {
-          printf("AttributeError: __add__");
-          exit(1);
-        }
-        assert(_add_obj->type == &(py_type_cfunc)); 
-        PyCFunction _add = ((PyCFuncObject *) _add_obj)->function;
-        PyObject *result = _add(a, b);
-        stack_push(state->current_frame->value_stack, result);
-        state->current_frame->bytecode_offset += 1;
-        break;
-      } else if (bin_op == MULT) {
-        PyObject *b = stack_pop(state->current_frame->value_stack);
-        PyObject *a = stack_pop(state->current_frame->value_stack);
-        // lookup __mult__ on `type(a)`
-        PyTypeObject *type_a = a->type; 
-        // assume all dunder methods are builtins
-        PyObject *_mult_obj = hashtable_get(type_a->methods, "__mult__");
-        if (_mult_obj == NULL) {
-          printf("AttributeError: __mult__");
-          exit(1);
-        }
-        assert(_mult_obj->type == &(py_type_cfunc)); 
-        PyCFunction _mult = ((PyCFuncObject *) _mult_obj)->function;
-        PyObject *result = _mult(a, b);
-        stack_push(state->current_frame->value_stack, result);
-        state->current_frame->bytecode_offset += 1;
-        break;
-      } else {
-        printf("OperatorError: unhandled operator %d\n", bin_op);
-        exit(1);
-      }
-    }
-    case OP_MAKE_FUNCTION: {
-      // make func obj
-      PyFuncObject *new_func = malloc(sizeof(PyFuncObject));
-      new_func->base.type = &py_type_func;
-      new_func->code = (PyCodeObject *) stack_pop(state->current_frame->value_stack); 
-      // push to stack - next opcode will be STORE_NAME...
-      stack_push(state->current_frame->value_stack, (PyObject *) new_func);
-      state->current_frame->bytecode_offset += 1;
-      break;
-    }
-    case OP_CALL_FUNCTION:
-      // push a new frame to callstack, remembering our
-      // current bytecode offset in the current frame
-      // NOTE: top of value stack needs to be a function lol
-      if (state->recursion_depth == MAX_RECURSION_DEPTH) {
-        printf("RecursionError: maximum recursion depth exceeded\n");
-        exit(1);
-      }
-
-      int arg_count = get_operand(input);
-      // pop #arg_count args
-      PyObject **args = malloc(5 * sizeof(PyObject *));
-      for (int i=arg_count-1; i>=0; i--) {
-        args[i] = malloc(sizeof(PyObject *));
-        args[i] = stack_pop(state->current_frame->value_stack);
-      }
-      // pop callable
-      PyObject *f = stack_pop(state->current_frame->value_stack); 
-      if (f->type == &py_type_func) {
-        // python functions
-        PyFuncObject *func = (PyFuncObject *) f;
-        // init new frame and populate locals
-        PyFrameObject *new_frame = malloc(sizeof(PyFrameObject));
-        py_frame_object_init(new_frame, NULL);
-        for (int j=0; j < arg_count; j++) {
-          hashtable_insert(new_frame->locals, func->code->argnames[j], args[j]);
-        }
-        new_frame->prev = state->current_frame;
-        new_frame->code = func->code;
-        // increment pc on the current frame so we pop back to the next instruction
-        state->current_frame->bytecode_offset += 1;
-        state->current_frame = new_frame;
-        state->recursion_depth += 1;
-      } else if (f->type == &py_type_cfunc) {
-        PyCFuncObject *cfunc = (PyCFuncObject *) f;
-        PyTupleObject *py_args = malloc(sizeof(PyTupleObject));
-        py_args->base.type = &py_type_tuple;
-        py_args->size = arg_count;
-        py_args->elements = malloc(arg_count * sizeof(PyObject *));
-        for (int j=0; j < arg_count; j++) {
-          py_args->elements[j] = args[j];
-        }
-        PyObject *result = cfunc->function(NULL, (PyObject *) py_args);
-        stack_push(state->current_frame->value_stack, result);
-        state->current_frame->bytecode_offset += 1; 
-      }
-      break;
-    case OP_RETURN: {
-      // pop a frame from the callstack, return to the
-      // bytecode instruction referenced in the caller frame
-      // (and push the return'd value to the value stack of
-      // of the frame below)
-      PyObject *return_value = stack_pop(state->current_frame->value_stack);
-      PyFrameObject *old_frame = state->current_frame;
-      // jump to prev frame and push the return value
-      state->current_frame = old_frame->prev;
-      stack_push(state->current_frame->value_stack, return_value);
-      state->recursion_depth -= 1;
-      // TODO: deallocate old frame!
-      break;
-    }
-    case OP_POP_TOP:
-      stack_pop(state->current_frame->value_stack);
-      break;
-    case OP_COMPARE: {
-      // e.g. "COMPARE,0" means '=='
-      // compare and push bool result
-      PyIntObject *right = (PyIntObject *) stack_pop(state->current_frame->value_stack);
-      PyIntObject *left = (PyIntObject *) stack_pop(state->current_frame->value_stack); 
-      int comparison = get_operand(input);
-      PyBoolObject *result = compare_func_table[comparison](left, right);
-      stack_push(state->current_frame->value_stack, (PyObject *) result);
-      state->current_frame->bytecode_offset += 1;
-      break;
-    }
-    case OP_POP_JUMP_IF_FALSE: {
-      PyBoolObject *top_bool = (PyBoolObject *) stack_pop(state->current_frame->value_stack);
-      int target = get_operand(input); // jump target offset
-      if (top_bool->value == 0) {
-        state->current_frame->bytecode_offset = target;
-      } else {
-        state->current_frame->bytecode_offset += 1;
-      }
-      break;
-    }
-    case OP_JUMP:
-      state->current_frame->bytecode_offset = get_operand(input);
-      break;
-    case OP_UNKNOWN:
-      printf("error: bad opcode %s\n", input);
-      exit(1); 
-  }
-}
+#include "interp.h"
+#include "profile.h"
+#include "stats.h"
+#include "memstats.h"
+#include "code.h"
+#include "writer.h"
+#include "jit.h"
+#include "server.h"
+#include "snapshot.h"
+#include "simd.h"
+
+#define PROFILE_HZ 1000 // --profile sampling rate
+#define MEMSTATS_TOP 10 // kinds and sites --memstats lists
+#define DUMP_BUFFER_SIZE (64 * 1024) // --dump-tokens/--dump-ast/--dis
 
 char *read_file(const char *filename) {
   FILE *f = fopen(filename, "r");
@@ -442,105 +44,213 @@ char *read_file(const char *filename) {
   return buffer;
 }
 
-// BUILT-INS
-PyObject *py_builtin_print(PyObject *self, PyObject *args) {
-  // NOTE: expect self == NULL
-  PyTupleObject *_args = (PyTupleObject *) args;
-  for (int i = 0; i < _args->size; i++) {
-    if (_args->elements[i]->type == &py_type_int) {
-      printf("%d", ((PyIntObject *) _args->elements[i])->value);
-    } else if (_args->elements[i]->type == &py_type_bytes) {
-      printf("%s", ((PyBytesObject *) _args->elements[i])->data); 
-    }
-    if (i+1 < _args->size) {
-      printf(" ");
-    } else {
-      printf("\n");
+int main(int argc, char **argv) {
+
+  PyInterpConfig config;
+  py_interp_config_init(&config);
+
+  // parse options - the first non-option is the script
+  const char *filename = NULL;
+  const char *profile_path = NULL;
+  const char *snapshot_in = NULL, *snapshot_out = NULL;
+  enum { STATS_OFF, STATS_COUNTS, STATS_CYCLES } stats_mode = STATS_OFF;
+  int memstats_top = 0; // --memstats, 0 for off
+  int dump_tokens = 0, dump_ast = 0, dump_bytecode = 0;
+  int jit = 0;
+  int serving = 0;
+  ServeConfig serve_config = { .socket_path = NULL, .workers = SERVE_WORKERS };
+  config.timeout_ms = SERVE_TIMEOUT_MS;
+  config.output_limit = SERVE_MAX_OUTPUT;
+  int jit_threshold = JIT_THRESHOLD;
+  for (int k=1; k<argc; k++) {
+    if (strcmp(argv[k], "--dump-tokens") == 0) {
+      dump_tokens = 1;
+    } else if (strcmp(argv[k], "--dump-ast") == 0) {
+      dump_ast = 1;
+    } else if (strcmp(argv[k], "--dis") == 0) {
+      dump_bytecode = 1;
+    } else if (strcmp(argv[k], "--tail-calls") == 0) {
+      config.tail_calls = 1;
+    } else if (strcmp(argv[k], "--no-inline") == 0) {
+      config.inline_functions = 0;
+    } else if (strcmp(argv[k], "--no-quicken") == 0) {
+      config.quicken = 0;
+    } else if (strcmp(argv[k], "--jit") == 0) {
+      jit = 1;
+    } else if (strncmp(argv[k], "--jit-threshold=", 16) == 0) {
+      jit_threshold = atoi(argv[k] + 16);
+      if (jit_threshold < 1) {
+        printf("error: bad --jit-threshold %s\n", argv[k] + 16);
+        exit(1);
+      }
+    } else if (strncmp(argv[k], "--output-buffer=", 16) == 0) {
+      config.output_buffer_size = atoi(argv[k] + 16);
+      if (config.output_buffer_size < 0) {
+        printf("error: bad --output-buffer size %s\n", argv[k] + 16);
+        exit(1);
+      }
+    } else if (strcmp(argv[k], "--serve") == 0) {
+      serving = 1;
+    } else if (strncmp(argv[k], "--serve=", 8) == 0) {
+      serving = 1;
+      serve_config.socket_path = argv[k] + 8;
+    } else if (strncmp(argv[k], "--workers=", 10) == 0) {
+      serve_config.workers = atoi(argv[k] + 10);
+      if (serve_config.workers < 1) {
+        printf("error: bad --workers %s\n", argv[k] + 10);
+        exit(1);
+      }
+    } else if (strncmp(argv[k], "--timeout=", 10) == 0) {
+      config.timeout_ms = atoi(argv[k] + 10);
+      if (config.timeout_ms < 0) {
+        printf("error: bad --timeout %s\n", argv[k] + 10);
+        exit(1);
+      }
+    } else if (strncmp(argv[k], "--max-output=", 13) == 0) {
+      config.output_limit = atoi(argv[k] + 13);
+      if (config.output_limit < 1) {
+        printf("error: bad --max-output %s\n", argv[k] + 13);
+        exit(1);
+      }
+    } else if (strncmp(argv[k], "--snapshot-in=", 14) == 0) {
+      snapshot_in = argv[k] + 14;
+    } else if (strncmp(argv[k], "--snapshot-out=", 15) == 0) {
+      snapshot_out = argv[k] + 15;
+    } else if (strncmp(argv[k], "--simd=", 7) == 0) {
+      if (simd_set_level(argv[k] + 7) != 0) {
+        printf("error: bad or unsupported --simd level %s\n", argv[k] + 7);
+        exit(1);
+      }
+    } else if (strncmp(argv[k], "--profile=", 10) == 0) {
+      profile_path = argv[k] + 10;
+    } else if (strcmp(argv[k], "--stats") == 0) {
+      stats_mode = STATS_COUNTS;
+    } else if (strcmp(argv[k], "--stats=cycles") == 0) {
+      stats_mode = STATS_CYCLES;
+    } else if (strcmp(argv[k], "--memstats") == 0) {
+      memstats_top = MEMSTATS_TOP;
+    } else if (strncmp(argv[k], "--memstats=", 11) == 0) {
+      memstats_top = atoi(argv[k] + 11);
+      if (memstats_top < 1) {
+        printf("error: bad --memstats %s\n", argv[k] + 11);
+        exit(1);
+      }
+    } else if (strncmp(argv[k], "--", 2) == 0) {
+      printf("error: unknown option %s\n", argv[k]);
+      exit(1);
+    } else if (filename == NULL) {
+      filename = argv[k];
     }
   }
-  return NULL;
-}
 
-PyObject *py_builtin_len(PyObject *self, PyObject *args) {
-  // NOTE: expect self == NULL
-  // we just return `type(args[0]).__len__(arg)`
-  PyTupleObject *_args = (PyTupleObject *) args;
-  PyObject *arg = _args->elements[0];
-  PyTypeObject *type_arg = arg->type; 
-  PyObject *_len_obj = hashtable_get(type_arg->methods, "__len__");
-  if (_len_obj == NULL) {
-    printf("AttributeError: __len__");
+  if (jit && !jit_available()) {
+    printf("error: --jit is only supported on x86-64\n");
     exit(1);
   }
-  assert(_len_obj->type == &py_type_cfunc); 
-  PyCFunction _len = ((PyCFuncObject *) _len_obj)->function;
-  return _len(self, arg);
-}
-
-int main(int argc, char **argv) {
-
-  // initialise types (i.e. build their method tabels.
-  py_type_init(&py_type_int);
-  py_type_init(&py_type_bytes);
-
-  // initialise globals hash-table
-  HashTable globals;
-  hashtable_init(&globals);
-  
-  // load builtins
-  PyMethodDef py_builtins[] = {
-    { "print", py_builtin_print },
-    { "len", py_builtin_len },
-    { NULL, NULL }
-  };
-  for (int i=0; py_builtins[i].name != NULL; i++) {
-    PyCFuncObject *_builtin_obj = malloc(sizeof(PyCFuncObject));
-    _builtin_obj->base.type = &py_type_cfunc;
-    _builtin_obj->function = py_builtins[i].method; 
-    hashtable_insert(&globals, py_builtins[i].name, (PyObject *) _builtin_obj);
+  if (jit && stats_mode) {
+    // NOTE: --stats counts instructions as the interpreter dispatches them,
+    // and native code doesn't go through the interpreter
+    printf("error: --jit can't be combined with --stats\n");
+    exit(1);
+  }
+  if (jit && (memstats_top || profile_path != NULL)) {
+    // NOTE: allocation sites and samples come from the frame's pc, which
+    // native code only keeps up to date where it can raise
+    printf("error: --jit can't be combined with --memstats or --profile\n");
+    exit(1);
   }
 
-  // initialise state with current frame
-  PyFrameObject bottom_frame;
-  py_frame_object_init(&bottom_frame, &globals);
-
-  PyState state; // essentially interpreter state
-  state.current_frame = &bottom_frame; 
-  state.recursion_depth = 0;
-  state.globals = &globals;
+  if (serving) {
+    // NOTE: limits are checked as the interpreter dispatches backward jumps
+    // and calls, so they'd miss loops running as native code. --stats,
+    // --memstats and --profile are for one script at a time
+    if (jit || stats_mode || memstats_top || profile_path != NULL) {
+      printf("error: --serve can't be combined with --jit, --stats, --memstats or --profile\n");
+      exit(1);
+    }
+    return serve(&serve_config, &config);
+  }
+  // NOTE: the limits are only for --serve
+  config.timeout_ms = 0;
 
-  if (argv[1] == NULL) {
+  if (filename == NULL) {
     printf("interactive mode unsupported! give me a file..\n");  
     exit(1);
   }
 
   // -> walk into a total string array of instructions
-  char *input = read_file(argv[1]);
+  char *input = read_file(filename);
+  if (input == NULL) {
+    printf("error: can't open file '%s'\n", filename);
+    exit(1);
+  }
+  // NOTE: dumps go to stdout ahead of any program output, and are flushed
+  // before the script runs
+  Writer dump;
+  if (dump_tokens || dump_ast || dump_bytecode) {
+    writer_init(&dump, STDOUT_FILENO, DUMP_BUFFER_SIZE);
+  }
+
   TokenArray tokens = tokenize(input);
-  print_tokens(tokens.data);
+  if (dump_tokens) {
+    writer_puts(&dump, "tokens =\n");
+    tokens_dump(&dump, tokens.data);
+    writer_puts(&dump, "\n");
+  }
 
   int t_idx = 0;
   Module *module = parse(tokens.data, &t_idx);
-  printf("ast = \n");
-  module_print(module);
-  printf("\n");
+  if (dump_ast) {
+    writer_puts(&dump, "ast =\n");
+    module_dump(&dump, module);
+    writer_puts(&dump, "\n");
+  }
   
-  PyCodeObject *code = module_walk(module);
-  state.current_frame->code = code;
+  if (stats_mode) {
+    stats_enable(stats_mode == STATS_CYCLES);
+  }
+  if (memstats_top) {
+    // before compiling, so constants are counted too
+    memstats_enable(memstats_top);
+  }
+  if (jit) {
+    config.jit_threshold = jit_threshold;
+  }
+  PyCodeObject *code = module_walk(module, config.inline_functions);
 
-  printf("bytecode =\n");
-  for (int k=0; code->bytecode[k] != NULL; k++) {
-    printf("%d: %s\n", k, code->bytecode[k]);
+  if (dump_bytecode) {
+    writer_puts(&dump, "bytecode =\n");
+    py_code_dump(&dump, code);
+    writer_puts(&dump, "\n");
+  }
+  if (dump_tokens || dump_ast || dump_bytecode) {
+    writer_puts(&dump, "output =\n");
+    writer_flush(&dump);
+  }
+  PyInterp *interp = py_interp_new(&config);
+  // globals saved by an earlier --snapshot-out, as if that script ran first
+  if (snapshot_in != NULL && snapshot_load(&interp->globals, snapshot_in) != 0) {
+    exit(1);
   }
-  printf("\n");
-  printf("output = \n");
-  // -> interpret the bytecode - handle_bytecode increments program counter
-  int i = state.current_frame->bytecode_offset;
-  while (state.current_frame->code->bytecode[i] != NULL) {
-    handle_bytecode(&state, state.current_frame->code->bytecode[i]);
-    i = state.current_frame->bytecode_offset; // current_frame may have changed!
+  if (memstats_top) {
+    memstats_watch(&interp->state);
+  }
+  if (profile_path != NULL) {
+    profile_start(&interp->state, profile_path, PROFILE_HZ);
+  }
+  // -> interpret the bytecode
+  // NOTE: output is flushed by the time we get back, so an error message
+  // still comes out after it
+  if (py_interp_exec(interp, code) != 0) {
+    printf("%s\n", py_interp_error(interp));
+    exit(1);
+  }
+  if (snapshot_out != NULL && snapshot_save(&interp->globals, snapshot_out) != 0) {
+    exit(1);
   }
 
+  if (profile_path != NULL) {
+    profile_stop(); // output is written at exit, so `interp` stays around
+  }
   return 0;
 }
-
@@ -26,5 +26,5 @@ int main() {
   PyObject *_int_add = hashtable_get(a.base.type->methods, "__add__");
   printf("looked up func at %p\n", _int_add); 
   PyObject *result = (((PyCFuncObject *) _int_add)->function)((PyObject *) &a, (PyObject * ) &b);
-  printf("result = %d\n", ((PyIntObject *) result)->value);
+  printf("result = %lld\n", ((PyIntObject *) result)->value);
 }
@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "memo.h"
+#include "type.h"
+#include "int.h"
+#include "bytes.h"
+#include "func.h"
+#include "cfunc.h"
+#include "stats.h"
+
+// NOTE: memoize(f, maxsize) wraps f in a cache keyed on its arguments. the
+// cache is a packed array of entries, found through an open-addressing
+// index (linear probing, backward-shift deletion so there are no
+// tombstones) and threaded on a doubly-linked LRU list - once it holds
+// maxsize entries the least recently used one is evicted to make room.
+// CALL_FUNCTION checks for the wrapper itself: a hit pushes the cached
+// value without touching f, a miss calls f and its frame remembers the key,
+// so RETURN can fill the entry in
+
+#define MEMO_INITIAL_CAPACITY 8
+
+PyTypeObject py_type_memo = {
+  .base = { .type = &py_type_type },
+  .name = "memoize",
+  .basic_size = sizeof(PyMemoObject),
+  .item_size = 0,
+  .methods = NULL
+};
+
+// NOTE: only kept for the --stats report, which is process-wide anyway -
+// with stats off, wrappers made by different interpreters share nothing
+static PyMemoObject *all_memos = NULL;
+
+PyObject *py_memo_new(PyObject *func, int maxsize) {
+  PyMemoObject *memo = (PyMemoObject *) py_type_alloc(&py_type_memo);
+  memo->func = func;
+  memo->maxsize = maxsize;
+  memo->capacity = maxsize < MEMO_INITIAL_CAPACITY ? maxsize : MEMO_INITIAL_CAPACITY;
+  memo->entries = py_type_realloc_data(&py_type_memo, NULL, 0, memo->capacity * sizeof(MemoEntry));
+  memo->count = 0;
+  // index is at most half full
+  int slots = 1;
+  while (slots < 2 * memo->capacity) slots *= 2;
+  memo->index = py_type_realloc_data(&py_type_memo, NULL, 0, slots * sizeof(int));
+  memset(memo->index, -1, slots * sizeof(int));
+  memo->index_mask = slots - 1;
+  memo->in_image = 0;
+  memo->head = -1;
+  memo->tail = -1;
+  memo->hits = 0;
+  memo->misses = 0;
+  memo->next_memo = NULL;
+  if (stats_enabled) {
+    memo->next_memo = all_memos;
+    all_memos = memo;
+  }
+  return (PyObject *) memo;
+}
+
+// keys -----------------------------------------------------------------
+
+static unsigned int hash_mix(unsigned int h, unsigned long long value) {
+  value *= 0x9e3779b97f4a7c15ULL;
+  return (h ^ (unsigned int) (value >> 32)) * 16777619u;
+}
+
+static void hash_chunk(const char *data, int size, void *arg) {
+  unsigned int *h = arg;
+  for (int i=0; i<size; i++) {
+    *h = (*h ^ (unsigned char) data[i]) * 16777619u;
+  }
+}
+
+int py_memo_key(MemoKey *key, PyObject *const *args, int nargs) {
+  if (nargs > MEMO_MAX_ARGS) {
+    return 0;
+  }
+  unsigned int h = 2166136261u ^ nargs;
+  for (int i=0; i<nargs; i++) {
+    PyObject *arg = args[i];
+    if (arg->type == &py_type_int) {
+      PyIntObject *n = (PyIntObject *) arg;
+      if (n->digits == NULL) {
+        h = hash_mix(h, n->value);
+      } else {
+        // NOTE: ints are normalised, so a bignum never equals a small int
+        h = hash_mix(h, n->size);
+        int num_digits = n->size < 0 ? -n->size : n->size;
+        for (int d=0; d<num_digits; d++) {
+          h = hash_mix(h, n->digits[d]);
+        }
+      }
+    } else if (arg->type == &py_type_bytes) {
+      // ropes are hashed chunk by chunk - no need to flatten
+      h = hash_mix(h, ((PyBytesObject *) arg)->size);
+      py_bytes_for_each_chunk(arg, hash_chunk, &h);
+    } else {
+      return 0;
+    }
+    key->args[i] = arg;
+  }
+  key->hash = h;
+  key->nargs = nargs;
+  return 1;
+}
+
+static int arg_equals(PyObject *a, PyObject *b) {
+  if (a == b) {
+    return 1;
+  }
+  if (a->type != b->type) {
+    return 0;
+  }
+  if (a->type == &py_type_int) {
+    PyIntObject *ia = (PyIntObject *) a;
+    PyIntObject *ib = (PyIntObject *) b;
+    if (ia->digits == NULL || ib->digits == NULL) {
+      return ia->digits == ib->digits && ia->value == ib->value;
+    }
+    int num_digits = ia->size < 0 ? -ia->size : ia->size;
+    return ia->size == ib->size && memcmp(ia->digits, ib->digits, num_digits * sizeof(ia->digits[0])) == 0;
+  }
+  int size = ((PyBytesObject *) a)->size;
+  return size == ((PyBytesObject *) b)->size && memcmp(py_bytes_data(a), py_bytes_data(b), size) == 0;
+}
+
+static int key_equals(const MemoKey *a, const MemoKey *b) {
+  if (a->hash != b->hash || a->nargs != b->nargs) {
+    return 0;
+  }
+  for (int i=0; i<a->nargs; i++) {
+    if (!arg_equals(a->args[i], b->args[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// the index -----------------------------------------------------------
+
+// slot holding `key`, or the empty slot it would go in
+static int find_slot(PyMemoObject *memo, const MemoKey *key) {
+  int slot = key->hash & memo->index_mask;
+  while (memo->index[slot] != -1 && !key_equals(&memo->entries[memo->index[slot]].key, key)) {
+    slot = (slot + 1) & memo->index_mask;
+  }
+  return slot;
+}
+
+// empty a slot, shifting back any later entries in its probe run that
+// would otherwise become unreachable
+static void index_remove(PyMemoObject *memo, int slot) {
+  int hole = slot;
+  int next = (hole + 1) & memo->index_mask;
+  while (memo->index[next] != -1) {
+    int home = memo->entries[memo->index[next]].key.hash & memo->index_mask;
+    // can the entry at `next` move back into the hole?
+    if (((next - home) & memo->index_mask) >= ((next - hole) & memo->index_mask)) {
+      memo->index[hole] = memo->index[next];
+      hole = next;
+    }
+    next = (next + 1) & memo->index_mask;
+  }
+  memo->index[hole] = -1;
+}
+
+static void grow(PyMemoObject *memo) {
+  int old_capacity = memo->capacity;
+  memo->capacity = memo->capacity * 2 < memo->maxsize ? memo->capacity * 2 : memo->maxsize;
+  int slots = memo->index_mask + 1;
+  while (slots < 2 * memo->capacity) slots *= 2;
+  if (memo->in_image) {
+    // the tables are in a snapshot image - copy the entries out, and start
+    // a new index (it's rebuilt below either way)
+    MemoEntry *entries = py_type_realloc_data(&py_type_memo, NULL, 0, memo->capacity * sizeof(MemoEntry));
+    memcpy(entries, memo->entries, memo->count * sizeof(MemoEntry));
+    memo->entries = entries;
+    memo->index = py_type_realloc_data(&py_type_memo, NULL, 0, slots * sizeof(int));
+    memo->in_image = 0;
+  } else {
+    memo->entries = py_type_realloc_data(&py_type_memo, memo->entries, old_capacity * sizeof(MemoEntry),
+                                         memo->capacity * sizeof(MemoEntry));
+    memo->index = py_type_realloc_data(&py_type_memo, memo->index, (memo->index_mask + 1) * sizeof(int),
+                                       slots * sizeof(int));
+  }
+  memset(memo->index, -1, slots * sizeof(int));
+  memo->index_mask = slots - 1;
+  for (int i=0; i<memo->count; i++) {
+    memo->index[find_slot(memo, &memo->entries[i].key)] = i;
+  }
+}
+
+// the LRU list --------------------------------------------------------
+
+static void lru_unlink(PyMemoObject *memo, int i) {
+  MemoEntry *entry = &memo->entries[i];
+  if (entry->prev != -1) {
+    memo->entries[entry->prev].next = entry->next;
+  } else {
+    memo->head = entry->next;
+  }
+  if (entry->next != -1) {
+    memo->entries[entry->next].prev = entry->prev;
+  } else {
+    memo->tail = entry->prev;
+  }
+}
+
+static void lru_push_front(PyMemoObject *memo, int i) {
+  MemoEntry *entry = &memo->entries[i];
+  entry->prev = -1;
+  entry->next = memo->head;
+  if (memo->head != -1) {
+    memo->entries[memo->head].prev = i;
+  } else {
+    memo->tail = i;
+  }
+  memo->head = i;
+}
+
+// ---------------------------------------------------------------------
+
+PyObject *py_memo_lookup(PyMemoObject *memo, const MemoKey *key) {
+  int i = memo->index[find_slot(memo, key)];
+  if (i == -1) {
+    memo->misses++;
+    return NULL;
+  }
+  memo->hits++;
+  if (memo->head != i) {
+    lru_unlink(memo, i);
+    lru_push_front(memo, i);
+  }
+  return memo->entries[i].value;
+}
+
+int py_memo_contains(PyMemoObject *memo, const MemoKey *key) {
+  return memo->index[find_slot(memo, key)] != -1;
+}
+
+void py_memo_insert(PyMemoObject *memo, const MemoKey *key, PyObject *value) {
+  int slot = find_slot(memo, key);
+  int i = memo->index[slot];
+  if (i != -1) {
+    // NOTE: a recursive call can get there first
+    memo->entries[i].value = value;
+    return;
+  }
+  if (memo->count < memo->capacity) {
+    i = memo->count++;
+  } else if (memo->capacity < memo->maxsize) {
+    grow(memo);
+    slot = find_slot(memo, key);
+    i = memo->count++;
+  } else {
+    // full - reuse the least recently used entry
+    i = memo->tail;
+    lru_unlink(memo, i);
+    index_remove(memo, find_slot(memo, &memo->entries[i].key));
+    slot = find_slot(memo, key);
+  }
+  memo->entries[i].key = *key;
+  memo->entries[i].value = value;
+  memo->index[slot] = i;
+  lru_push_front(memo, i);
+}
+
+const char *py_memo_name(PyMemoObject *memo) {
+  if (memo->func->type == &py_type_func) {
+    return ((PyFuncObject *) memo->func)->code->name;
+  }
+  return ((PyCFuncObject *) memo->func)->name;
+}
+
+void py_memo_report(FILE *out) {
+  if (all_memos == NULL) {
+    return;
+  }
+  fprintf(out, "\nmemoize:\n");
+  for (PyMemoObject *memo = all_memos; memo != NULL; memo = memo->next_memo) {
+    long total = memo->hits + memo->misses;
+    fprintf(out, "  %-20s %12ld hits %12ld misses", py_memo_name(memo), memo->hits, memo->misses);
+    if (total > 0) {
+      fprintf(out, " (%.1f%% hit)", 100.0 * memo->hits / total);
+    }
+    fprintf(out, ", %d/%d entries\n", memo->count, memo->maxsize);
+  }
+}
@@ -0,0 +1,19 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stdio.h>
+
+#include "type.h"
+
+extern PyTypeObject py_type_memo;
+
+PyObject *py_memo_new(PyObject *func, int maxsize);
+// 0 if an argument isn't something we can hash - the call isn't cached
+int py_memo_key(MemoKey *key, PyObject *const *args, int nargs);
+PyObject *py_memo_lookup(PyMemoObject *memo, const MemoKey *key); // NULL on a miss
+int py_memo_contains(PyMemoObject *memo, const MemoKey *key); // doesn't count or reorder
+const char *py_memo_name(PyMemoObject *memo); // the wrapped function's
+void py_memo_insert(PyMemoObject *memo, const MemoKey *key, PyObject *value);
+void py_memo_report(FILE *out); // hits and misses for every wrapper
+
+#endif
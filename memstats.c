@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memstats.h"
+#include "code.h"
+
+// NOTE: kinds are few, so they're a flat table searched by name (pointer
+// first - it's nearly always the same literal). sites go in an
+// open-addressing table keyed on (code, offset), like the profiler's stacks.
+// anything allocated with no code running - builtins, compile-time
+// constants - is put down to a NULL code
+#define MEMSTATS_MAX_KINDS 64
+#define MEMSTATS_TABLE_SIZE (1 << 14) // distinct sites, power of two
+#define MEMSTATS_NAME_WIDTH 32
+
+typedef struct {
+  const char *name;
+  long objects; // made, less freed
+  long long bytes; // live
+  long allocated; // objects ever made
+  long long allocated_bytes;
+} KindStats;
+
+typedef struct {
+  PyCodeObject *code;
+  int offset;
+  long objects; // 0 means the slot is free
+  long long bytes;
+} SiteStats;
+
+int memstats_enabled = 0;
+
+static int top_count = 0;
+static PyState *watched_state = NULL;
+static KindStats kinds[MEMSTATS_MAX_KINDS];
+static int num_kinds = 0;
+static KindStats other_kinds = { "(others)" }; // once the kind table is full
+static SiteStats *site_table = NULL;
+static int num_sites = 0;
+static SiteStats other_sites = { NULL, -1 }; // once the site table is 3/4 full
+static long long live_bytes = 0;
+static long long peak_bytes = 0;
+
+static KindStats *find_kind(const char *name) {
+  for (int i=0; i<num_kinds; i++) {
+    if (kinds[i].name == name || strcmp(kinds[i].name, name) == 0) {
+      return &kinds[i];
+    }
+  }
+  if (num_kinds == MEMSTATS_MAX_KINDS) {
+    return &other_kinds;
+  }
+  kinds[num_kinds].name = name;
+  return &kinds[num_kinds++];
+}
+
+static SiteStats *find_site(PyCodeObject *code, int offset) {
+  unsigned int hash = 2166136261u;
+  hash = (hash ^ (unsigned int) (size_t) code) * 16777619u;
+  hash = (hash ^ (unsigned int) offset) * 16777619u;
+  unsigned int slot = hash & (MEMSTATS_TABLE_SIZE - 1);
+  while (site_table[slot].objects != 0 || site_table[slot].bytes != 0) {
+    if (site_table[slot].code == code && site_table[slot].offset == offset) {
+      return &site_table[slot];
+    }
+    slot = (slot + 1) & (MEMSTATS_TABLE_SIZE - 1);
+  }
+  if (num_sites >= MEMSTATS_TABLE_SIZE / 4 * 3) {
+    return &other_sites;
+  }
+  site_table[slot].code = code;
+  site_table[slot].offset = offset;
+  num_sites++;
+  return &site_table[slot];
+}
+
+void memstats_record(const char *kind, int objects, long long bytes) {
+  KindStats *k = find_kind(kind);
+  k->objects += objects;
+  k->bytes += bytes;
+  if (objects > 0) {
+    k->allocated += objects;
+  }
+  if (bytes > 0) {
+    k->allocated_bytes += bytes;
+  }
+  live_bytes += bytes;
+  if (live_bytes > peak_bytes) {
+    peak_bytes = live_bytes;
+  }
+  // sites are where memory was asked for - frees aren't put down to one
+  if (objects <= 0 && bytes <= 0) {
+    return;
+  }
+  PyCodeObject *code = NULL;
+  int offset = 0;
+  if (watched_state != NULL && watched_state->current_frame != NULL) {
+    code = watched_state->current_frame->code;
+    offset = watched_state->current_frame->bytecode_offset;
+  }
+  SiteStats *site = find_site(code, offset);
+  site->objects += objects > 0 ? objects : 0;
+  site->bytes += bytes > 0 ? bytes : 0;
+}
+
+static int compare_kinds(const void *a, const void *b) {
+  long long diff = ((const KindStats *) b)->allocated_bytes - ((const KindStats *) a)->allocated_bytes;
+  return (diff > 0) - (diff < 0);
+}
+
+static int compare_sites(const void *a, const void *b) {
+  long long diff = ((const SiteStats *) b)->bytes - ((const SiteStats *) a)->bytes;
+  return (diff > 0) - (diff < 0);
+}
+
+static double percent(long long part, long long total) {
+  return total > 0 ? 100.0 * part / total : 0.0;
+}
+
+static void memstats_report(void) {
+  FILE *out = stderr;
+  long allocated = other_kinds.allocated, retained = other_kinds.objects;
+  long long allocated_bytes = other_kinds.allocated_bytes;
+  for (int i=0; i<num_kinds; i++) {
+    allocated += kinds[i].allocated;
+    retained += kinds[i].objects;
+    allocated_bytes += kinds[i].allocated_bytes;
+  }
+  fprintf(out, "\nmemstats: %ld objects, %lld bytes allocated - %lld bytes live, peak %lld\n",
+          allocated, allocated_bytes, live_bytes, peak_bytes);
+
+  // kinds, most bytes allocated first
+  qsort(kinds, num_kinds, sizeof(KindStats), compare_kinds);
+  fprintf(out, "  %-*s %12s %14s %7s %14s\n", MEMSTATS_NAME_WIDTH, "kind", "objects", "bytes", "%", "live bytes");
+  for (int i=0; i<num_kinds && i<top_count; i++) {
+    fprintf(out, "  %-*s %12ld %14lld %6.2f%% %14lld\n", MEMSTATS_NAME_WIDTH, kinds[i].name,
+            kinds[i].allocated, kinds[i].allocated_bytes,
+            percent(kinds[i].allocated_bytes, allocated_bytes), kinds[i].bytes);
+  }
+  if (other_kinds.allocated > 0 || other_kinds.allocated_bytes > 0) {
+    fprintf(out, "  %-*s %12ld %14lld\n", MEMSTATS_NAME_WIDTH, other_kinds.name,
+            other_kinds.allocated, other_kinds.allocated_bytes);
+  }
+
+  // sites - compacted to the front of the table, then sorted
+  fprintf(out, "\ntop allocation sites:\n");
+  int n = 0;
+  for (int slot=0; slot<MEMSTATS_TABLE_SIZE; slot++) {
+    if (site_table[slot].objects != 0 || site_table[slot].bytes != 0) {
+      site_table[n++] = site_table[slot];
+    }
+  }
+  qsort(site_table, n, sizeof(SiteStats), compare_sites);
+  fprintf(out, "  %-*s %12s %14s %7s\n", MEMSTATS_NAME_WIDTH, "site", "objects", "bytes", "%");
+  for (int i=0; i<n && i<top_count; i++) {
+    SiteStats *site = &site_table[i];
+    char name[MEMSTATS_NAME_WIDTH + 1];
+    if (site->code == NULL) {
+      snprintf(name, sizeof(name), "(no code running)");
+    } else {
+      snprintf(name, sizeof(name), "%s:%d @%d", site->code->name,
+               py_code_line(site->code, site->offset), site->offset);
+    }
+    fprintf(out, "  %-*s %12ld %14lld %6.2f%%\n", MEMSTATS_NAME_WIDTH, name,
+            site->objects, site->bytes, percent(site->bytes, allocated_bytes));
+  }
+  if (other_sites.objects > 0 || other_sites.bytes > 0) {
+    fprintf(out, "  %-*s %12ld %14lld\n", MEMSTATS_NAME_WIDTH, "(others)",
+            other_sites.objects, other_sites.bytes);
+  }
+  // NOTE: nothing frees objects yet, so this is every object made - reachable
+  // or not. it's what the process is holding on to, not a count of leaks
+  fprintf(out, "\nretained at exit: %ld objects (nothing is freed yet, so that's every allocation)\n", retained);
+}
+
+void memstats_enable(int top) {
+  // NOTE: untouched pages of this are never faulted in
+  site_table = calloc(MEMSTATS_TABLE_SIZE, sizeof(SiteStats));
+  if (site_table == NULL) {
+    printf("MemoryError\n");
+    exit(1);
+  }
+  memstats_enabled = 1;
+  top_count = top;
+  atexit(memstats_report);
+}
+
+void memstats_watch(PyState *state) {
+  watched_state = state;
+}
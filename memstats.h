@@ -0,0 +1,18 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include "frame.h"
+
+// NOTE: --memstats counters. objects are counted as py_type_alloc_var() and
+// py_frame_new() make them, and the buffers they own (a list's items, a
+// dict's table) as py_type_realloc_data() grows and frees them - each by
+// kind (the type's name, or "frame"), and by the code and bytecode offset
+// that was running at the time. nothing here is called unless the mode is on
+extern int memstats_enabled;
+
+void memstats_enable(int top); // report the `top` kinds and sites to stderr at exit
+void memstats_watch(PyState *state); // put allocations from now on down to its frame
+// `objects` and `bytes` are negative for what's freed
+void memstats_record(const char *kind, int objects, long long bytes);
+
+#endif
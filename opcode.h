@@ -0,0 +1,80 @@
+#ifndef OPCODE_H
+#define OPCODE_H
+
+// NOTE: define opcodes
+typedef enum {
+  OP_UNKNOWN = -1,
+  OP_LOAD_CONST,
+  OP_STORE_NAME,
+  OP_LOAD_NAME,
+  OP_BINARY_OP,
+  OP_MAKE_FUNCTION,
+  OP_CALL_FUNCTION, // called with int argn, number of args to pop from stack
+  OP_TAIL_CALL, // CALL_FUNCTION directly before a RETURN - see --tail-calls
+  OP_RETURN,
+  OP_POP_TOP,
+  OP_COMPARE,
+  OP_JUMP, // arg: target offset
+  OP_POP_JUMP_IF_FALSE, // arg: target offset
+  OP_COMPARE_AND_JUMP, // args: comparison, target offset - jumps if it's false
+  OP_JUMP_BACKWARD, // arg: target offset - every loop's back edge goes through here
+  OP_GET_RANGE, // arg: number of range() args to pop, pushes an iterator
+  OP_FOR_RANGE, // args: exit offset, whether to push the boxed loop variable
+  OP_INLINE_GUARD, // args: inlined code const, offset of the ordinary call to jump to
+  OP_YIELD_VALUE, // hands the top of the stack to whoever resumed the generator
+  OP_RESUME, // arg: exit offset - pushes the next value of the iterator on top of the stack
+  OP_CALL_METHOD, // args: method slot (-1 if there is none), number of args, method name - [receiver, *args] -> result
+  OP_BUILD_MAP, // arg: number of MAP_ADDs to follow - pushes an empty dict with room for them
+  OP_MAP_ADD, // [dict, key, value] -> [dict]
+  OP_BUILD_LIST, // arg: number of LIST_APPENDs to follow - pushes an empty list with room for them
+  OP_LIST_APPEND, // [list, item] -> [list]
+  OP_BINARY_SUBSCR, // [container, index] -> container[index]
+  OP_STORE_SUBSCR, // [value, container, index] -> []
+  OP_DELETE_SUBSCR, // [container, index] -> []
+  OP_GET_ITER, // replaces the top of the stack with an iterator over it, for RESUME
+  OP_STORE_TEMP, // arg: the frame's temp slot - an inlined call's argument, see parser.c
+  OP_LOAD_TEMP, // arg: the frame's temp slot
+  // specialised BINARY_OPs, only ever written by quicken.c at runtime
+  OP_BINARY_ADD_INT,
+  OP_BINARY_ADD_BYTES,
+  OP_BINARY_MULT_BYTES_INT,
+  NUM_OPCODES
+} OpCode;
+
+static const char *opcode_table[NUM_OPCODES] = {
+  "LOAD_CONST",
+  "STORE_NAME",
+  "LOAD_NAME",
+  "BINARY_OP",
+  "MAKE_FUNCTION",
+  "CALL_FUNCTION",
+  "TAIL_CALL",
+  "RETURN",
+  "POP_TOP",
+  "COMPARE",
+  "JUMP",
+  "POP_JUMP_IF_FALSE",
+  "COMPARE_AND_JUMP",
+  "JUMP_BACKWARD",
+  "GET_RANGE",
+  "FOR_RANGE",
+  "INLINE_GUARD",
+  "YIELD_VALUE",
+  "RESUME",
+  "CALL_METHOD",
+  "BUILD_MAP",
+  "MAP_ADD",
+  "BUILD_LIST",
+  "LIST_APPEND",
+  "BINARY_SUBSCR",
+  "STORE_SUBSCR",
+  "DELETE_SUBSCR",
+  "GET_ITER",
+  "STORE_TEMP",
+  "LOAD_TEMP",
+  "BINARY_ADD_INT",
+  "BINARY_ADD_BYTES",
+  "BINARY_MULT_BYTES_INT"
+};
+
+#endif
@@ -5,12 +5,13 @@
 #include <stdarg.h>
 
 #include "parser.h"
-#include "string.h"
+#include "writer.h"
 #include "int.h"
 #include "bytes.h"
 #include "code.h"
-
-const int MAX_ARGS = 5;
+#include "type.h"
+#include "stats.h"
+#include "error.h"
 
 void token_array_init(TokenArray *a) {
   const int INITIAL_SIZE = 8;
@@ -36,44 +37,47 @@ TokenArray tokenize(const char *source) {
   TokenArray tokens;
   token_array_init(&tokens); 
 
-  char buf[64]; // buffer for lexeme
-  int b_idx = 0; // buffer idx
-
   int i = 0; // character index
   int c; // character being scanned 
   int level = 0; // indentation level
+  int line = 1; // source line
   while ((c = source[i]) != '\0') {
     Token token; // to be added
+    token.line = line;
     if (isdigit(c)) {
-      // start accumulating
+      // NOTE: int literals can be arbitrarily long, so copy straight
+      // from source rather than through the fixed lexeme buffer
+      int start = i;
       while (isdigit(c) || c == '_') {
-        if (c != '_') {
-          buf[b_idx++] = c;
-        }
         c = source[++i]; 
       }
-      buf[b_idx++] = '\0';
-      // when done, emit T_INT and clear buffer
+      // when done, emit T_INT (minus any '_' separators)
       token.type = T_INT;
-      token.lexeme = malloc(b_idx);
-      strcpy(token.lexeme, buf);
+      token.lexeme = malloc(i - start + 1);
+      int l_idx = 0;
+      for (int k=start; k<i; k++) {
+        if (source[k] != '_') {
+          token.lexeme[l_idx++] = source[k];
+        }
+      }
+      token.lexeme[l_idx] = '\0';
       token_array_push(&tokens, token);
-      // reset buffer
-      b_idx = 0;
     } else if (isalpha(c) || c == '_') {
       // start accumulating name
+      int start = i;
       while (isalnum(c) || c == '_') {
-        buf[b_idx++] = c;
         c = source[++i];
       }
-      buf[b_idx++] = '\0';
+      char *name = malloc(i - start + 1);
+      memcpy(name, source + start, i - start);
+      name[i - start] = '\0';
 
       // check keywords
       int is_keyword = 0;
       Keyword keyword;
-      for (int j = 0; j < num_keywords; j++) {
+      for (int j = 0; j < NUM_KEYWORDS; j++) {
         keyword = keywords[j];
-        if (strncmp(buf, keyword.kw, keyword.length) == 0) {
+        if (strcmp(name, keyword.kw) == 0) {
           token.type = keyword.type;
           token.lexeme = NULL;
           token_array_push(&tokens, token);
@@ -85,26 +89,24 @@ TokenArray tokenize(const char *source) {
       if (is_keyword == 0) {
         // else emit name with lexeme
         token.type = T_NAME;
-        token.lexeme = malloc(b_idx);
-        strcpy(token.lexeme, buf);
+        token.lexeme = name;
         token_array_push(&tokens, token);
+      } else {
+        free(name);
       }
-
-      // reset buffer
-      b_idx = 0;
     } else if (c == '"') {
-      c = source[++i];
-      // start accumulating string
-      while ((c = source[i++]) != '"') {
-        buf[b_idx++] = c;
+      // copy the string straight from source, it can be any length
+      int start = ++i;
+      while (source[i] != '"') {
+        i++;
       }
-      buf[b_idx++] = '\0';
       // emit token
       token.type = T_STRING;  
-      token.lexeme = malloc(b_idx);
-      strcpy(token.lexeme, buf);
+      token.lexeme = malloc(i - start + 1);
+      memcpy(token.lexeme, source + start, i - start);
+      token.lexeme[i - start] = '\0';
       token_array_push(&tokens, token); 
-      b_idx = 0;
+      i++; // closing quote
     } else if (c == ' ') {
       i++;
     } else if (c == '+') { // operators
@@ -123,7 +125,19 @@ TokenArray tokenize(const char *source) {
       token_array_push(&tokens, token);
       i++;
     } else if (c == '/') {
-      token.type = T_DIVIDE;
+      if (source[i+1] == '/') {
+        token.type = T_FLOORDIV;
+        token.lexeme = NULL;
+        token_array_push(&tokens, token);
+        i += 2;
+      } else {
+        token.type = T_DIVIDE;
+        token.lexeme = NULL;
+        token_array_push(&tokens, token);
+        i += 1;
+      }
+    } else if (c == '%') {
+      token.type = T_MODULO;
       token.lexeme = NULL;
       token_array_push(&tokens, token);
       i++;
@@ -173,6 +187,26 @@ TokenArray tokenize(const char *source) {
       token.lexeme = NULL;
       token_array_push(&tokens, token);
       i++;
+    } else if (c == '{') {
+      token.type = T_LBRACE;
+      token.lexeme = NULL;
+      token_array_push(&tokens, token);
+      i++;
+    } else if (c == '}') {
+      token.type = T_RBRACE;
+      token.lexeme = NULL;
+      token_array_push(&tokens, token);
+      i++;
+    } else if (c == '[') {
+      token.type = T_LBRACKET;
+      token.lexeme = NULL;
+      token_array_push(&tokens, token);
+      i++;
+    } else if (c == ']') {
+      token.type = T_RBRACKET;
+      token.lexeme = NULL;
+      token_array_push(&tokens, token);
+      i++;
     } else if (c == ',') {
       token.type = T_COMMA;
       token.lexeme = NULL;
@@ -183,11 +217,18 @@ TokenArray tokenize(const char *source) {
       token.lexeme = NULL;
       token_array_push(&tokens, token);
       i++;
+    } else if (c == '.') {
+      token.type = T_DOT;
+      token.lexeme = NULL;
+      token_array_push(&tokens, token);
+      i++;
     } else if (c == '\n') {
       token.type = T_NEWLINE;
       token.lexeme = NULL;
       token_array_push(&tokens, token);
       i++;
+      line++;
+      token.line = line;
       // count leading spaces + check indentation
       int num_leading_spaces = 0;
       int gap_size; // between num_leading_spaces and level*4
@@ -209,18 +250,17 @@ TokenArray tokenize(const char *source) {
           level--;
         } 
       } else {
-        printf("IndentationError\n");
-        exit(1);
+        py_error("IndentationError");
       }
     } else {
-      printf("error: we do not handle non-integers yet!\n");
-      exit(1);
+      py_error("error: we do not handle non-integers yet!");
     }
   }
 
   Token final_token;
   final_token.type = T_EOF;
   final_token.lexeme = NULL;
+  final_token.line = line;
   token_array_push(&tokens, final_token);
   return tokens;
 }
@@ -229,9 +269,7 @@ static const char *SYNTAX_ERROR_MESSAGE = "SyntaxError: invalid syntax";
 
 void assert_token_type_equals(TokenType a, TokenType b, const char *error) {
   if (a != b) {
-    printf("%s", SYNTAX_ERROR_MESSAGE);
-    printf(" - expected %s, saw %s\n", token_table[b], token_table[a]);
-    exit(1);
+    py_error("%s - expected %s, saw %s", SYNTAX_ERROR_MESSAGE, token_table[b], token_table[a]);
   }
 }
 
@@ -246,9 +284,7 @@ void expect_in(TokenType r, TokenType group[], int group_length) {
     }
   }
 
-  printf("%s", SYNTAX_ERROR_MESSAGE);
-  printf(" - expected group %s, saw %s\n", token_table[group[0]], token_table[r]);
-  exit(1);
+  py_error("%s - expected group %s, saw %s", SYNTAX_ERROR_MESSAGE, token_table[group[0]], token_table[r]);
 }
 
 typedef struct {
@@ -257,19 +293,151 @@ typedef struct {
   int    node_count;
 } ParseResult;
 
+// the arguments of a call, from just after its `(` to just after its `)`.
+// returns how many there were
+static int parse_call_args(const Token *tokens, int *t_idx, Node **args) {
+  int arg_idx = 0;
+  int size = 4;
+  *args = malloc(size * sizeof(Node));
+  if (tokens[*t_idx].type == T_RPAREN) {
+    // no arguments
+    (*t_idx)++;
+    return 0;
+  }
+  while (tokens[*t_idx].type != T_RPAREN) {
+    // TODO: perhaps return Node, not Node* ???
+    Node *arg_node = parse_expression(tokens, t_idx);
+    if (arg_idx == size) {
+      size *= 2;
+      *args = realloc(*args, size * sizeof(Node));
+    }
+    (*args)[arg_idx] = *arg_node;
+    arg_idx++;
+    if (tokens[*t_idx].type == T_COMMA) {
+      (*t_idx)++;
+    } else if (tokens[*t_idx].type == T_RPAREN) {
+      (*t_idx)++;
+      break;
+    } else {
+      py_error("%s\nbad func", SYNTAX_ERROR_MESSAGE);
+    }
+  }
+  return arg_idx;
+}
+
+// `.method(`
+static int is_method_suffix(const Token *tokens, int t_idx) {
+  return tokens[t_idx].type == T_DOT
+    && tokens[t_idx+1].type == T_NAME
+    && tokens[t_idx+2].type == T_LPAREN;
+}
+
+// `name.method(` or `"string".method(`
+static int is_method_call(const Token *tokens, int t_idx) {
+  return (tokens[t_idx].type == T_NAME || tokens[t_idx].type == T_STRING)
+    && is_method_suffix(tokens, t_idx+1);
+}
+
+// `receiver.method(args)`, from the `.` to just after the `)`
+static Node *parse_method_call(Node *receiver, const Token *tokens, int *t_idx) {
+  CallMethod *call = malloc(sizeof(CallMethod));
+  call->receiver = receiver;
+  call->method = tokens[*t_idx+1].lexeme;
+  *t_idx += 3;
+  call->argc = parse_call_args(tokens, t_idx, &call->args);
+  Node *call_node = malloc(sizeof(Node));
+  call_node->type = CALLMETHOD;
+  call_node->data.call_method = call;
+  return call_node;
+}
+
+// a dict literal, from just after its `{` to just after its `}`
+static Node *parse_dict(const Token *tokens, int *t_idx) {
+  Dict *dict = malloc(sizeof(Dict));
+  int size = 4;
+  dict->keys = malloc(size * sizeof(Node));
+  dict->values = malloc(size * sizeof(Node));
+  dict->count = 0;
+  while (tokens[*t_idx].type != T_RBRACE) {
+    if (dict->count == size) {
+      size *= 2;
+      dict->keys = realloc(dict->keys, size * sizeof(Node));
+      dict->values = realloc(dict->values, size * sizeof(Node));
+    }
+    dict->keys[dict->count] = *parse_expression(tokens, t_idx);
+    expect(tokens[(*t_idx)++].type, T_COLON);
+    dict->values[dict->count] = *parse_expression(tokens, t_idx);
+    dict->count++;
+    if (tokens[*t_idx].type == T_COMMA) {
+      (*t_idx)++;
+    } else {
+      expect(tokens[*t_idx].type, T_RBRACE);
+    }
+  }
+  (*t_idx)++;
+  Node *dict_node = malloc(sizeof(Node));
+  dict_node->type = DICT;
+  dict_node->data.dict = dict;
+  return dict_node;
+}
+
+// a list literal, from just after its `[` to just after its `]`
+static Node *parse_list(const Token *tokens, int *t_idx) {
+  List *list = malloc(sizeof(List));
+  int size = 4;
+  list->elts = malloc(size * sizeof(Node));
+  list->count = 0;
+  while (tokens[*t_idx].type != T_RBRACKET) {
+    if (list->count == size) {
+      size *= 2;
+      list->elts = realloc(list->elts, size * sizeof(Node));
+    }
+    list->elts[list->count++] = *parse_expression(tokens, t_idx);
+    if (tokens[*t_idx].type == T_COMMA) {
+      (*t_idx)++;
+    } else {
+      expect(tokens[*t_idx].type, T_RBRACKET);
+    }
+  }
+  (*t_idx)++;
+  Node *list_node = malloc(sizeof(Node));
+  list_node->type = LIST;
+  list_node->data.list = list;
+  return list_node;
+}
+
+// `value[index]`, from just after the `[` to just after the `]`
+static Node *parse_subscript(Node *value, const Token *tokens, int *t_idx) {
+  Subscript *subscript = malloc(sizeof(Subscript));
+  subscript->value = value;
+  subscript->index = parse_expression(tokens, t_idx);
+  expect(tokens[(*t_idx)++].type, T_RBRACKET);
+  Node *subscript_node = malloc(sizeof(Node));
+  subscript_node->type = SUBSCRIPT;
+  subscript_node->data.subscript = subscript;
+  return subscript_node;
+}
+
+static int ends_expression(TokenType type) {
+  return type == T_EOF || type == T_COMMA || type == T_RPAREN || type == T_RBRACE
+    || type == T_RBRACKET || type == T_COLON || type == T_NEWLINE || type == T_ASSIGN;
+}
+
 ParseResult handle_functions(const Token *tokens, int *t_idx) {
 
   int length = 0;
   while (tokens[length].type != T_EOF) length++;
 
   Token *out_tokens = malloc((length + 1) * sizeof(Token));
-  Node  *out_nodes  = malloc(10 * sizeof(Node));
+  Node  *out_nodes  = malloc((length + 1) * sizeof(Node)); // at most one per token
 
   int out_t_idx = 0;
   int out_n_idx = 0;
 
-  // TODO: think about terminate condition
-  while (tokens[*t_idx].type != T_EOF && tokens[*t_idx].type != T_COMMA && tokens[*t_idx].type != T_RPAREN && tokens[*t_idx].type != T_COLON && tokens[*t_idx].type != T_NEWLINE) {
+  // NOTE: `=` ends one too - `d[k] = v` is parsed as an expression first,
+  // see parse()
+  while (!ends_expression(tokens[*t_idx].type)) {
+    Node *call_node;
     if (tokens[*t_idx].type == T_NAME && tokens[*t_idx+1].type == T_LPAREN) {
       // allocate func name
       Name *n = malloc(sizeof(Name));
@@ -280,47 +448,73 @@ ParseResult handle_functions(const Token *tokens, int *t_idx) {
 
       // move fwd + allocate args
       *t_idx += 2;
-      int arg_idx = 0;
-      call->args = malloc((MAX_ARGS + 1) * sizeof(Node));
-      while (tokens[*t_idx].type != T_RPAREN) {
-        // TODO: perhaps return Node, not Node* ???
-        Node *arg_node = parse_expression(tokens, t_idx);
-        call->args[arg_idx] = *arg_node;
-        arg_idx++;
-        if (tokens[*t_idx].type == T_COMMA) {
-          (*t_idx)++;
-        } else if (tokens[*t_idx].type == T_RPAREN) {
-          (*t_idx)++;
-          break;
-        } else {
-          printf("%s", SYNTAX_ERROR_MESSAGE);
-          printf("\nbad func\n");
-          exit(1);
-        }
-      }
-      call->argc = arg_idx;
-      Node *call_node = malloc(sizeof(Node));
+      call->argc = parse_call_args(tokens, t_idx, &call->args);
+      call_node = malloc(sizeof(Node));
       call_node->type = CALLFUNCTION;
       call_node->data.call_function = call;
-
-      // now we've allocated the function call node
-      // => insert into node array and emit T_NODE
-      out_nodes[out_n_idx] = *call_node;
-
-      // build new T_NODE token
-      Token new_token;
-      new_token.type = T_NODE;
-      new_token.lexeme = malloc(12);
-      sprintf(new_token.lexeme, "%d", out_n_idx++);
-      // printf("new token lexeme: %s\n", new_token.lexeme);
-      // printf("references node of type %s", node_type_table[nodes[n_idx-1].type]);
-
-      // emit it
-      out_tokens[out_t_idx++] = new_token;
+    } else if (is_method_call(tokens, *t_idx)) {
+      Node *receiver = malloc(sizeof(Node));
+      if (tokens[*t_idx].type == T_NAME) {
+        Name *n = malloc(sizeof(Name));
+        n->id = tokens[*t_idx].lexeme;
+        receiver->type = NAME;
+        receiver->data.name = n;
+      } else {
+        Constant *c = malloc(sizeof(Constant));
+        c->value = py_bytes_from_string(tokens[*t_idx].lexeme, strlen(tokens[*t_idx].lexeme));
+        receiver->type = CONSTANT;
+        receiver->data.constant = c;
+      }
+      (*t_idx)++;
+      call_node = parse_method_call(receiver, tokens, t_idx);
+    } else if (tokens[*t_idx].type == T_LBRACE) {
+      (*t_idx)++;
+      call_node = parse_dict(tokens, t_idx);
+    } else if (tokens[*t_idx].type == T_LBRACKET) {
+      // NOTE: a `[` after an operand is a subscript, and never gets here
+      (*t_idx)++;
+      call_node = parse_list(tokens, t_idx);
+    } else if (tokens[*t_idx].type == T_NAME && tokens[*t_idx+1].type == T_LBRACKET) {
+      Name *n = malloc(sizeof(Name));
+      n->id = tokens[(*t_idx)++].lexeme;
+      call_node = malloc(sizeof(Node));
+      call_node->type = NAME;
+      call_node->data.name = n;
+    } else if (tokens[*t_idx].type == T_STRING && tokens[*t_idx+1].type == T_LBRACKET) {
+      Constant *c = malloc(sizeof(Constant));
+      c->value = py_bytes_from_string(tokens[*t_idx].lexeme, strlen(tokens[*t_idx].lexeme));
+      (*t_idx)++;
+      call_node = malloc(sizeof(Node));
+      call_node->type = CONSTANT;
+      call_node->data.constant = c;
     } else {
       // otherwise just emit the same token
       out_tokens[out_t_idx++] = tokens[(*t_idx)++];
+      continue;
     }
+    // and any subscripts or method calls on it e.g. `d["a"]["b"]` or
+    // `d["a"].append(x)`
+    while (tokens[*t_idx].type == T_LBRACKET || is_method_suffix(tokens, *t_idx)) {
+      if (tokens[*t_idx].type == T_LBRACKET) {
+        (*t_idx)++;
+        call_node = parse_subscript(call_node, tokens, t_idx);
+      } else {
+        call_node = parse_method_call(call_node, tokens, t_idx);
+      }
+    }
+
+    // now we've allocated the call node
+    // => insert into node array and emit T_NODE
+    out_nodes[out_n_idx] = *call_node;
+
+    // build new T_NODE token
+    Token new_token;
+    new_token.type = T_NODE;
+    new_token.lexeme = malloc(12);
+    sprintf(new_token.lexeme, "%d", out_n_idx++);
+
+    // emit it
+    out_tokens[out_t_idx++] = new_token;
   }
   out_tokens[out_t_idx].type = T_EOF;
 
@@ -341,7 +535,7 @@ ParseResult handle_multiply_divide(
   while (tokens[length].type != T_EOF) length++;
 
   Token *out_tokens = malloc((length + 1) * sizeof(Token));
-  Node  *out_nodes  = malloc(10 * sizeof(Node));
+  Node  *out_nodes  = malloc((length + 1) * sizeof(Node)); // at most one per token
 
   int t_idx = 0;
   int out_t_idx = 0;
@@ -371,9 +565,7 @@ ParseResult handle_multiply_divide(
       left = malloc(sizeof(Node));
       if (tokens[t_idx].type == T_INT) {
         // -- allocate PyIntObject --
-        PyIntObject *v = malloc(sizeof(PyIntObject));
-        v->base.type = &py_type_int;
-        v->value = atoi(tokens[t_idx].lexeme);
+        PyObject *v = py_int_from_string(tokens[t_idx].lexeme);
         // --------------------------
         Constant *c = malloc(sizeof(Constant));
         c->value = (PyObject *) v;
@@ -381,10 +573,7 @@ ParseResult handle_multiply_divide(
         left->data.constant = c;
       } else if (tokens[t_idx].type == T_STRING) {
         // -- allocate PyBytesObject --
-        PyBytesObject *v = malloc(sizeof(PyBytesObject));
-        v->base.type = &py_type_bytes;
-        v->size = strlen(tokens[t_idx].lexeme);
-        v->data = strdup(tokens[t_idx].lexeme);
+        PyObject *v = py_bytes_from_string(tokens[t_idx].lexeme, strlen(tokens[t_idx].lexeme));
         // ----------------------------
         Constant *c = malloc(sizeof(Constant));
         c->value = (PyObject *) v;
@@ -400,10 +589,25 @@ ParseResult handle_multiply_divide(
 
     /* ---- fold * / chain ---- */
     while (tokens[t_idx + 1].type == T_MULTIPLY ||
-           tokens[t_idx + 1].type == T_DIVIDE) {
+           tokens[t_idx + 1].type == T_DIVIDE ||
+           tokens[t_idx + 1].type == T_FLOORDIV ||
+           tokens[t_idx + 1].type == T_MODULO) {
 
       BinaryOp *bin = malloc(sizeof(BinaryOp));
-      bin->op = (tokens[t_idx + 1].type == T_MULTIPLY) ? MULT : DIV;
+      switch (tokens[t_idx + 1].type) {
+        case T_MULTIPLY:
+          bin->op = MULT;
+          break;
+        case T_DIVIDE:
+          bin->op = DIV;
+          break;
+        case T_FLOORDIV:
+          bin->op = FLOORDIV;
+          break;
+        default:
+          bin->op = MOD;
+          break;
+      }
 
       t_idx += 2;
 
@@ -416,9 +620,7 @@ ParseResult handle_multiply_divide(
 
         if (tokens[t_idx].type == T_INT) {
           // -- allocate PyIntObject --
-          PyIntObject *v = malloc(sizeof(PyIntObject));
-          v->base.type = &py_type_int;
-          v->value = atoi(tokens[t_idx].lexeme);
+          PyObject *v = py_int_from_string(tokens[t_idx].lexeme);
           // --------------------------
           Constant *c = malloc(sizeof(Constant));
           c->value = (PyObject *) v;
@@ -426,15 +628,12 @@ ParseResult handle_multiply_divide(
           right->data.constant = c;
         } else if (tokens[t_idx].type == T_STRING) {
           // -- allocate PyBytesObject --
-          PyBytesObject *v = malloc(sizeof(PyBytesObject));
-          v->base.type = &py_type_bytes;
-          v->size = strlen(tokens[t_idx].lexeme);
-          v->data = strdup(tokens[t_idx].lexeme);
+          PyObject *v = py_bytes_from_string(tokens[t_idx].lexeme, strlen(tokens[t_idx].lexeme));
           // ----------------------------
           Constant *c = malloc(sizeof(Constant));
           c->value = (PyObject *) v;
-          left->type = CONSTANT;
-          left->data.constant = c;
+          right->type = CONSTANT;
+          right->data.constant = c;
         } else {
           Name *n = malloc(sizeof(Name));
           n->id = tokens[t_idx].lexeme;
@@ -486,7 +685,7 @@ ParseResult handle_add_subtract(
   while (tokens[length].type != T_EOF) length++;
 
   Token *out_tokens = malloc((length + 1) * sizeof(Token));
-  Node  *out_nodes  = malloc(10 * sizeof(Node));
+  Node  *out_nodes  = malloc((length + 1) * sizeof(Node)); // at most one per token
 
   int t_idx = 0;
   int out_t_idx = 0;
@@ -516,9 +715,7 @@ ParseResult handle_add_subtract(
       left = malloc(sizeof(Node));
       if (tokens[t_idx].type == T_INT) {
         // -- allocate PyIntObject --
-        PyIntObject *v = malloc(sizeof(PyIntObject));
-        v->base.type = &py_type_int;
-        v->value = atoi(tokens[t_idx].lexeme);
+        PyObject *v = py_int_from_string(tokens[t_idx].lexeme);
         // --------------------------
         Constant *c = malloc(sizeof(Constant));
         c->value = (PyObject *) v;
@@ -526,10 +723,7 @@ ParseResult handle_add_subtract(
         left->data.constant = c;
       } else if (tokens[t_idx].type == T_STRING) {
         // -- allocate PyBytesObject --
-        PyBytesObject *v = malloc(sizeof(PyBytesObject));
-        v->base.type = &py_type_bytes;
-        v->size = strlen(tokens[t_idx].lexeme);
-        v->data = strdup(tokens[t_idx].lexeme);
+        PyObject *v = py_bytes_from_string(tokens[t_idx].lexeme, strlen(tokens[t_idx].lexeme));
         // ----------------------------
         Constant *c = malloc(sizeof(Constant));
         c->value = (PyObject *) v;
@@ -561,25 +755,20 @@ ParseResult handle_add_subtract(
 
         if (tokens[t_idx].type == T_INT) {
           // -- allocate PyIntObject --
-          PyIntObject *v = malloc(sizeof(PyIntObject));
-          v->base.type = &py_type_int;
-          v->value = atoi(tokens[t_idx].lexeme);
+          PyObject *v = py_int_from_string(tokens[t_idx].lexeme);
           // --------------------------
           Constant *c = malloc(sizeof(Constant));
           c->value = (PyObject *) v;
-          left->type = CONSTANT;
-          left->data.constant = c;
+          right->type = CONSTANT;
+          right->data.constant = c;
         } else if (tokens[t_idx].type == T_STRING) {
           // -- allocate PyBytesObject --
-          PyBytesObject *v = malloc(sizeof(PyBytesObject));
-          v->base.type = &py_type_bytes;
-          v->size = strlen(tokens[t_idx].lexeme);
-          v->data = strdup(tokens[t_idx].lexeme);
+          PyObject *v = py_bytes_from_string(tokens[t_idx].lexeme, strlen(tokens[t_idx].lexeme));
           // ----------------------------
           Constant *c = malloc(sizeof(Constant));
           c->value = (PyObject *) v;
-          left->type = CONSTANT;
-          left->data.constant = c;
+          right->type = CONSTANT;
+          right->data.constant = c;
         } else {
           Name *n = malloc(sizeof(Name));
           n->id = tokens[t_idx].lexeme;
@@ -631,7 +820,7 @@ ParseResult handle_comparator(
   while (tokens[length].type != T_EOF) length++;
 
   Token *out_tokens = malloc((length + 1) * sizeof(Token));
-  Node  *out_nodes  = malloc(10 * sizeof(Node));
+  Node  *out_nodes  = malloc((length + 1) * sizeof(Node)); // at most one per token
 
   int t_idx = 0;
   int out_t_idx = 0;
@@ -657,9 +846,7 @@ ParseResult handle_comparator(
       left = malloc(sizeof(Node));
       if (tokens[t_idx].type == T_INT) {
         // -- allocate PyIntObject --
-        PyIntObject *v = malloc(sizeof(PyIntObject));
-        v->base.type = &py_type_int;
-        v->value = atoi(tokens[t_idx].lexeme);
+        PyObject *v = py_int_from_string(tokens[t_idx].lexeme);
         // --------------------------
         Constant *c = malloc(sizeof(Constant));
         c->value = (PyObject *) v;
@@ -667,10 +854,7 @@ ParseResult handle_comparator(
         left->data.constant = c;
       } else if (tokens[t_idx].type == T_STRING) {
         // -- allocate PyBytesObject --
-        PyBytesObject *v = malloc(sizeof(PyBytesObject));
-        v->base.type = &py_type_bytes;
-        v->size = strlen(tokens[t_idx].lexeme);
-        v->data = strdup(tokens[t_idx].lexeme);
+        PyObject *v = py_bytes_from_string(tokens[t_idx].lexeme, strlen(tokens[t_idx].lexeme));
         // ----------------------------
         Constant *c = malloc(sizeof(Constant));
         c->value = (PyObject *) v;
@@ -709,8 +893,7 @@ ParseResult handle_comparator(
           bin->op = GTE;
           break;
         default:
-          printf("error: non-comparison bin-op: %d\n", tokens[t_idx+1].type);
-          exit(1);
+          py_error("error: non-comparison bin-op: %d", tokens[t_idx+1].type);
           break;
       }
 
@@ -725,25 +908,20 @@ ParseResult handle_comparator(
 
         if (tokens[t_idx].type == T_INT) {
           // -- allocate PyIntObject --
-          PyIntObject *v = malloc(sizeof(PyIntObject));
-          v->base.type = &py_type_int;
-          v->value = atoi(tokens[t_idx].lexeme);
+          PyObject *v = py_int_from_string(tokens[t_idx].lexeme);
           // --------------------------
           Constant *c = malloc(sizeof(Constant));
           c->value = (PyObject *) v;
-          left->type = CONSTANT;
-          left->data.constant = c;
+          right->type = CONSTANT;
+          right->data.constant = c;
         } else if (tokens[t_idx].type == T_STRING) {
           // -- allocate PyBytesObject --
-          PyBytesObject *v = malloc(sizeof(PyBytesObject));
-          v->base.type = &py_type_bytes;
-          v->size = strlen(tokens[t_idx].lexeme);
-          v->data = strdup(tokens[t_idx].lexeme);
+          PyObject *v = py_bytes_from_string(tokens[t_idx].lexeme, strlen(tokens[t_idx].lexeme));
           // ----------------------------
           Constant *c = malloc(sizeof(Constant));
           c->value = (PyObject *) v;
-          left->type = CONSTANT;
-          left->data.constant = c;
+          right->type = CONSTANT;
+          right->data.constant = c;
         } else {
           Name *n = malloc(sizeof(Name));
           n->id = tokens[t_idx].lexeme;
@@ -795,34 +973,49 @@ Node *parse_expression(const Token *tokens, int *t_idx) {
   return &gl.nodes[0];
 }
 
+static int is_range_call(Node *node) {
+  return node->type == CALLFUNCTION && strcmp(node->data.call_function->func->id, "range") == 0;
+}
+
 Module *parse(const Token *tokens, int *t_idx) {
   Module *result = malloc(sizeof(Module));
   int n_idx = 0; // node index
+  int n_size = 8;
+  result->nodes = malloc(n_size * sizeof(Node *));
   while (tokens[*t_idx].type != T_EOF) {
+    // room for this statement plus the NULL terminator
+    if (n_idx + 1 >= n_size) {
+      n_size *= 2;
+      result->nodes = realloc(result->nodes, n_size * sizeof(Node *));
+    }
+    int start_n_idx = n_idx;
+    int line = tokens[*t_idx].line;
     if (tokens[*t_idx].type == T_DEF) {
       FunctionDef *f = malloc(sizeof(FunctionDef));
       // expect name and allocate it
       expect(tokens[++(*t_idx)].type, T_NAME);
-      f->name = malloc(10);
-      strcpy(f->name, tokens[*t_idx].lexeme);
+      f->name = tokens[*t_idx].lexeme;
       // expect (
       expect(tokens[++(*t_idx)].type, T_LPAREN); 
       // accumulate argnames
       expect(tokens[++(*t_idx)].type, T_NAME);
       // do first one
-      f->args = malloc((MAX_ARGS + 1) * sizeof(char *)); 
-      f->args[0] = malloc(10);
-      strcpy(f->args[0], tokens[*t_idx].lexeme);
+      int a_size = 4; // grows, with room for the NULL
+      f->args = malloc(a_size * sizeof(char *)); 
+      f->args[0] = tokens[*t_idx].lexeme;
       // do rest
       int a_idx = 1;
       while (tokens[++(*t_idx)].type == T_COMMA) {
         expect(tokens[++(*t_idx)].type, T_NAME);
-        f->args[a_idx] = malloc(10);
-        strcpy(f->args[a_idx], tokens[*t_idx].lexeme);
+        if (a_idx + 1 == a_size) {
+          a_size *= 2;
+          f->args = realloc(f->args, a_size * sizeof(char *));
+        }
+        f->args[a_idx] = tokens[*t_idx].lexeme;
         a_idx++;
       }
       // null-terminate arg array
-      f->args[a_idx] = NULL; // <----- BAD LINE
+      f->args[a_idx] = NULL;
       expect(tokens[(*t_idx)++].type, T_RPAREN);
       expect(tokens[(*t_idx)++].type, T_COLON);
       expect(tokens[(*t_idx)++].type, T_NEWLINE);
@@ -840,9 +1033,30 @@ Module *parse(const Token *tokens, int *t_idx) {
       ret_node->type = RETURN;
       ret_node->data.ret = r;
       result->nodes[n_idx++] = ret_node;
+    } else if (tokens[*t_idx].type == T_YIELD) {
+      Yield *y = malloc(sizeof(Yield));
+      (*t_idx)++;
+      y->value = parse_expression(tokens, t_idx);
+      Node *yield_node = malloc(sizeof(Node));
+      yield_node->type = YIELD;
+      yield_node->data.yield = y;
+      result->nodes[n_idx++] = yield_node;
+    } else if (tokens[*t_idx].type == T_DEL) {
+      (*t_idx)++;
+      Node *target = parse_expression(tokens, t_idx);
+      if (target->type != SUBSCRIPT) {
+        py_error("%s - can only delete a subscript", SYNTAX_ERROR_MESSAGE);
+      }
+      Delete *del = malloc(sizeof(Delete));
+      del->target = target->data.subscript;
+      Node *del_node = malloc(sizeof(Node));
+      del_node->type = DELETE;
+      del_node->data.del = del;
+      result->nodes[n_idx++] = del_node;
     } else if (tokens[*t_idx].type == T_IF) {
       (*t_idx)++;
       If *if_struct = malloc(sizeof(If));
+      if_struct->orelse = NULL;
       // parse test expr and check syntax
       if_struct->test = parse_expression(tokens, t_idx);
       expect(tokens[(*t_idx)++].type, T_COLON);
@@ -865,6 +1079,42 @@ Module *parse(const Token *tokens, int *t_idx) {
       if_node->type = IF;
       if_node->data.iff = if_struct;
       result->nodes[n_idx++] = if_node;
+    } else if (tokens[*t_idx].type == T_WHILE) {
+      (*t_idx)++;
+      While *while_loop = malloc(sizeof(While));
+      while_loop->test = parse_expression(tokens, t_idx);
+      expect(tokens[(*t_idx)++].type, T_COLON);
+      expect(tokens[(*t_idx)++].type, T_NEWLINE);
+      expect(tokens[(*t_idx)++].type, T_INDENT);
+      while_loop->body = parse(tokens, t_idx);
+      Node *while_node = malloc(sizeof(Node));
+      while_node->type = WHILE;
+      while_node->data.while_loop = while_loop;
+      result->nodes[n_idx++] = while_node;
+    } else if (tokens[*t_idx].type == T_FOR) {
+      For *for_loop = malloc(sizeof(For));
+      expect(tokens[++(*t_idx)].type, T_NAME);
+      Name *target = malloc(sizeof(Name));
+      target->id = tokens[*t_idx].lexeme;
+      for_loop->target = target;
+      expect(tokens[++(*t_idx)].type, T_IN);
+      (*t_idx)++;
+      for_loop->iter = parse_expression(tokens, t_idx);
+      // NOTE: anything but a call to range() goes through iter() - GET_ITER
+      // checks it's iterable when the loop runs
+      if (is_range_call(for_loop->iter)
+          && (for_loop->iter->data.call_function->argc < 1
+            || for_loop->iter->data.call_function->argc > 3)) {
+        py_error("%s - range() takes 1 to 3 arguments", SYNTAX_ERROR_MESSAGE);
+      }
+      expect(tokens[(*t_idx)++].type, T_COLON);
+      expect(tokens[(*t_idx)++].type, T_NEWLINE);
+      expect(tokens[(*t_idx)++].type, T_INDENT);
+      for_loop->body = parse(tokens, t_idx);
+      Node *for_node = malloc(sizeof(Node));
+      for_node->type = FOR;
+      for_node->data.for_loop = for_loop;
+      result->nodes[n_idx++] = for_node;
     } else if (tokens[*t_idx].type == T_NAME && tokens[*t_idx+1].type == T_ASSIGN) {
       // assignment
       Assign *ass = malloc(sizeof(Assign));
@@ -885,342 +1135,1164 @@ Module *parse(const Token *tokens, int *t_idx) {
       (*t_idx)++;
       break;
     } else {
-      result->nodes[n_idx++] = parse_expression(tokens, t_idx);
+      Node *value = parse_expression(tokens, t_idx);
+      if (tokens[*t_idx].type == T_ASSIGN) {
+        // subscript assignment - the target was parsed as an expression
+        if (value->type != SUBSCRIPT) {
+          py_error("%s - cannot assign to expression", SYNTAX_ERROR_MESSAGE);
+        }
+        (*t_idx)++;
+        SubscriptAssign *ass = malloc(sizeof(SubscriptAssign));
+        ass->target = value->data.subscript;
+        ass->value = parse_expression(tokens, t_idx);
+        Node *ass_node = malloc(sizeof(Node));
+        ass_node->type = SUBSCRIPTASSIGN;
+        ass_node->data.subscript_assign = ass;
+        result->nodes[n_idx++] = ass_node;
+      } else {
+        // expression statement - its value is thrown away
+        Expr *expr = malloc(sizeof(Expr));
+        expr->value = value;
+        Node *expr_node = malloc(sizeof(Node));
+        expr_node->type = EXPR;
+        expr_node->data.expr = expr;
+        result->nodes[n_idx++] = expr_node;
+      }
+    }
+    // tag the statement we just parsed with its first line
+    if (n_idx > start_n_idx) {
+      result->nodes[n_idx-1]->line = line;
     }
   }
   result->nodes[n_idx] = NULL;
   return result;
 }
 
-char *space(int n) {
-  char *buf = malloc(n+1);
-  for (int i=0; i<n; i++) {
-    buf[i] = ' ';
+// NOTE: the dumps stream straight into a Writer - nothing is built up in
+// memory, so a huge module costs time proportional to its size to print
+
+static void node_dump(Writer *w, Node *n, int indent);
+
+// `[` statements `]`, one per line at indent+2
+static void block_dump(Writer *w, Module *block, int indent) {
+  if (block->nodes[0] == NULL) {
+    writer_puts(w, "[]");
+    return;
+  }
+  writer_puts(w, "[\n");
+  for (int j=0; block->nodes[j] != NULL; j++) {
+    writer_spaces(w, indent+2);
+    node_dump(w, block->nodes[j], indent+2);
+    writer_puts(w, block->nodes[j+1] != NULL ? ",\n" : "\n");
   }
-  buf[n] = '\0';
-  return buf;
+  writer_spaces(w, indent);
+  writer_puts(w, "]");
 }
 
-String node_format(Node *n, int indent) {
-  String result;
-  string_init(&result);
-  if (n->type == CONSTANT) {
-    if (n->data.constant->value->type == &py_type_int) {
-      string_appendf(&result, "Constant(value=%d)", ((PyIntObject *) n->data.constant->value)->value);
-    } else if (n->data.constant->value->type == &py_type_bytes) {
-      string_appendf(&result, "Constant(value='%s')", ((PyBytesObject *) n->data.constant->value)->data);
-    } else {
-      printf("RuntimeError: can't format this type\n");
-      exit(1);
+// `Subscript(value=..., slice=...)`
+static void subscript_dump(Writer *w, Subscript *subscript, int indent) {
+  writer_puts(w, "Subscript(\n");
+  writer_spaces(w, indent+2);
+  writer_puts(w, "value=");
+  node_dump(w, subscript->value, indent+2);
+  writer_puts(w, ",\n");
+  writer_spaces(w, indent+2);
+  writer_puts(w, "slice=");
+  node_dump(w, subscript->index, indent+2);
+  writer_puts(w, "\n");
+  writer_spaces(w, indent);
+  writer_puts(w, ")");
+}
+
+static void node_dump(Writer *w, Node *n, int indent) {
+  switch (n->type) {
+    case CONSTANT: {
+      PyObject *value = n->data.constant->value;
+      if (value->type == &py_type_int) {
+        char *digits = py_int_format(value);
+        writer_printf(w, "Constant(value=%s)", digits);
+        free(digits);
+      } else if (value->type == &py_type_bytes) {
+        writer_puts(w, "Constant(value='");
+        writer_write(w, py_bytes_data(value), ((PyBytesObject *) value)->size);
+        writer_puts(w, "')");
+      } else {
+        py_error("RuntimeError: can't format this type");
+      }
+      break;
+    }
+    case NAME:
+      writer_printf(w, "Name(id='%s')", n->data.name->id);
+      break;
+    case BINARYOP:
+      writer_puts(w, "BinOp(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "left=");
+      node_dump(w, n->data.binary_op->left, indent+2);
+      writer_puts(w, ",\n");
+      writer_spaces(w, indent+2);
+      writer_printf(w, "op=%s,\n", bin_op_table[n->data.binary_op->op]);
+      writer_spaces(w, indent+2);
+      writer_puts(w, "right=");
+      node_dump(w, n->data.binary_op->right, indent+2);
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case ASSIGN:
+      writer_puts(w, "Assign(\n");
+      writer_spaces(w, indent+2);
+      writer_printf(w, "target=Name(id='%s'),\n", n->data.assign->target->id);
+      writer_spaces(w, indent+2);
+      writer_puts(w, "value=");
+      node_dump(w, n->data.assign->value, indent+2);
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case RETURN:
+      writer_puts(w, "Return(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "value=");
+      node_dump(w, n->data.ret->value, indent+2);
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case CALLMETHOD:
+      writer_puts(w, "Call(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "func=Attribute(\n");
+      writer_spaces(w, indent+4);
+      writer_puts(w, "value=");
+      node_dump(w, n->data.call_method->receiver, indent+4);
+      writer_puts(w, ",\n");
+      writer_spaces(w, indent+4);
+      writer_printf(w, "attr='%s'\n", n->data.call_method->method);
+      writer_spaces(w, indent+2);
+      writer_puts(w, "),\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "args=[\n");
+      for (int i=0; i<n->data.call_method->argc; i++) {
+        writer_spaces(w, indent+4);
+        node_dump(w, n->data.call_method->args+i, indent+4);
+        writer_puts(w, ",\n");
+      }
+      writer_spaces(w, indent+2);
+      writer_puts(w, "]\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case YIELD:
+      writer_puts(w, "Yield(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "value=");
+      node_dump(w, n->data.yield->value, indent+2);
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case CALLFUNCTION:
+      writer_puts(w, "Call(\n");
+      writer_spaces(w, indent+2);
+      writer_printf(w, "func=Name(id='%s'),\n", n->data.call_function->func->id);
+      writer_spaces(w, indent+2);
+      writer_puts(w, "args=[\n");
+      for (int i=0; i<n->data.call_function->argc; i++) {
+        writer_spaces(w, indent+4);
+        node_dump(w, n->data.call_function->args+i, indent+4);
+        writer_puts(w, ",\n");
+      }
+      writer_spaces(w, indent+2);
+      writer_puts(w, "]\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case FUNCTIONDEF:
+      writer_puts(w, "FunctionDef(\n");
+      writer_spaces(w, indent+2);
+      writer_printf(w, "name='%s',\n", n->data.function_def->name);
+      writer_spaces(w, indent+2);
+      writer_puts(w, "args=[");
+      for (int i=0; n->data.function_def->args[i] != NULL; i++) {
+        writer_printf(w, "%s,", n->data.function_def->args[i]);
+      }
+      writer_puts(w, "],\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "body=");
+      block_dump(w, n->data.function_def->body, indent+2);
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case IF:
+      writer_puts(w, "If(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "test=");
+      node_dump(w, n->data.iff->test, indent+2);
+      writer_puts(w, ",\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "body=");
+      block_dump(w, n->data.iff->body, indent+2);
+      if (n->data.iff->orelse != NULL) {
+        writer_puts(w, ",\n");
+        writer_spaces(w, indent+2);
+        writer_puts(w, "orelse=");
+        block_dump(w, n->data.iff->orelse, indent+2);
+      }
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case EXPR:
+      writer_puts(w, "Expr(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "value=");
+      node_dump(w, n->data.expr->value, indent+2);
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case WHILE:
+      writer_puts(w, "While(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "test=");
+      node_dump(w, n->data.while_loop->test, indent+2);
+      writer_puts(w, ",\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "body=");
+      block_dump(w, n->data.while_loop->body, indent+2);
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case FOR:
+      writer_puts(w, "For(\n");
+      writer_spaces(w, indent+2);
+      writer_printf(w, "target=Name(id='%s'),\n", n->data.for_loop->target->id);
+      writer_spaces(w, indent+2);
+      writer_puts(w, "iter=");
+      node_dump(w, n->data.for_loop->iter, indent+2);
+      writer_puts(w, ",\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "body=");
+      block_dump(w, n->data.for_loop->body, indent+2);
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case COMPARE:
+      writer_puts(w, "Compare(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "left=");
+      node_dump(w, n->data.compare->left, indent+2);
+      writer_puts(w, ",\n");
+      writer_spaces(w, indent+2);
+      writer_printf(w, "op=%s,\n", bin_op_table[n->data.compare->comparison]);
+      writer_spaces(w, indent+2);
+      writer_puts(w, "right=");
+      node_dump(w, n->data.compare->right, indent+2);
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case DICT:
+      writer_puts(w, "Dict(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "keys=[\n");
+      for (int i=0; i<n->data.dict->count; i++) {
+        writer_spaces(w, indent+4);
+        node_dump(w, n->data.dict->keys+i, indent+4);
+        writer_puts(w, ",\n");
+      }
+      writer_spaces(w, indent+2);
+      writer_puts(w, "],\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "values=[\n");
+      for (int i=0; i<n->data.dict->count; i++) {
+        writer_spaces(w, indent+4);
+        node_dump(w, n->data.dict->values+i, indent+4);
+        writer_puts(w, ",\n");
+      }
+      writer_spaces(w, indent+2);
+      writer_puts(w, "]\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case LIST:
+      writer_puts(w, "List(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "elts=[\n");
+      for (int i=0; i<n->data.list->count; i++) {
+        writer_spaces(w, indent+4);
+        node_dump(w, n->data.list->elts+i, indent+4);
+        writer_puts(w, ",\n");
+      }
+      writer_spaces(w, indent+2);
+      writer_puts(w, "]\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case SUBSCRIPT:
+      subscript_dump(w, n->data.subscript, indent);
+      break;
+    case SUBSCRIPTASSIGN:
+      writer_puts(w, "Assign(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "target=");
+      subscript_dump(w, n->data.subscript_assign->target, indent+2);
+      writer_puts(w, ",\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "value=");
+      node_dump(w, n->data.subscript_assign->value, indent+2);
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+    case DELETE:
+      writer_puts(w, "Delete(\n");
+      writer_spaces(w, indent+2);
+      writer_puts(w, "target=");
+      subscript_dump(w, n->data.del->target, indent+2);
+      writer_puts(w, "\n");
+      writer_spaces(w, indent);
+      writer_puts(w, ")");
+      break;
+  }
+}
+
+void module_dump(Writer *w, Module *m) {
+  for (int i=0; m->nodes[i] != NULL; i++) {
+    node_dump(w, m->nodes[i], 0);
+    writer_puts(w, "\n");
+  }
+}
+
+// NOTE: inlining. a module-level function whose body is a single small
+// `return <expr>` is compiled into its call sites: the arguments are bound
+// (constants and names are substituted, anything else goes in a hidden
+// local named "f.x"), then the expression runs in the caller's frame. the
+// call site starts with INLINE_GUARD, which checks the name still refers to
+// the function that was inlined and otherwise jumps to an ordinary call.
+// inlining is skipped where the caller has locals that would change what
+// the function's names mean
+#define INLINE_BUDGET 24 // AST nodes in the expression, after its own inlining
+
+typedef enum {
+  INLINE_UNVISITED,
+  INLINE_VISITING,
+  INLINE_OK,
+  INLINE_NO
+} InlineState;
+
+typedef struct {
+  FunctionDef *def;
+  InlineState state;
+  int size; // once INLINE_OK
+  PyCodeObject *code; // compiled on first use, shared with the def
+} InlineCandidate;
+
+typedef struct {
+  InlineCandidate *candidates;
+  int count;
+} Inliner;
+
+// parameters of a function being inlined, and what each one reads as -
+// the argument itself, or the temp slot it was stored in
+typedef struct InlineScope {
+  FunctionDef *def;
+  Node *args;
+  int *temps; // -1 for an argument that's read as it is
+  struct InlineScope *outer;
+} InlineScope;
+
+static PyCodeObject *code_walk(Module *module, char *name, char **argnames, Inliner *inliner);
+
+// growable bytecode + consts for the code object being walked
+typedef struct {
+  char **bytecode;
+  int b_idx; // next free instruction
+  int b_size;
+  PyObject **consts;
+  int c_idx; // next free const
+  int c_size;
+  LineTable lines;
+  Module *body; // the whole block this code object is compiled from
+  int module_level;
+  char *name;
+  char **argnames;
+  Inliner *inliner; // NULL with inlining off
+  InlineScope *scope; // innermost function being inlined, if any
+  int temps_in_use; // STORE_TEMP slots taken by the inlined calls we're in
+  int num_temps; // most ever in use at once
+} CodeBuilder;
+
+static void code_builder_init(CodeBuilder *code) {
+  const int INITIAL_SIZE = 16;
+  code->bytecode = malloc(INITIAL_SIZE * sizeof(char *));
+  code->b_idx = 0;
+  code->b_size = INITIAL_SIZE;
+  code->consts = malloc(INITIAL_SIZE * sizeof(PyObject *));
+  code->c_idx = 0;
+  code->c_size = INITIAL_SIZE;
+  linetable_init(&code->lines);
+}
+
+static char *format_instruction(const char *fmt, va_list args) {
+  va_list args_copy;
+  va_copy(args_copy, args);
+  int needed = vsnprintf(NULL, 0, fmt, args);
+  char *instruction = malloc(needed + 1);
+  vsnprintf(instruction, needed + 1, fmt, args_copy);
+  va_end(args_copy);
+  return instruction;
+}
+
+// append an instruction and return its offset
+static int emit(CodeBuilder *code, const char *fmt, ...) {
+  // NOTE: keep a slot spare for the NULL terminator
+  if (code->b_idx + 1 >= code->b_size) {
+    code->b_size *= 2;
+    code->bytecode = realloc(code->bytecode, code->b_size * sizeof(char *));
+  }
+  va_list args;
+  va_start(args, fmt);
+  code->bytecode[code->b_idx] = format_instruction(fmt, args);
+  va_end(args);
+  return code->b_idx++;
+}
+
+// overwrite an instruction emitted earlier (e.g. a forward jump)
+static void patch(CodeBuilder *code, int offset, const char *fmt, ...) {
+  free(code->bytecode[offset]);
+  va_list args;
+  va_start(args, fmt);
+  code->bytecode[offset] = format_instruction(fmt, args);
+  va_end(args);
+}
+
+static int add_const(CodeBuilder *code, PyObject *value) {
+  if (code->c_idx == code->c_size) {
+    code->c_size *= 2;
+    code->consts = realloc(code->consts, code->c_size * sizeof(PyObject *));
+  }
+  code->consts[code->c_idx] = value;
+  return code->c_idx++;
+}
+
+static void walk_block(Module *block, CodeBuilder *code);
+void walk(Node *node, CodeBuilder *code);
+
+static int block_reads_name(Module *block, const char *name);
+
+static int reads_name(Node *node, const char *name);
+
+static int subscript_reads_name(Subscript *subscript, const char *name) {
+  return reads_name(subscript->value, name) || reads_name(subscript->index, name);
+}
+
+// does evaluating `node` (or running it, for statements) read `name`?
+// NOTE: nested defs are skipped - they can't see our locals
+static int reads_name(Node *node, const char *name) {
+  switch (node->type) {
+    case CONSTANT:
+    case FUNCTIONDEF:
+      return 0;
+    case NAME:
+      return strcmp(node->data.name->id, name) == 0;
+    case BINARYOP:
+      return reads_name(node->data.binary_op->left, name)
+        || reads_name(node->data.binary_op->right, name);
+    case ASSIGN:
+      return reads_name(node->data.assign->value, name);
+    case RETURN:
+      return reads_name(node->data.ret->value, name);
+    case YIELD:
+      return reads_name(node->data.yield->value, name);
+    case CALLFUNCTION:
+      if (strcmp(node->data.call_function->func->id, name) == 0) {
+        return 1;
+      }
+      for (int i=0; i<node->data.call_function->argc; i++) {
+        if (reads_name(node->data.call_function->args+i, name)) {
+          return 1;
+        }
+      }
+      return 0;
+    case CALLMETHOD:
+      if (reads_name(node->data.call_method->receiver, name)) {
+        return 1;
+      }
+      for (int i=0; i<node->data.call_method->argc; i++) {
+        if (reads_name(node->data.call_method->args+i, name)) {
+          return 1;
+        }
+      }
+      return 0;
+    case EXPR:
+      return reads_name(node->data.expr->value, name);
+    case IF:
+      return reads_name(node->data.iff->test, name)
+        || block_reads_name(node->data.iff->body, name)
+        || (node->data.iff->orelse != NULL && block_reads_name(node->data.iff->orelse, name));
+    case COMPARE:
+      return reads_name(node->data.compare->left, name)
+        || reads_name(node->data.compare->right, name);
+    case WHILE:
+      return reads_name(node->data.while_loop->test, name)
+        || block_reads_name(node->data.while_loop->body, name);
+    case FOR:
+      return reads_name(node->data.for_loop->iter, name)
+        || block_reads_name(node->data.for_loop->body, name);
+    case DICT:
+      for (int i=0; i<node->data.dict->count; i++) {
+        if (reads_name(node->data.dict->keys+i, name) || reads_name(node->data.dict->values+i, name)) {
+          return 1;
+        }
+      }
+      return 0;
+    case LIST:
+      for (int i=0; i<node->data.list->count; i++) {
+        if (reads_name(node->data.list->elts+i, name)) {
+          return 1;
+        }
+      }
+      return 0;
+    case SUBSCRIPT:
+      return subscript_reads_name(node->data.subscript, name);
+    case SUBSCRIPTASSIGN:
+      return subscript_reads_name(node->data.subscript_assign->target, name)
+        || reads_name(node->data.subscript_assign->value, name);
+    case DELETE:
+      return subscript_reads_name(node->data.del->target, name);
+  }
+  return 1; // be safe
+}
+
+static int block_reads_name(Module *block, const char *name) {
+  for (int j=0; block->nodes[j] != NULL; j++) {
+    if (reads_name(block->nodes[j], name)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int block_binds_name(Module *block, const char *name);
+
+// does running `node` bind `name` in the current frame?
+static int binds_name(Node *node, const char *name) {
+  switch (node->type) {
+    case ASSIGN:
+      return strcmp(node->data.assign->target->id, name) == 0;
+    case FUNCTIONDEF:
+      return strcmp(node->data.function_def->name, name) == 0;
+    case IF:
+      return block_binds_name(node->data.iff->body, name)
+        || (node->data.iff->orelse != NULL && block_binds_name(node->data.iff->orelse, name));
+    case WHILE:
+      return block_binds_name(node->data.while_loop->body, name);
+    case FOR:
+      return strcmp(node->data.for_loop->target->id, name) == 0
+        || block_binds_name(node->data.for_loop->body, name);
+    default:
+      return 0;
+  }
+}
+
+static int block_binds_name(Module *block, const char *name) {
+  for (int j=0; block->nodes[j] != NULL; j++) {
+    if (binds_name(block->nodes[j], name)) {
+      return 1;
     }
-  } else if (n->type == NAME) {
-    string_appendf(&result, "Name(id='%s')", n->data.name->id);
-  } else if (n->type == BINARYOP) {
-    string_appendf(
-      &result, 
-      "BinOp(\n%sleft=%s,\n%sop=%s,\n%sright=%s\n%s)",
-      space(indent+2),
-      node_format(n->data.binary_op->left, indent+2).data, 
-      space(indent+2),
-      bin_op_table[n->data.binary_op->op],
-      space(indent+2),
-      node_format(n->data.binary_op->right, indent+2).data,
-      space(indent)
-    );
-  } else if (n->type == ASSIGN) {
-    string_appendf(
-      &result,
-      "Assign(\n%starget=Name(id='%s'),\n%svalue=%s\n%s)",
-      space(indent+2),
-      n->data.assign->target->id,
-      space(indent+2),
-      node_format(n->data.assign->value, indent+2).data,
-      space(indent)
-    );
-  } else if (n->type == RETURN) {
-    string_appendf(
-      &result,
-      "Return(\n%svalue=%s\n%s)",
-      space(indent+2),
-      node_format(n->data.ret->value, indent+2).data,
-      space(indent)
-    );
-  } else if (n->type == CALLFUNCTION) {
-    string_appendf(&result,
-      "Call(\n%sfunc=Name(id='%s'),\n%sargs=[\n",
-      space(indent+2),
-      n->data.call_function->func->id,
-      space(indent+2)
-    );
-    for (int i=0; i<n->data.call_function->argc; i++) {
-      string_appendf(&result, 
-        "%s%s,\n", 
-        space(indent+4),
-        node_format(n->data.call_function->args+i, indent+4).data
-      );
+  }
+  return 0;
+}
+
+static int block_yields(Module *block);
+
+// does `node` yield (making the function it's in a generator)?
+// NOTE: like CPython we decide at compile time, even if the yield never runs
+static int yields(Node *node) {
+  switch (node->type) {
+    case YIELD:
+      return 1;
+    case IF:
+      return block_yields(node->data.iff->body)
+        || (node->data.iff->orelse != NULL && block_yields(node->data.iff->orelse));
+    case WHILE:
+      return block_yields(node->data.while_loop->body);
+    case FOR:
+      return block_yields(node->data.for_loop->body);
+    default:
+      return 0; // including nested defs - their yields are their own
+  }
+}
+
+static int block_yields(Module *block) {
+  for (int j=0; block->nodes[j] != NULL; j++) {
+    if (yields(block->nodes[j])) {
+      return 1;
     }
-    string_appendf(&result, "%s]\n%s)", space(indent+2), space(indent));
-  } else if (n->type == FUNCTIONDEF) {
-    string_appendf(
-      &result,
-      "FunctionDef(\n%sname='%s',\n%sargs=[",
-      space(indent+2),
-      n->data.function_def->name,
-      space(indent+2)
-    );
-    for (int i=0; n->data.function_def->args[i] != NULL; i++) {
-      string_appendf(
-        &result,
-        "%s,", 
-        n->data.function_def->args[i]
-      );
+  }
+  return 0;
+}
+
+// would LOAD_NAME of `name` find one of the caller's locals?
+static int code_binds_name(CodeBuilder *code, const char *name) {
+  if (code->module_level) {
+    return 0; // locals are the globals
+  }
+  for (int i=0; code->argnames[i] != NULL; i++) {
+    if (strcmp(code->argnames[i], name) == 0) {
+      return 1;
     }
-    string_appendf(
-      &result,
-      "],\n%sbody=[%s\n",
-      space(indent+2),
-      space(indent+2)
-    );
-    for (int j=0; n->data.function_def->body->nodes[j] != NULL; j++) {
-      string_appendf(
-        &result,
-        "%s%s",
-        space(indent+4),
-        node_format(n->data.function_def->body->nodes[j], indent+4).data
-      );
-      if (n->data.function_def->body->nodes[j+1] != NULL) {
-        string_append(&result, ",\n");
-      } else {
-        string_appendf(
-          &result, 
-          "\n%s]\n%s)", 
-          space(indent+2),
-          space(indent)
-        );
-      }
+  }
+  return block_binds_name(code->body, name);
+}
+
+static int def_argc(FunctionDef *def) {
+  int argc = 0;
+  while (def->args[argc] != NULL) argc++;
+  return argc;
+}
+
+static int def_param(FunctionDef *def, const char *name) {
+  for (int i=0; def->args[i] != NULL; i++) {
+    if (strcmp(def->args[i], name) == 0) {
+      return i;
     }
-  } else if (n->type == IF) {
-    string_appendf(
-      &result,
-      "If(\n%stest=%s,\n",
-      space(indent+2),
-      node_format(n->data.iff->test, indent+2).data
-    );
-    string_appendf(
-      &result,
-      "%sbody=[\n",
-      space(indent+2)
-    );
-    for (int j=0; n->data.iff->body->nodes[j] != NULL; j++) {
-      string_appendf(
-        &result,
-        "%s%s",
-        space(indent+4),
-        node_format(n->data.iff->body->nodes[j], indent+4).data
-      );
-      if (n->data.iff->body->nodes[j+1] != NULL) {
-        string_append(&result, ",\n");
-      } else {
-        string_appendf(
-          &result, 
-          "\n%s]", 
-          space(indent+2)
-        );
+  }
+  return -1;
+}
+
+static InlineCandidate *find_candidate(Inliner *inliner, const char *name) {
+  for (int i=0; i<inliner->count; i++) {
+    if (strcmp(inliner->candidates[i].def->name, name) == 0) {
+      return &inliner->candidates[i];
+    }
+  }
+  return NULL;
+}
+
+static int inline_visit(Inliner *inliner, InlineCandidate *candidate);
+
+// size of `expr` in `def`'s body once its own calls are inlined, or -1 if
+// it can't be inlined at all
+static int inline_size(Inliner *inliner, FunctionDef *def, Node *expr) {
+  switch (expr->type) {
+    case CONSTANT:
+    case NAME:
+      return 1;
+    case BINARYOP: {
+      int left = inline_size(inliner, def, expr->data.binary_op->left);
+      int right = inline_size(inliner, def, expr->data.binary_op->right);
+      return left < 0 || right < 0 ? -1 : 1 + left + right;
+    }
+    case COMPARE: {
+      int left = inline_size(inliner, def, expr->data.compare->left);
+      int right = inline_size(inliner, def, expr->data.compare->right);
+      return left < 0 || right < 0 ? -1 : 1 + left + right;
+    }
+    case CALLFUNCTION: {
+      CallFunction *call = expr->data.call_function;
+      if (def_param(def, call->func->id) >= 0) {
+        return -1; // calls one of its arguments
+      }
+      int size = 1;
+      for (int i=0; i<call->argc; i++) {
+        int arg_size = inline_size(inliner, def, call->args+i);
+        if (arg_size < 0) {
+          return -1;
+        }
+        size += arg_size;
       }
+      InlineCandidate *callee = find_candidate(inliner, call->func->id);
+      if (callee != NULL && inline_visit(inliner, callee) && def_argc(callee->def) == call->argc) {
+        size += callee->size;
+      }
+      return size;
     }
-    if (n->data.iff->orelse != NULL) {
-      string_appendf(
-        &result,
-        ",\n%sorelse=[\n",
-        space(indent+2)
-      );
-      for (int j=0; n->data.iff->orelse->nodes[j] != NULL; j++) {
-        string_appendf(
-          &result,
-          "%s%s",
-          space(indent+4),
-          node_format(n->data.iff->orelse->nodes[j], indent+4).data
-        );
-        if (n->data.iff->orelse->nodes[j+1] != NULL) {
-          string_append(&result, ",\n");
-        } else {
-          string_appendf(
-            &result, 
-            "\n%s]\n%s)", 
-            space(indent+2),
-            space(indent)
-          );
+    default:
+      return -1;
+  }
+}
+
+// decide whether a candidate can be inlined - recursion (through other
+// candidates) makes the function it comes back round to a plain call
+static int inline_visit(Inliner *inliner, InlineCandidate *candidate) {
+  if (candidate->state == INLINE_UNVISITED) {
+    candidate->state = INLINE_VISITING;
+    Node **body = candidate->def->body->nodes;
+    int size = -1;
+    if (body[0] != NULL && body[0]->type == RETURN && body[1] == NULL) {
+      size = inline_size(inliner, candidate->def, body[0]->data.ret->value);
+    }
+    if (candidate->state == INLINE_VISITING) {
+      candidate->size = size;
+      candidate->state = size >= 0 && size <= INLINE_BUDGET ? INLINE_OK : INLINE_NO;
+    }
+  } else if (candidate->state == INLINE_VISITING) {
+    candidate->state = INLINE_NO;
+  }
+  return candidate->state == INLINE_OK;
+}
+
+// every def at module level with a name that's only def'd once
+static Inliner *inliner_new(Module *module) {
+  Inliner *inliner = malloc(sizeof(Inliner));
+  int n = 0;
+  while (module->nodes[n] != NULL) n++;
+  inliner->candidates = malloc((n + 1) * sizeof(InlineCandidate));
+  inliner->count = 0;
+  for (int j=0; module->nodes[j] != NULL; j++) {
+    if (module->nodes[j]->type != FUNCTIONDEF) {
+      continue;
+    }
+    FunctionDef *def = module->nodes[j]->data.function_def;
+    InlineCandidate *existing = find_candidate(inliner, def->name);
+    if (existing != NULL) {
+      existing->state = INLINE_NO;
+      continue;
+    }
+    InlineCandidate *candidate = &inliner->candidates[inliner->count++];
+    candidate->def = def;
+    candidate->state = INLINE_UNVISITED;
+    candidate->code = NULL;
+  }
+  for (int i=0; i<inliner->count; i++) {
+    inline_visit(inliner, &inliner->candidates[i]);
+  }
+  return inliner;
+}
+
+static PyCodeObject *candidate_code(Inliner *inliner, InlineCandidate *candidate) {
+  if (candidate->code == NULL) {
+    FunctionDef *def = candidate->def;
+    candidate->code = code_walk(def->body, def->name, def->args, inliner);
+  }
+  return candidate->code;
+}
+
+// would any name in the inlined expression (or anything it inlines in
+// turn) resolve to one of the caller's locals?
+static int inline_conflicts(CodeBuilder *code, FunctionDef *def, Node *expr) {
+  switch (expr->type) {
+    case NAME:
+      return def_param(def, expr->data.name->id) < 0 && code_binds_name(code, expr->data.name->id);
+    case BINARYOP:
+      return inline_conflicts(code, def, expr->data.binary_op->left)
+        || inline_conflicts(code, def, expr->data.binary_op->right);
+    case COMPARE:
+      return inline_conflicts(code, def, expr->data.compare->left)
+        || inline_conflicts(code, def, expr->data.compare->right);
+    case CALLFUNCTION: {
+      CallFunction *call = expr->data.call_function;
+      if (code_binds_name(code, call->func->id)) {
+        return 1;
+      }
+      for (int i=0; i<call->argc; i++) {
+        if (inline_conflicts(code, def, call->args+i)) {
+          return 1;
         }
       }
+      InlineCandidate *callee = find_candidate(code->inliner, call->func->id);
+      if (callee != NULL && callee->state == INLINE_OK) {
+        return inline_conflicts(code, callee->def, callee->def->body->nodes[0]->data.ret->value);
+      }
+      return 0;
     }
+    default:
+      return 0;
   }
-  return result;
 }
 
-void module_print(Module *m) {
-  Node *n;
-  for (int i=0; ((n=m->nodes[i])) != NULL; i++) {
-    printf("%s\n", node_format(n, 0).data);
+static void walk_plain_call(Node *node, CodeBuilder *code, const char *opname);
+
+// compile a call inline if we can - returns 0 if it's left to walk_call
+static int walk_inline_call(Node *node, CodeBuilder *code, const char *opname) {
+  CallFunction *call = node->data.call_function;
+  if (code->inliner == NULL) {
+    return 0;
+  }
+  InlineCandidate *candidate = find_candidate(code->inliner, call->func->id);
+  if (candidate == NULL || candidate->state != INLINE_OK || def_argc(candidate->def) != call->argc) {
+    return 0;
+  }
+  FunctionDef *def = candidate->def;
+  Node *body = def->body->nodes[0]->data.ret->value;
+  if (code_binds_name(code, def->name) || inline_conflicts(code, def, body)) {
+    return 0;
+  }
+
+  int guard_idx = add_const(code, (PyObject *) candidate_code(code->inliner, candidate));
+  int guard_offset = emit(code, "INLINE_GUARD,%d,-1", guard_idx);
+  // arguments that aren't a constant or a name are evaluated once, onto the
+  // stack left to right, then stored right to left into the frame's temps -
+  // never the globals, which would bump their version and fail every guard
+  int *temps = malloc(call->argc * sizeof(int));
+  int temps_in_use = code->temps_in_use;
+  for (int i=0; i<call->argc; i++) {
+    Node *arg = call->args+i;
+    temps[i] = -1;
+    if (arg->type != CONSTANT && arg->type != NAME) {
+      walk(arg, code);
+      temps[i] = code->temps_in_use++;
+    }
+  }
+  if (code->temps_in_use > code->num_temps) {
+    code->num_temps = code->temps_in_use;
+  }
+  for (int i=call->argc-1; i>=0; i--) {
+    if (temps[i] >= 0) {
+      emit(code, "STORE_TEMP,%d", temps[i]);
+    }
+  }
+  InlineScope scope = { def, call->args, temps, code->scope };
+  code->scope = &scope;
+  walk(body, code);
+  code->scope = scope.outer;
+  code->temps_in_use = temps_in_use;
+  int jump_offset = emit(code, "JUMP,-1");
+  patch(code, guard_offset, "INLINE_GUARD,%d,%d", guard_idx, code->b_idx);
+  walk_plain_call(node, code, opname);
+  patch(code, jump_offset, "JUMP,%d", code->b_idx);
+  if (stats_enabled) {
+    stats_count_inline(def->name, code->name);
+  }
+  return 1;
+}
+
+static void walk_call(Node *node, CodeBuilder *code, const char *opname) {
+  if (!walk_inline_call(node, code, opname)) {
+    walk_plain_call(node, code, opname);
+  }
+}
+
+static void walk_plain_call(Node *node, CodeBuilder *code, const char *opname) {
+  emit(code, "LOAD_NAME,'%s'", node->data.call_function->func->id);
+  // for each argument, emit a LOAD_ opcode
+  int i = 0;
+  while (i < node->data.call_function->argc) {
+    // walk the arg
+    walk(node->data.call_function->args+i, code);
+    i++;
+  }
+  emit(code, "%s,%d", opname, i);
+}
+
+// a forward branch taken when a condition is false, target still to come
+typedef struct {
+  int offset;
+  int comparison; // -1 for a POP_JUMP_IF_FALSE
+} Branch;
+
+// a comparison compares and branches in one instruction, with no bool in
+// between - anything else is evaluated and then tested
+static Branch walk_branch_if_false(Node *test, CodeBuilder *code) {
+  Branch branch = { .comparison = -1 };
+  if (test->type == BINARYOP && is_comparison(test->data.binary_op->op)) {
+    branch.comparison = test->data.binary_op->op;
+    walk(test->data.binary_op->left, code);
+    walk(test->data.binary_op->right, code);
+    branch.offset = emit(code, "COMPARE_AND_JUMP,%d,-1", branch.comparison);
+  } else if (test->type == COMPARE) {
+    branch.comparison = test->data.compare->comparison;
+    walk(test->data.compare->left, code);
+    walk(test->data.compare->right, code);
+    branch.offset = emit(code, "COMPARE_AND_JUMP,%d,-1", branch.comparison);
+  } else {
+    walk(test, code);
+    branch.offset = emit(code, "POP_JUMP_IF_FALSE,-1");
+  }
+  return branch;
+}
+
+static void patch_branch(CodeBuilder *code, Branch branch, int target) {
+  if (branch.comparison >= 0) {
+    patch(code, branch.offset, "COMPARE_AND_JUMP,%d,%d", branch.comparison, target);
+  } else {
+    patch(code, branch.offset, "POP_JUMP_IF_FALSE,%d", target);
   }
-  printf("\n");
 }
 
-void walk(Node *node, char **bytecode, int *b_idx, PyObject **consts, int *c_idx) {
+void walk(Node *node, CodeBuilder *code) {
   // post-order traverse AST and emit bytecode to output
   // buffer according to the current offset
-  // first: allocate string
   switch (node->type) {
-    case CONSTANT: {
+    case CONSTANT:
       // TODO: is this a move?
-      consts[*c_idx] = node->data.constant->value;
-      bytecode[*b_idx] = malloc(32);
-      sprintf(bytecode[*b_idx], "LOAD_CONST,%d", *c_idx);
-      *b_idx += 1;
-      *c_idx += 1;
+      emit(code, "LOAD_CONST,%d", add_const(code, node->data.constant->value));
       break;
-    }
-    case NAME:
-      bytecode[*b_idx] = malloc(32);
-      sprintf(bytecode[*b_idx], "LOAD_NAME,'%s'", node->data.name->id);
-      *b_idx += 1;
+    case NAME: {
+      InlineScope *scope = code->scope;
+      int param = scope != NULL ? def_param(scope->def, node->data.name->id) : -1;
+      if (param >= 0 && scope->temps[param] >= 0) {
+        emit(code, "LOAD_TEMP,%d", scope->temps[param]);
+      } else if (param >= 0) {
+        // the argument belongs to the scope the call was made from
+        code->scope = scope->outer;
+        walk(&scope->args[param], code);
+        code->scope = scope;
+      } else {
+        emit(code, "LOAD_NAME,'%s'", node->data.name->id);
+      }
       break;
+    }
     case BINARYOP:
-      walk(node->data.binary_op->left, bytecode, b_idx, consts, c_idx);
-      walk(node->data.binary_op->right, bytecode, b_idx, consts, c_idx);
-      bytecode[*b_idx] = malloc(32); 
-      sprintf(bytecode[*b_idx], "BINARY_OP,%d", node->data.binary_op->op);
-      *b_idx += 1;
+      walk(node->data.binary_op->left, code);
+      walk(node->data.binary_op->right, code);
+      if (is_comparison(node->data.binary_op->op)) {
+        emit(code, "COMPARE,%d", node->data.binary_op->op);
+      } else {
+        emit(code, "BINARY_OP,%d", node->data.binary_op->op);
+      }
       break;
     case ASSIGN:
-      walk(node->data.assign->value, bytecode, b_idx, consts, c_idx);
-      bytecode[*b_idx] = malloc(32);
-      sprintf(bytecode[*b_idx], "STORE_NAME,'%s'", node->data.assign->target->id);
-      *b_idx += 1;
+      walk(node->data.assign->value, code);
+      emit(code, "STORE_NAME,'%s'", node->data.assign->target->id);
       break;
     case FUNCTIONDEF: {
-      // 1. build PyCodeObject
-      PyCodeObject *code = module_walk(node->data.function_def->body);
-      code->argnames = node->data.function_def->args;
+      // 1. build PyCodeObject (call sites may have got there first)
+      InlineCandidate *candidate = code->inliner != NULL && code->module_level
+        ? find_candidate(code->inliner, node->data.function_def->name) : NULL;
+      PyCodeObject *function_code;
+      if (candidate != NULL && candidate->def == node->data.function_def) {
+        function_code = candidate_code(code->inliner, candidate);
+      } else {
+        function_code = code_walk(
+          node->data.function_def->body,
+          node->data.function_def->name,
+          node->data.function_def->args,
+          code->inliner
+        );
+      }
 
       // 2. save it to consts and emit a LOAD_CONST
-      consts[*c_idx] = (PyObject *) code;
-      bytecode[*b_idx] = malloc(32);
-      sprintf(bytecode[*b_idx], "LOAD_CONST,%d", *c_idx);
-      *c_idx += 1;
-      *b_idx += 1;
+      emit(code, "LOAD_CONST,%d", add_const(code, (PyObject *) function_code));
 
       // 3. emit MAKE_FUNCTION and STORE_NAME
-      bytecode[*b_idx] = "MAKE_FUNCTION";
-      *b_idx += 1;
-      bytecode[*b_idx] = malloc(32);
-      sprintf(bytecode[*b_idx], "STORE_NAME,'%s'", node->data.function_def->name);
-      *b_idx += 1;
+      emit(code, "MAKE_FUNCTION");
+      emit(code, "STORE_NAME,'%s'", node->data.function_def->name);
       break;
     }
     case RETURN:
-      walk(node->data.ret->value, bytecode, b_idx, consts, c_idx);
-      bytecode[*b_idx] = "RETURN";
-      *b_idx += 1;
+      if (node->data.ret->value->type == CALLFUNCTION) {
+        // NOTE: the RETURN stays, for when the call can't reuse the frame
+        walk_call(node->data.ret->value, code, "TAIL_CALL");
+      } else {
+        walk(node->data.ret->value, code);
+      }
+      emit(code, "RETURN");
+      break;
+    case YIELD:
+      if (code->module_level) {
+        py_error("SyntaxError: 'yield' outside function");
+      }
+      walk(node->data.yield->value, code);
+      emit(code, "YIELD_VALUE");
       break;
     case CALLFUNCTION:
-      bytecode[*b_idx] = malloc(32);
-      sprintf(bytecode[*b_idx], "LOAD_NAME,'%s'", node->data.call_function->func->id);
-      *b_idx += 1;
-      // for each argument, emit a LOAD_ opcode
-      int i = 0;
-      while (i < node->data.call_function->argc) {
-        // walk the arg
-        walk(node->data.call_function->args+i, bytecode, b_idx, consts, c_idx);
-        i++;
+      walk_call(node, code, "CALL_FUNCTION");
+      break;
+    case CALLMETHOD:
+      walk(node->data.call_method->receiver, code);
+      for (int i=0; i<node->data.call_method->argc; i++) {
+        walk(node->data.call_method->args+i, code);
       }
-      bytecode[*b_idx] = malloc(32);
-      sprintf(bytecode[*b_idx], "CALL_FUNCTION,%d", i);
-      *b_idx += 1;
+      // NOTE: the slot's looked up here, once - the name's only kept for --dis
+      // and the AttributeError when there's no such method
+      emit(code, "CALL_METHOD,%d,%d,'%s'", py_method_slot(node->data.call_method->method),
+           node->data.call_method->argc, node->data.call_method->method);
       break;
     case EXPR:
       // walk the expression then pop the result
-      walk(node->data.expr->value, bytecode, b_idx, consts, c_idx);
-      bytecode[*b_idx] = "POP_TOP";
-      *b_idx += 1;
+      walk(node->data.expr->value, code);
+      emit(code, "POP_TOP");
       break;
-    case IF:
-      walk(node->data.iff->test, bytecode, b_idx, consts, c_idx);
-      int pop_jump_offset = *b_idx; // patch when we know block sizes
-      *b_idx += 1;
-      for (int j=0; node->data.iff->body->nodes[j] != NULL; j++) {
-        walk(node->data.iff->body->nodes[j], bytecode, b_idx, consts, c_idx);
-      }
+    case IF: {
+      // patch when we know block sizes
+      Branch branch = walk_branch_if_false(node->data.iff->test, code);
+      walk_block(node->data.iff->body, code);
       if (node->data.iff->orelse != NULL) {
-        // put the extra JUMP after true block and patch POP_JUMP_IF_FALSE
-        int extra_jump_offset = *b_idx;
-        *b_idx += 1;
-        bytecode[pop_jump_offset] = malloc(32);
-        sprintf(bytecode[pop_jump_offset], "POP_JUMP_IF_FALSE,%d", *b_idx);
+        // put the extra JUMP after true block and patch the branch
+        int extra_jump_offset = emit(code, "JUMP,-1");
+        patch_branch(code, branch, code->b_idx);
         // now walk the orelse
-        for (int j=0; node->data.iff->orelse->nodes[j] != NULL; j++) {
-          walk(node->data.iff->orelse->nodes[j], bytecode, b_idx, consts, c_idx);
-        }
+        walk_block(node->data.iff->orelse, code);
         // finally patch the jump to skip if we've done the true block
-        bytecode[extra_jump_offset] = malloc(32);
-        sprintf(bytecode[extra_jump_offset], "JUMP,%d", *b_idx);
+        patch(code, extra_jump_offset, "JUMP,%d", code->b_idx);
       } else {
-        bytecode[pop_jump_offset] = malloc(32);
-        sprintf(bytecode[pop_jump_offset], "POP_JUMP_IF_FALSE,%d", *b_idx);
-        // nb. *b_idx has been incr'd by body walk
+        // nb. b_idx has been incr'd by body walk
+        patch_branch(code, branch, code->b_idx);
       }
       break;
+    }
+    case WHILE: {
+      int loop_start = code->b_idx;
+      Branch exit_branch = walk_branch_if_false(node->data.while_loop->test, code);
+      walk_block(node->data.while_loop->body, code);
+      emit(code, "JUMP_BACKWARD,%d", loop_start);
+      patch_branch(code, exit_branch, code->b_idx);
+      break;
+    }
+    case FOR: {
+      if (!is_range_call(node->data.for_loop->iter)) {
+        // the iterator lives on the value stack for the whole loop, and
+        // each RESUME gets its next value (running a generator up to its
+        // next yield)
+        walk(node->data.for_loop->iter, code);
+        emit(code, "GET_ITER");
+        int loop_start = emit(code, "RESUME,-1");
+        emit(code, "STORE_NAME,'%s'", node->data.for_loop->target->id);
+        walk_block(node->data.for_loop->body, code);
+        emit(code, "JUMP_BACKWARD,%d", loop_start);
+        patch(code, loop_start, "RESUME,%d", code->b_idx);
+        break;
+      }
+      // the range iterator lives on the value stack for the whole loop
+      CallFunction *range = node->data.for_loop->iter->data.call_function;
+      for (int i=0; i<range->argc; i++) {
+        walk(range->args+i, code);
+      }
+      emit(code, "GET_RANGE,%d", range->argc);
+      // NOTE: the counter stays unboxed in the iterator - we only make an
+      // int object for the loop variable if something can read it. anything
+      // at module level could be a global read by some function
+      char *target = node->data.for_loop->target->id;
+      int store = code->module_level || block_reads_name(code->body, target);
+      int loop_start = emit(code, "FOR_RANGE,-1,%d", store);
+      if (store) {
+        emit(code, "STORE_NAME,'%s'", target);
+      }
+      walk_block(node->data.for_loop->body, code);
+      emit(code, "JUMP_BACKWARD,%d", loop_start);
+      patch(code, loop_start, "FOR_RANGE,%d,%d", code->b_idx, store);
+      break;
+    }
     case COMPARE:
-      walk(node->data.compare->left, bytecode, b_idx, consts, c_idx);
-      walk(node->data.compare->right, bytecode, b_idx, consts, c_idx);
-      bytecode[*b_idx] = malloc(32);
-      sprintf(bytecode[*b_idx], "COMPARE,%d", node->data.compare->comparison);
-      *b_idx += 1;
+      walk(node->data.compare->left, code);
+      walk(node->data.compare->right, code);
+      emit(code, "COMPARE,%d", node->data.compare->comparison);
+      break;
+    case DICT:
+      emit(code, "BUILD_MAP,%d", node->data.dict->count);
+      for (int i=0; i<node->data.dict->count; i++) {
+        walk(node->data.dict->keys+i, code);
+        walk(node->data.dict->values+i, code);
+        emit(code, "MAP_ADD");
+      }
+      break;
+    case LIST:
+      emit(code, "BUILD_LIST,%d", node->data.list->count);
+      for (int i=0; i<node->data.list->count; i++) {
+        walk(node->data.list->elts+i, code);
+        emit(code, "LIST_APPEND");
+      }
+      break;
+    case SUBSCRIPT:
+      walk(node->data.subscript->value, code);
+      walk(node->data.subscript->index, code);
+      emit(code, "BINARY_SUBSCR");
+      break;
+    case SUBSCRIPTASSIGN:
+      walk(node->data.subscript_assign->value, code);
+      walk(node->data.subscript_assign->target->value, code);
+      walk(node->data.subscript_assign->target->index, code);
+      emit(code, "STORE_SUBSCR");
+      break;
+    case DELETE:
+      walk(node->data.del->target->value, code);
+      walk(node->data.del->target->index, code);
+      emit(code, "DELETE_SUBSCR");
       break;
   }
 }
 
-PyCodeObject *module_walk(Module *module) {
-  PyCodeObject *result = malloc(sizeof(PyCodeObject));
-  result->base.type = &py_type_code;
-  result->bytecode = malloc(100 * sizeof(char *));
-  result->consts = malloc(10 * sizeof(PyObject *));
-  result->argnames = malloc((MAX_ARGS + 1) * sizeof(char *));
-  int b_idx = 0; int c_idx = 0;
-  for (int i=0; module->nodes[i] != NULL; i++) {
-    walk(module->nodes[i], result->bytecode, &b_idx, result->consts, &c_idx);
+// walk each statement in a block, recording where its line starts
+static void walk_block(Module *block, CodeBuilder *code) {
+  for (int j=0; block->nodes[j] != NULL; j++) {
+    linetable_add(&code->lines, code->b_idx, block->nodes[j]->line);
+    walk(block->nodes[j], code);
   }
-  result->bytecode[b_idx] = NULL;
+}
+
+// argnames is NULL-terminated (or NULL for module-level code)
+static PyCodeObject *code_walk(Module *module, char *name, char **argnames, Inliner *inliner) {
+  int argc = 0;
+  while (argnames != NULL && argnames[argc] != NULL) argc++;
+  // argnames live inline after the header
+  PyCodeObject *result = (PyCodeObject *) py_type_alloc_var(&py_type_code, argc + 1);
+  for (int i=0; i<argc; i++) {
+    result->argnames[i] = argnames[i];
+  }
+  result->argnames[argc] = NULL;
+  result->name = name;
+  result->hotness = 0;
+  result->jit = NULL;
+  result->quicken = NULL;
+  result->inline_version = 0;
+  CodeBuilder code;
+  code_builder_init(&code);
+  code.body = module;
+  code.module_level = argnames == NULL;
+  code.name = name;
+  code.argnames = argnames;
+  code.inliner = inliner;
+  code.scope = NULL;
+  code.temps_in_use = 0;
+  code.num_temps = 0;
+  walk_block(module, &code);
+  // NOTE: a generator that runs off the end of its body still has to
+  // RETURN - that's how whoever resumed it finds out it's finished
+  result->is_generator = !code.module_level && block_yields(module);
+  if (result->is_generator) {
+    emit(&code, "RETURN");
+  }
+  code.bytecode[code.b_idx] = NULL;
+  result->bytecode = code.bytecode;
+  result->consts = code.consts;
+  result->num_consts = code.c_idx;
+  result->num_temps = code.num_temps;
+  result->first_line = code.lines.first_line;
+  result->linetable = code.lines.data;
+  result->linetable_length = code.lines.length;
   return result;
 }
 
-void print_tokens(Token *tokens) {
-  Token t;
-  printf("tokens = \n");
-  for (int i=0; ((t = tokens[i]).type) != T_EOF; i++) {
-    if (t.lexeme != NULL) {
-      printf("%d: %s, %s\n", i, token_table[t.type], t.lexeme);
+PyCodeObject *module_walk(Module *module, int inline_functions) {
+  Inliner *inliner = inline_functions ? inliner_new(module) : NULL;
+  return code_walk(module, "<module>", NULL, inliner);
+}
+
+void tokens_dump(Writer *w, const Token *tokens) {
+  for (int i=0; tokens[i].type != T_EOF; i++) {
+    if (tokens[i].lexeme != NULL) {
+      writer_printf(w, "%d: %s, %s\n", i, token_table[tokens[i].type], tokens[i].lexeme);
     } else {
-      printf("%d: %s\n", i, token_table[t.type]);
+      writer_printf(w, "%d: %s\n", i, token_table[tokens[i].type]);
     }
   }
-  printf("\n");
 }
 
 /*
 int main() {
   TokenArray tokens = tokenize("print(\"foo\" * 3)");
-  print_tokens(tokens.data);
+  Writer w;
+  writer_init(&w, 1, 4096);
+  tokens_dump(&w, tokens.data);
 
   int t_idx = 0;
   Module *module = parse(tokens.data, &t_idx);
-  printf("module = \n");
-  module_print(module);
+  writer_puts(&w, "module = \n");
+  module_dump(&w, module);
 
-  printf("bytecode = \n");
-  PyCodeObject *code = module_walk(module);
+  writer_puts(&w, "bytecode = \n");
+  PyCodeObject *code = module_walk(module, 1);
   for (int i=0; code->bytecode[i] != NULL; i++) {
-    printf("%s\n", code->bytecode[i]);
+    writer_printf(&w, "%s\n", code->bytecode[i]);
   }
+  writer_flush(&w);
   exit(0);
 }
 */
@@ -2,7 +2,7 @@
 #define TOKEN_H
 
 #include "hash-table.h"
-#include "string.h"
+#include "writer.h"
 
 // tokenizer stuff ----------------------------
 typedef enum {
@@ -16,6 +16,11 @@ typedef enum {
   T_RETURN,
   T_IF,
   T_ELSE,
+  T_WHILE,
+  T_FOR,
+  T_IN,
+  T_YIELD,
+  T_DEL,
   
   // operators
   T_PLUS,
@@ -23,6 +28,8 @@ typedef enum {
   T_ASSIGN,
   T_MULTIPLY,
   T_DIVIDE,
+  T_FLOORDIV,
+  T_MODULO,
   T_EQ,
   T_LT,
   T_GT,
@@ -32,8 +39,13 @@ typedef enum {
   // punctuation + grouping 
   T_LPAREN,
   T_RPAREN,
+  T_LBRACE,
+  T_RBRACE,
+  T_LBRACKET,
+  T_RBRACKET,
   T_COMMA,
   T_COLON,
+  T_DOT,
   T_NEWLINE,
   T_INDENT,
   T_DEDENT,
@@ -46,7 +58,7 @@ typedef enum {
   T_EOF
 } TokenType;
 
-static char *token_table[26] = {
+static char *token_table[38] = {
   "INT",
   "STRING",
   "NAME",
@@ -54,11 +66,18 @@ static char *token_table[26] = {
   "RETURN",
   "IF",
   "ELSE",
+  "WHILE",
+  "FOR",
+  "IN",
+  "YIELD",
+  "DEL",
   "PLUS",
   "MINUS",
   "ASSIGN",
   "MULTIPLY",
   "DIVIDE",
+  "FLOORDIV",
+  "MODULO",
   "EQ",
   "LT",
   "GT",
@@ -66,8 +85,13 @@ static char *token_table[26] = {
   "GEQ",
   "LPAREN",
   "RPAREN",
+  "LBRACE",
+  "RBRACE",
+  "LBRACKET",
+  "RBRACKET",
   "COMMA",
   "COLON",
+  "DOT",
   "NEWLINE",
   "INDENT",
   "DEDENT",
@@ -81,19 +105,25 @@ typedef struct {
   TokenType type;
 } Keyword;
 
-static const int num_keywords = 4;
+#define NUM_KEYWORDS 9
 
-static Keyword keywords[num_keywords] = {
+static Keyword keywords[NUM_KEYWORDS] = {
   { "def", 3, T_DEF },
   { "return", 6, T_RETURN },
   { "if", 2, T_IF },
   { "else", 4, T_ELSE },
+  { "while", 5, T_WHILE },
+  { "for", 3, T_FOR },
+  { "in", 2, T_IN },
+  { "yield", 5, T_YIELD },
+  { "del", 3, T_DEL },
 };
 
 // e.g. Token{type: T_NAME, lexeme: "foo"}
 typedef struct {
   TokenType type;
   char *lexeme;
+  int line; // source line the token starts on
 } Token;
 
 typedef struct {
@@ -115,10 +145,19 @@ typedef enum NodeType {
   CALLFUNCTION,
   EXPR,
   IF,
-  COMPARE
+  COMPARE,
+  WHILE,
+  FOR,
+  YIELD,
+  CALLMETHOD,
+  DICT,
+  LIST,
+  SUBSCRIPT,
+  SUBSCRIPTASSIGN,
+  DELETE
 } NodeType;
 
-static char *node_type_table[10] = {
+static char *node_type_table[19] = {
   "CONSTANT",
   "NAME",
   "BINARYOP",
@@ -128,9 +167,20 @@ static char *node_type_table[10] = {
   "CALLFUNCTION",
   "EXPR",
   "IF",
-  "COMPARE"
+  "COMPARE",
+  "WHILE",
+  "FOR",
+  "YIELD",
+  "CALLMETHOD",
+  "DICT",
+  "LIST",
+  "SUBSCRIPT",
+  "SUBSCRIPTASSIGN",
+  "DELETE"
 };
 
+// NOTE: EQ..GTE are the comparisons - keep them together, see
+// is_comparison()
 typedef enum {
   ADD = 0,
   SUB,
@@ -140,10 +190,16 @@ typedef enum {
   LT,
   GT,
   LTE,
-  GTE
+  GTE,
+  FLOORDIV,
+  MOD
 } BinOp;
 
-static char *bin_op_table[9] = {
+static inline int is_comparison(BinOp op) {
+  return op >= EQ && op <= GTE;
+}
+
+static char *bin_op_table[11] = {
   "Add",
   "Sub",
   "Mult",
@@ -152,7 +208,9 @@ static char *bin_op_table[9] = {
   "Lt",
   "Gt",
   "LtE",
-  "GtE"
+  "GtE",
+  "FloorDiv",
+  "Mod"
 };
 
 typedef struct Constant {
@@ -178,6 +236,10 @@ typedef struct Return {
   struct Node *value;
 } Return;
 
+typedef struct Yield { // NOTE: a statement only - `x = yield y` isn't supported
+  struct Node *value;
+} Yield;
+
 typedef struct FunctionDef {
   char *name;
   char **args; // NOTE: limit to 5 arguments
@@ -190,6 +252,13 @@ typedef struct CallFunction {
   int argc;
 } CallFunction;
 
+typedef struct CallMethod { // e.g. `line.find("x")`
+  struct Node *receiver; // NOTE: any operand - a name, a literal, a call or a subscript
+  char *method;
+  struct Node *args;
+  int argc;
+} CallMethod;
+
 typedef struct Expr { // NOTE: pure expressions e.g. `3 + 4`
   struct Node *value;
 } Expr;
@@ -200,6 +269,42 @@ typedef struct If {
   struct Module *orelse;
 } If;
 
+typedef struct While {
+  struct Node *test;
+  struct Module *body;
+} While;
+
+typedef struct For { // NOTE: range(...) or anything iterable
+  Name *target;
+  struct Node *iter;
+  struct Module *body;
+} For;
+
+typedef struct Dict { // e.g. `{"a": 1, "b": 2}`
+  struct Node *keys;
+  struct Node *values;
+  int count;
+} Dict;
+
+typedef struct List { // e.g. `[1, 2, 3]`
+  struct Node *elts;
+  int count;
+} List;
+
+typedef struct Subscript { // e.g. `d["a"]` or `l[0]`
+  struct Node *value;
+  struct Node *index;
+} Subscript;
+
+typedef struct SubscriptAssign { // e.g. `d["a"] = 1`
+  Subscript *target;
+  struct Node *value;
+} SubscriptAssign;
+
+typedef struct Delete { // NOTE: one subscript only e.g. `del d["a"]`
+  Subscript *target;
+} Delete;
+
 typedef struct Compare {
   struct Node *left;
   struct Node *right;
@@ -208,6 +313,7 @@ typedef struct Compare {
 
 typedef struct Node {
   NodeType type;
+  int line; // NOTE: only set on statements - see parse()
   union {
     Constant *constant;
     Name *name;
@@ -216,21 +322,29 @@ typedef struct Node {
     FunctionDef *function_def;
     Return *ret;
     CallFunction *call_function;
+    CallMethod *call_method;
     Expr *expr;
     If *iff;
     Compare *compare;
+    While *while_loop;
+    For *for_loop;
+    Yield *yield;
+    Dict *dict;
+    List *list;
+    Subscript *subscript;
+    SubscriptAssign *subscript_assign;
+    Delete *del;
   } data;
 } Node;
 
 typedef struct Module {
-  Node *nodes[20];
+  Node **nodes; // NULL-terminated, grows as we parse
 } Module;
 
-String node_format(Node *n, int indent);
-void module_print(Module *m);
-PyCodeObject *module_walk(Module *m);
+void module_dump(Writer *w, Module *m);
+PyCodeObject *module_walk(Module *m, int inline_functions); // see INLINE_BUDGET
 Node *parse_expression(const Token *tokens, int *t_idx);
 Module *parse(const Token *tokens, int *t_idx); // main entry point
-void print_tokens(Token *tokens);
+void tokens_dump(Writer *w, const Token *tokens);
 
 #endif
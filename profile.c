@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include "profile.h"
+#include "code.h"
+
+// NOTE: the SIGPROF handler can't allocate, so samples are aggregated in
+// place: each distinct stack is stored once in a preallocated frame pool and
+// found again through an open-addressing table keyed on its hash. only the
+// innermost PROFILE_MAX_DEPTH frames of a stack are kept.
+#define PROFILE_MAX_DEPTH 128
+#define PROFILE_TABLE_SIZE (1 << 16) // distinct stacks, power of two
+#define PROFILE_POOL_SIZE (1 << 20) // frames over all distinct stacks
+
+typedef struct {
+  PyCodeObject *code;
+  int line;
+} ProfileFrame;
+
+typedef struct {
+  unsigned int hash;
+  int start; // index into the frame pool
+  int depth;
+  long count; // 0 means the slot is free
+} ProfileStack;
+
+static PyState *profiled_state = NULL;
+static const char *profile_path = NULL;
+static ProfileFrame *frame_pool = NULL;
+static int frame_pool_used = 0;
+static ProfileStack *stack_table = NULL;
+static int num_stacks = 0;
+static long num_samples = 0;
+static long dropped_samples = 0;
+
+// field by field - ProfileFrame has padding after `line`, and the frames
+// being sampled are on the stack with whatever was there before
+static int same_frames(const ProfileFrame *a, const ProfileFrame *b, int depth) {
+  for (int i=0; i<depth; i++) {
+    if (a[i].code != b[i].code || a[i].line != b[i].line) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void profile_sample(int sig) {
+  ProfileFrame frames[PROFILE_MAX_DEPTH];
+  int depth = 0;
+  // innermost first - callers have already moved their pc past the call
+  for (PyFrameObject *f = profiled_state->current_frame; f != NULL && depth < PROFILE_MAX_DEPTH; f = f->prev) {
+    if (f->code == NULL) {
+      continue;
+    }
+    int offset = depth == 0 ? f->bytecode_offset : f->bytecode_offset - 1;
+    frames[depth].code = f->code;
+    frames[depth].line = py_code_line(f->code, offset);
+    depth++;
+  }
+  if (depth == 0) {
+    return;
+  }
+  num_samples++;
+
+  // FNV-1a over the frames
+  unsigned int hash = 2166136261u;
+  for (int i=0; i<depth; i++) {
+    hash = (hash ^ (unsigned int) (size_t) frames[i].code) * 16777619u;
+    hash = (hash ^ (unsigned int) frames[i].line) * 16777619u;
+  }
+
+  unsigned int slot = hash & (PROFILE_TABLE_SIZE - 1);
+  while (stack_table[slot].count != 0) {
+    ProfileStack *entry = &stack_table[slot];
+    if (entry->hash == hash && entry->depth == depth &&
+        same_frames(&frame_pool[entry->start], frames, depth)) {
+      entry->count++;
+      return;
+    }
+    slot = (slot + 1) & (PROFILE_TABLE_SIZE - 1);
+  }
+
+  // new stack - keep the table at most 3/4 full
+  if (num_stacks >= PROFILE_TABLE_SIZE / 4 * 3 || frame_pool_used + depth > PROFILE_POOL_SIZE) {
+    dropped_samples++;
+    return;
+  }
+  memcpy(&frame_pool[frame_pool_used], frames, depth * sizeof(ProfileFrame));
+  stack_table[slot].hash = hash;
+  stack_table[slot].start = frame_pool_used;
+  stack_table[slot].depth = depth;
+  stack_table[slot].count = 1;
+  frame_pool_used += depth;
+  num_stacks++;
+}
+
+void profile_stop(void) {
+  struct itimerval off = {0};
+  setitimer(ITIMER_PROF, &off, NULL);
+  signal(SIGPROF, SIG_IGN);
+}
+
+// one line per distinct stack, outermost frame first:
+//   <module>:12;fib:3;fib:4 57
+static void profile_write(void) {
+  profile_stop();
+
+  FILE *f = fopen(profile_path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "profile: can't write %s\n", profile_path);
+    return;
+  }
+  for (int slot=0; slot<PROFILE_TABLE_SIZE; slot++) {
+    ProfileStack *entry = &stack_table[slot];
+    if (entry->count == 0) {
+      continue;
+    }
+    for (int i=entry->depth-1; i>=0; i--) {
+      ProfileFrame *frame = &frame_pool[entry->start + i];
+      fprintf(f, "%s:%d%s", frame->code->name, frame->line, i > 0 ? ";" : "");
+    }
+    fprintf(f, " %ld\n", entry->count);
+  }
+  fclose(f);
+  fprintf(stderr, "profile: %ld samples, %d stacks written to %s", num_samples, num_stacks, profile_path);
+  if (dropped_samples > 0) {
+    fprintf(stderr, " (%ld dropped)", dropped_samples);
+  }
+  fprintf(stderr, "\n");
+}
+
+void profile_start(PyState *state, const char *path, int hz) {
+  profiled_state = state;
+  profile_path = path;
+  // NOTE: untouched pages of these are never faulted in
+  frame_pool = calloc(PROFILE_POOL_SIZE, sizeof(ProfileFrame));
+  stack_table = calloc(PROFILE_TABLE_SIZE, sizeof(ProfileStack));
+  if (frame_pool == NULL || stack_table == NULL) {
+    printf("MemoryError\n");
+    exit(1);
+  }
+  atexit(profile_write);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = profile_sample;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, NULL);
+
+  struct itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = 1000000 / hz;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, NULL);
+}
@@ -0,0 +1,11 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "frame.h"
+
+// sample `state`'s frame chain `hz` times per second of CPU time and write
+// collapsed stacks (flamegraph.pl / speedscope format) to `path` at exit
+void profile_start(PyState *state, const char *path, int hz);
+void profile_stop(void); // stop sampling - call before `state` goes away
+
+#endif
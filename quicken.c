@@ -0,0 +1,92 @@
+#include <stdlib.h>
+
+#include "quicken.h"
+#include "parser.h"
+#include "int.h"
+#include "bytes.h"
+
+// NOTE: adaptive specialisation ("quickening"), after CPython 3.11. a
+// generic BINARY_OP counts its executions, and once it's warm looks at the
+// operands it's about to run on. if there's a specialised form for their
+// types the instruction is rewritten in place - the bytecode slot is
+// pointed at the specialised instruction's string. specialised forms
+// check their types before taking the fast path, and on a miss rewrite
+// themselves back to the generic form. failed attempts and deopts double
+// the wait before the next attempt, so type-unstable instructions settle
+// down to costing a counter decrement
+
+typedef struct {
+  OpCode opcode;
+  const char *input; // what's written into the bytecode
+  const char *generic; // ... and what's written back on a deopt
+} Specialisation;
+
+static const Specialisation specialisations[] = {
+  { OP_BINARY_ADD_INT, "BINARY_ADD_INT", "BINARY_OP,0" },
+  { OP_BINARY_ADD_BYTES, "BINARY_ADD_BYTES", "BINARY_OP,0" },
+  { OP_BINARY_MULT_BYTES_INT, "BINARY_MULT_BYTES_INT", "BINARY_OP,2" },
+};
+
+static const int num_specialisations = sizeof(specialisations) / sizeof(specialisations[0]);
+
+static OpCode specialise(int bin_op, PyObject *a, PyObject *b) {
+  switch (bin_op) {
+    case ADD:
+      if (a->type == &py_type_int && b->type == &py_type_int)
+        return OP_BINARY_ADD_INT;
+      if (a->type == &py_type_bytes && b->type == &py_type_bytes)
+        return OP_BINARY_ADD_BYTES;
+      break;
+    case MULT:
+      if (a->type == &py_type_bytes && b->type == &py_type_int)
+        return OP_BINARY_MULT_BYTES_INT;
+      break;
+  }
+  return OP_UNKNOWN;
+}
+
+static QuickenCounter *counters(PyCodeObject *code) {
+  if (code->quicken == NULL) {
+    int n = 0;
+    while (code->bytecode[n] != NULL) n++;
+    code->quicken = malloc(n * sizeof(QuickenCounter));
+    for (int i=0; i<n; i++) {
+      code->quicken[i].countdown = QUICKEN_WARMUP;
+      code->quicken[i].backoff = 0;
+    }
+  }
+  return code->quicken;
+}
+
+static void back_off(QuickenCounter *counter) {
+  if (counter->backoff < QUICKEN_MAX_BACKOFF) {
+    counter->backoff++;
+  }
+  counter->countdown = (1 << counter->backoff) - 1;
+}
+
+void quicken_binary_op(PyCodeObject *code, int offset, int bin_op, PyObject *a, PyObject *b) {
+  QuickenCounter *counter = &counters(code)[offset];
+  if (counter->countdown > 0) {
+    counter->countdown--;
+    return;
+  }
+  OpCode opcode = specialise(bin_op, a, b);
+  for (int i=0; i<num_specialisations; i++) {
+    if (specialisations[i].opcode == opcode) {
+      code->bytecode[offset] = (char *) specialisations[i].input;
+      return;
+    }
+  }
+  back_off(counter);
+}
+
+void quicken_deopt(PyCodeObject *code, int offset, OpCode opcode) {
+  for (int i=0; i<num_specialisations; i++) {
+    if (specialisations[i].opcode == opcode) {
+      code->bytecode[offset] = (char *) specialisations[i].generic;
+      break;
+    }
+  }
+  back_off(&counters(code)[offset]);
+}
@@ -0,0 +1,22 @@
+#ifndef QUICKEN_H
+#define QUICKEN_H
+
+#include "type.h"
+#include "opcode.h"
+
+#define QUICKEN_WARMUP 8 // generic executions before the first attempt
+#define QUICKEN_MAX_BACKOFF 12 // at most 2^12 executions between attempts
+
+// one per instruction, allocated the first time a code object quickens
+typedef struct QuickenCounter {
+  unsigned short countdown; // executions until the next attempt
+  unsigned short backoff; // failed attempts and deopts so far, capped
+} QuickenCounter;
+
+// a generic BINARY_OP at `offset` is about to run on a and b - after enough
+// executions this rewrites it to a specialised form for their types
+void quicken_binary_op(PyCodeObject *code, int offset, int bin_op, PyObject *a, PyObject *b);
+// a specialised instruction's type guard failed - put the generic form back
+void quicken_deopt(PyCodeObject *code, int offset, OpCode opcode);
+
+#endif
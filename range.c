@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "range.h"
+#include "type.h"
+#include "int.h"
+#include "error.h"
+
+PyTypeObject py_type_range_iterator = {
+  .base = { .type = &py_type_type },
+  .name = "range_iterator",
+  .basic_size = sizeof(PyRangeIterObject),
+  .item_size = 0,
+  .methods = NULL
+};
+
+static long long range_arg(PyObject *arg) {
+  if (arg->type != &py_type_int) {
+    py_error("TypeError: '%s' object cannot be interpreted as an integer", arg->type->name);
+  }
+  return py_int_as_long(arg);
+}
+
+PyObject *py_range_iter_new(PyObject *const *args, int nargs) {
+  PyRangeIterObject *result = (PyRangeIterObject *) py_type_alloc(&py_type_range_iterator);
+  result->next = 0;
+  result->step = 1;
+  if (nargs == 1) {
+    result->stop = range_arg(args[0]);
+  } else {
+    result->next = range_arg(args[0]);
+    result->stop = range_arg(args[1]);
+    if (nargs == 3) {
+      result->step = range_arg(args[2]);
+    }
+  }
+  if (result->step == 0) {
+    py_error("ValueError: range() arg 3 must not be zero");
+  }
+  return (PyObject *) result;
+}
+
+int py_range_iter_next(PyObject *iter, long long *value) {
+  PyRangeIterObject *range = (PyRangeIterObject *) iter;
+  if (range->step > 0 ? range->next >= range->stop : range->next <= range->stop) {
+    return 0;
+  }
+  *value = range->next;
+  // NOTE: stop once we'd step past LLONG_MAX/MIN rather than wrap around
+  if (__builtin_add_overflow(range->next, range->step, &range->next)) {
+    range->next = range->stop;
+  }
+  return 1;
+}
@@ -0,0 +1,12 @@
+#ifndef RANGE_H
+#define RANGE_H
+
+#include "type.h"
+
+extern PyTypeObject py_type_range_iterator;
+
+// range(stop), range(start, stop) or range(start, stop, step) - ints only
+PyObject *py_range_iter_new(PyObject *const *args, int nargs);
+int py_range_iter_next(PyObject *iter, long long *value); // 0 when exhausted
+
+#endif
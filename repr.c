@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "repr.h"
+#include "type.h"
+#include "int.h"
+#include "bool.h"
+#include "bytes.h"
+#include "dict.h"
+#include "list.h"
+
+// NOTE: a container that (indirectly) holds itself prints as {...} or [...]
+// where it comes round again, as in python - these are the ones we're inside
+#define MAX_REPR_DEPTH 64
+
+typedef struct {
+  PyObject *objects[MAX_REPR_DEPTH];
+  int depth;
+} ReprStack;
+
+static void repr(Writer *w, PyObject *obj, ReprStack *stack);
+
+static void write_chunk(const char *data, int size, void *arg) {
+  writer_write(arg, data, size);
+}
+
+static void int_str(Writer *w, PyIntObject *n) {
+  if (n->digits == NULL) {
+    writer_long(w, n->value);
+  } else {
+    char *formatted = py_int_format((PyObject *) n);
+    writer_puts(w, formatted);
+    free(formatted);
+  }
+}
+
+// quoted as python would: '...' unless that needs more escaping than "..."
+static void bytes_repr(Writer *w, PyObject *obj) {
+  int size = ((PyBytesObject *) obj)->size;
+  const char *data = py_bytes_data(obj);
+  char quote = memchr(data, '\'', size) != NULL && memchr(data, '"', size) == NULL ? '"' : '\'';
+  writer_write(w, &quote, 1);
+  for (int i=0; i<size; i++) {
+    char c = data[i];
+    if (c == quote || c == '\\') {
+      writer_write(w, "\\", 1);
+      writer_write(w, &c, 1);
+    } else if (c == '\n') {
+      writer_puts(w, "\\n");
+    } else if (c == '\t') {
+      writer_puts(w, "\\t");
+    } else if (c == '\r') {
+      writer_puts(w, "\\r");
+    } else {
+      writer_write(w, &c, 1);
+    }
+  }
+  writer_write(w, &quote, 1);
+}
+
+// 0 (having written `placeholder`) if we're already inside `obj`
+static int repr_enter(Writer *w, PyObject *obj, ReprStack *stack, const char *placeholder) {
+  for (int i=0; i<stack->depth; i++) {
+    if (stack->objects[i] == obj) {
+      writer_puts(w, placeholder);
+      return 0;
+    }
+  }
+  if (stack->depth == MAX_REPR_DEPTH) {
+    writer_puts(w, placeholder);
+    return 0;
+  }
+  stack->objects[stack->depth++] = obj;
+  return 1;
+}
+
+static void dict_repr(Writer *w, PyObject *obj, ReprStack *stack) {
+  if (!repr_enter(w, obj, stack, "{...}")) {
+    return;
+  }
+  HashTable *table = &((PyDictObject *) obj)->table;
+  int pos = 0;
+  Entry *entry;
+  writer_puts(w, "{");
+  for (int first = 1; hashtable_next(table, &pos, &entry); first = 0) {
+    if (!first) {
+      writer_puts(w, ", ");
+    }
+    repr(w, entry->key, stack);
+    writer_puts(w, ": ");
+    repr(w, entry->object, stack);
+  }
+  writer_puts(w, "}");
+  stack->depth--;
+}
+
+static void list_repr(Writer *w, PyObject *obj, ReprStack *stack) {
+  if (!repr_enter(w, obj, stack, "[...]")) {
+    return;
+  }
+  PyListObject *list = (PyListObject *) obj;
+  writer_puts(w, "[");
+  for (int i=0; i<list->size; i++) {
+    if (i > 0) {
+      writer_puts(w, ", ");
+    }
+    repr(w, list->items[i], stack);
+  }
+  writer_puts(w, "]");
+  stack->depth--;
+}
+
+static void repr(Writer *w, PyObject *obj, ReprStack *stack) {
+  if (obj->type == &py_type_int) {
+    int_str(w, (PyIntObject *) obj);
+  } else if (obj->type == &py_type_bool) {
+    writer_puts(w, ((PyBoolObject *) obj)->value ? "True" : "False");
+  } else if (obj->type == &py_type_bytes) {
+    bytes_repr(w, obj);
+  } else if (obj->type == &py_type_dict) {
+    dict_repr(w, obj, stack);
+  } else if (obj->type == &py_type_list) {
+    list_repr(w, obj, stack);
+  } else {
+    writer_printf(w, "<%s object at %p>", obj->type->name, (void *) obj);
+  }
+}
+
+void py_object_str(Writer *w, PyObject *obj) {
+  if (obj->type == &py_type_bytes) {
+    // NOTE: ropes are written leaf by leaf rather than flattened
+    py_bytes_for_each_chunk(obj, write_chunk, w);
+  } else {
+    py_object_repr(w, obj);
+  }
+}
+
+void py_object_repr(Writer *w, PyObject *obj) {
+  ReprStack stack;
+  stack.depth = 0;
+  repr(w, obj, &stack);
+}
+
+void py_object_repr_buffer(PyObject *obj, char *buffer, int size) {
+  Writer w;
+  writer_init_capture(&w, size, size - 1);
+  py_object_repr(&w, obj);
+  memcpy(buffer, w.data, w.length);
+  buffer[w.length] = '\0';
+  writer_free(&w);
+}
@@ -0,0 +1,14 @@
+#ifndef REPR_H
+#define REPR_H
+
+#include "hash-table.h"
+#include "writer.h"
+
+// formatting objects as text: str() is what print() writes, repr() is how
+// an object looks inside a container or an error message ('quoted' strs)
+void py_object_str(Writer *w, PyObject *obj);
+void py_object_repr(Writer *w, PyObject *obj);
+// repr() into a buffer, cut short if it doesn't fit
+void py_object_repr_buffer(PyObject *obj, char *buffer, int size);
+
+#endif
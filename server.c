@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "writer.h"
+
+// NOTE: each worker thread has its own interpreter and its own script
+// cache. a request runs with fresh globals (py_interp_reset), but its code
+// object comes from the cache when the same script was seen before - and
+// since quickening and the JIT rewrite code objects as they run, the cache
+// can't be shared between workers. a replaced entry's code isn't freed
+// (nothing is, yet)
+
+#define SERVE_CACHE_SIZE 64 // scripts per worker, direct-mapped
+#define SERVE_HEADER_SIZE 32
+
+typedef struct {
+  unsigned long long hash; // of the source
+  char *source;
+  int length;
+  PyCodeObject *code;
+} CacheEntry;
+
+// where requests come from: stdin (shared by every worker) or one
+// connection on the socket
+typedef struct {
+  FILE *in;
+  int out_fd;
+  pthread_mutex_t in_lock;
+  pthread_mutex_t out_lock;
+  long next_seq;
+  int closed; // at EOF, or lost track of where requests start
+} Stream;
+
+typedef struct {
+  PyInterp *interp;
+  CacheEntry cache[SERVE_CACHE_SIZE];
+  Stream *stream; // stdin, or NULL to accept connections
+  int listen_fd;
+  pthread_t thread;
+} Worker;
+
+static void stream_init(Stream *stream, FILE *in, int out_fd) {
+  stream->in = in;
+  stream->out_fd = out_fd;
+  pthread_mutex_init(&stream->in_lock, NULL);
+  pthread_mutex_init(&stream->out_lock, NULL);
+  stream->next_seq = 0;
+  stream->closed = 0;
+}
+
+static void stream_destroy(Stream *stream) {
+  pthread_mutex_destroy(&stream->in_lock);
+  pthread_mutex_destroy(&stream->out_lock);
+}
+
+// FNV-1a
+static unsigned long long hash_source(const char *source, int length) {
+  unsigned long long h = 14695981039346656037ULL;
+  for (int i=0; i<length; i++) {
+    h = (h ^ (unsigned char) source[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+// the script's code, compiling it on a miss. takes ownership of `source`.
+// NULL on a syntax error (which isn't cached)
+static PyCodeObject *cached_compile(Worker *worker, char *source, int length) {
+  unsigned long long h = hash_source(source, length);
+  CacheEntry *entry = &worker->cache[h % SERVE_CACHE_SIZE];
+  if (entry->code != NULL && entry->hash == h && entry->length == length
+      && memcmp(entry->source, source, length) == 0) {
+    free(source);
+    return entry->code;
+  }
+  PyCodeObject *code = py_interp_compile(worker->interp, source);
+  if (code == NULL) {
+    free(source);
+    return NULL;
+  }
+  free(entry->source);
+  entry->hash = h;
+  entry->source = source;
+  entry->length = length;
+  entry->code = code;
+  return code;
+}
+
+// the next request's script, NUL-terminated, or NULL at EOF. *length is -1
+// if the request is malformed - there's no finding the next one after that
+static char *read_request(Stream *stream, int *length) {
+  char header[SERVE_HEADER_SIZE];
+  *length = 0;
+  if (stream->closed) {
+    return NULL;
+  }
+  stream->closed = 1;
+  if (fgets(header, sizeof(header), stream->in) == NULL) {
+    return NULL;
+  }
+  char *end;
+  long size = strtol(header, &end, 10);
+  if (end == header || *end != '\n' || size < 0 || size > SERVE_MAX_SCRIPT) {
+    *length = -1;
+    return NULL;
+  }
+  char *source = malloc(size + 1);
+  if (fread(source, 1, size, stream->in) != (size_t) size) {
+    free(source);
+    *length = -1;
+    return NULL;
+  }
+  source[size] = '\0';
+  *length = size;
+  stream->closed = 0;
+  return source;
+}
+
+// `error` (if not NULL) goes on its own line after the output - as on the
+// command line
+static void write_response(Stream *stream, long seq, const char *output, int length, const char *error) {
+  int error_length = error != NULL ? strlen(error) + 1 : 0;
+  Writer out;
+  writer_init(&out, stream->out_fd, SERVE_HEADER_SIZE * 2);
+  writer_printf(&out, "%ld %d %d\n", seq, error != NULL, length + error_length);
+  writer_write(&out, output, length);
+  if (error != NULL) {
+    writer_puts(&out, error);
+    writer_write(&out, "\n", 1);
+  }
+  pthread_mutex_lock(&stream->out_lock);
+  writer_flush(&out);
+  pthread_mutex_unlock(&stream->out_lock);
+  free(out.data);
+}
+
+// answer requests until the stream ends
+static void serve_stream(Worker *worker, Stream *stream) {
+  PyInterp *interp = worker->interp;
+  while (1) {
+    int length;
+    pthread_mutex_lock(&stream->in_lock);
+    char *source = read_request(stream, &length);
+    long seq = stream->next_seq++;
+    pthread_mutex_unlock(&stream->in_lock);
+    if (source == NULL) {
+      if (length < 0) {
+        write_response(stream, seq, "", 0, "error: bad request");
+      }
+      return;
+    }
+
+    py_interp_reset(interp);
+    PyCodeObject *code = cached_compile(worker, source, length);
+    int failed = code == NULL || py_interp_exec(interp, code) != 0;
+    int output_length;
+    const char *output = py_interp_output(interp, &output_length);
+    write_response(stream, seq, output, output_length, failed ? py_interp_error(interp) : NULL);
+  }
+}
+
+static void *worker_main(void *arg) {
+  Worker *worker = arg;
+  if (worker->stream != NULL) {
+    serve_stream(worker, worker->stream);
+    return NULL;
+  }
+  while (1) {
+    int fd = accept(worker->listen_fd, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    Stream stream;
+    stream_init(&stream, fdopen(fd, "r"), fd);
+    serve_stream(worker, &stream);
+    fclose(stream.in);
+    stream_destroy(&stream);
+  }
+  return NULL;
+}
+
+static int listen_on(const char *path) {
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    printf("error: socket path too long: %s\n", path);
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+    perror(path);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int serve(const ServeConfig *serve_config, const PyInterpConfig *config) {
+  // a client hanging up shows up as a failed write, not a signal
+  signal(SIGPIPE, SIG_IGN);
+
+  Stream stdin_stream;
+  int listen_fd = -1;
+  if (serve_config->socket_path != NULL) {
+    listen_fd = listen_on(serve_config->socket_path);
+    if (listen_fd < 0) {
+      return 1;
+    }
+  } else {
+    stream_init(&stdin_stream, stdin, STDOUT_FILENO);
+  }
+
+  PyInterpConfig worker_config = *config;
+  worker_config.out_fd = -1;
+  int num_workers = serve_config->workers;
+  Worker *workers = calloc(num_workers, sizeof(Worker));
+  for (int i=0; i<num_workers; i++) {
+    workers[i].interp = py_interp_new(&worker_config);
+    workers[i].stream = listen_fd < 0 ? &stdin_stream : NULL;
+    workers[i].listen_fd = listen_fd;
+    pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+  }
+  for (int i=0; i<num_workers; i++) {
+    pthread_join(workers[i].thread, NULL);
+    py_interp_free(workers[i].interp);
+    for (int j=0; j<SERVE_CACHE_SIZE; j++) {
+      free(workers[i].cache[j].source);
+    }
+  }
+  free(workers);
+  if (listen_fd < 0) {
+    stream_destroy(&stdin_stream);
+  }
+  return 0;
+}
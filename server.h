@@ -0,0 +1,35 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "interp.h"
+
+// --serve: keep interpreters warm and run scripts on request, so a job
+// runner doesn't pay for a process (and a compile) per script
+//
+// a request is a decimal byte count and a newline, then the script:
+//
+//     21\n
+//     print(6 * 7)\n ...
+//
+// the response is "<seq> <status> <length>\n" then that many bytes - seq
+// counts requests on the stream from 0, status is 0 or 1 like our exit
+// code, and the bytes are what the command line would have printed (the
+// script's output, then the error message if it failed). with more than
+// one worker on stdin, responses can come back out of order - match seq
+
+#define SERVE_WORKERS 4
+#define SERVE_TIMEOUT_MS 10000
+#define SERVE_MAX_OUTPUT (1024 * 1024)
+#define SERVE_MAX_SCRIPT (16 * 1024 * 1024)
+
+typedef struct {
+  const char *socket_path; // NULL to serve stdin/stdout
+  int workers;
+} ServeConfig;
+
+// `config` is what each worker's interpreter gets - its timeout_ms and
+// output_limit are the per-request limits. returns at EOF on stdin; on a
+// socket, only if it can't listen
+int serve(const ServeConfig *serve_config, const PyInterpConfig *config);
+
+#endif
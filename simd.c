@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "simd.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// NOTE: find uses the first and last bytes of the needle as a filter - a
+// vector compare of each against a block of the haystack (the last-byte
+// block shifted along by m - 1) gives a mask of the starts where both
+// match, and only those get a full compare. it's rare for both to match by
+// accident, so long haystacks go by a block at a time.
+//
+// SSE2 is part of x86-64, so it's always there. the AVX2 kernels are built
+// for AVX2 with a target attribute - the rest of the binary isn't - and only
+// get called if the CPU has it
+
+static const char *level_names[NUM_SIMD_LEVELS] = {
+  "scalar",
+  "sse2",
+  "avx2"
+};
+
+// SCALAR
+
+static size_t mismatch_scalar(const char *a, const char *b, size_t n) {
+  size_t i = 0;
+  while (i < n && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+static long find_scalar(const char *haystack, size_t n, const char *needle, size_t m) {
+  if (m == 0) {
+    return 0;
+  }
+  for (size_t i=0; i + m <= n; i++) {
+    if (haystack[i] == needle[0] && mismatch_scalar(haystack + i + 1, needle + 1, m - 1) == m - 1) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static size_t count_byte_scalar(const char *haystack, size_t n, char c) {
+  size_t count = 0;
+  for (size_t i=0; i<n; i++) {
+    count += haystack[i] == c;
+  }
+  return count;
+}
+
+// the scalar kernels finish off whatever's left after the last full block
+static long find_rest(const char *haystack, size_t n, size_t i, const char *needle, size_t m) {
+  long rest = find_scalar(haystack + i, n - i, needle, m);
+  return rest < 0 ? -1 : (long) i + rest;
+}
+
+#if defined(__x86_64__)
+
+// SSE2 - 16 bytes at a time
+
+static size_t mismatch_sse2(const char *a, const char *b, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xffff;
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + mismatch_scalar(a + i, b + i, n - i);
+}
+
+static long find_byte_sse2(const char *haystack, size_t n, char c) {
+  __m128i vc = _mm_set1_epi8(c);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *) (haystack + i));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, vc));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return find_rest(haystack, n, i, &c, 1);
+}
+
+static long find_sse2(const char *haystack, size_t n, const char *needle, size_t m) {
+  if (m == 0) {
+    return 0;
+  } else if (m == 1) {
+    return find_byte_sse2(haystack, n, needle[0]);
+  }
+  __m128i first = _mm_set1_epi8(needle[0]);
+  __m128i last = _mm_set1_epi8(needle[m - 1]);
+  size_t i = 0;
+  for (; i + m - 1 + 16 <= n; i += 16) {
+    __m128i block_first = _mm_loadu_si128((const __m128i *) (haystack + i));
+    __m128i block_last = _mm_loadu_si128((const __m128i *) (haystack + i + m - 1));
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                                    _mm_cmpeq_epi8(last, block_last)));
+    while (mask != 0) {
+      int bit = __builtin_ctz(mask);
+      if (memcmp(haystack + i + bit + 1, needle + 1, m - 2) == 0) {
+        return i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return find_rest(haystack, n, i, needle, m);
+}
+
+static size_t count_byte_sse2(const char *haystack, size_t n, char c) {
+  __m128i vc = _mm_set1_epi8(c);
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *) (haystack + i));
+    count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(block, vc)));
+  }
+  return count + count_byte_scalar(haystack + i, n - i, c);
+}
+
+// AVX2 - 32 bytes at a time, same shape as SSE2
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static size_t mismatch_avx2(const char *a, const char *b, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+    unsigned mask = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + mismatch_sse2(a + i, b + i, n - i);
+}
+
+AVX2 static long find_byte_avx2(const char *haystack, size_t n, char c) {
+  __m256i vc = _mm256_set1_epi8(c);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *) (haystack + i));
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, vc));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return find_rest(haystack, n, i, &c, 1);
+}
+
+AVX2 static long find_avx2(const char *haystack, size_t n, const char *needle, size_t m) {
+  if (m == 0) {
+    return 0;
+  } else if (m == 1) {
+    return find_byte_avx2(haystack, n, needle[0]);
+  }
+  __m256i first = _mm256_set1_epi8(needle[0]);
+  __m256i last = _mm256_set1_epi8(needle[m - 1]);
+  size_t i = 0;
+  for (; i + m - 1 + 32 <= n; i += 32) {
+    __m256i block_first = _mm256_loadu_si256((const __m256i *) (haystack + i));
+    __m256i block_last = _mm256_loadu_si256((const __m256i *) (haystack + i + m - 1));
+    unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                                                          _mm256_cmpeq_epi8(last, block_last)));
+    while (mask != 0) {
+      int bit = __builtin_ctz(mask);
+      if (memcmp(haystack + i + bit + 1, needle + 1, m - 2) == 0) {
+        return i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return find_rest(haystack, n, i, needle, m);
+}
+
+AVX2 static size_t count_byte_avx2(const char *haystack, size_t n, char c) {
+  __m256i vc = _mm256_set1_epi8(c);
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *) (haystack + i));
+    count += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, vc)));
+  }
+  return count + count_byte_scalar(haystack + i, n - i, c);
+}
+
+#endif
+
+// DISPATCH
+
+typedef struct {
+  size_t (*mismatch)(const char *a, const char *b, size_t n);
+  long (*find)(const char *haystack, size_t n, const char *needle, size_t m);
+  size_t (*count_byte)(const char *haystack, size_t n, char c);
+} Kernels;
+
+static const Kernels kernels[NUM_SIMD_LEVELS] = {
+  [SIMD_SCALAR] = { mismatch_scalar, find_scalar, count_byte_scalar },
+#if defined(__x86_64__)
+  [SIMD_SSE2] = { mismatch_sse2, find_sse2, count_byte_sse2 },
+  [SIMD_AVX2] = { mismatch_avx2, find_avx2, count_byte_avx2 },
+#endif
+};
+
+static SimdLevel best_level = SIMD_SCALAR;
+static const Kernels *active = &kernels[SIMD_SCALAR];
+
+// NOTE: runs before main(), so the choice is made before any thread
+// (--serve's workers) can call a kernel
+__attribute__((constructor)) static void simd_init(void) {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  best_level = __builtin_cpu_supports("avx2") ? SIMD_AVX2 : SIMD_SSE2;
+#endif
+  active = &kernels[best_level];
+}
+
+int simd_set_level(const char *name) {
+  for (int level=0; level<=best_level; level++) {
+    if (strcmp(name, level_names[level]) == 0) {
+      active = &kernels[level];
+      return 0;
+    }
+  }
+  return -1;
+}
+
+size_t simd_mismatch(const char *a, const char *b, size_t n) {
+  return active->mismatch(a, b, n);
+}
+
+long simd_find(const char *haystack, size_t n, const char *needle, size_t m) {
+  if (m > n) {
+    return -1;
+  }
+  return active->find(haystack, n, needle, m);
+}
+
+size_t simd_count(const char *haystack, size_t n, const char *needle, size_t m) {
+  if (m == 1) {
+    return active->count_byte(haystack, n, needle[0]);
+  }
+  size_t count = 0;
+  size_t i = 0;
+  long found;
+  while ((found = simd_find(haystack + i, n - i, needle, m)) >= 0) {
+    count++;
+    i += found + m;
+  }
+  return count;
+}
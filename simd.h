@@ -0,0 +1,28 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stddef.h>
+
+// byte-string kernels for bytes.c. each has an AVX2, an SSE2 and a plain C
+// version - the best one this CPU can run is picked once at startup (see
+// simd.c). they work on flat data, so ropes are flattened first
+
+typedef enum {
+  SIMD_SCALAR,
+  SIMD_SSE2,
+  SIMD_AVX2,
+  NUM_SIMD_LEVELS
+} SimdLevel;
+
+// --simd=NAME: use a lower level than the CPU supports (to compare them).
+// -1 if NAME isn't a level this CPU has. call before any threads start
+int simd_set_level(const char *name);
+
+// index of the first byte where a and b differ, n if they don't
+size_t simd_mismatch(const char *a, const char *b, size_t n);
+// first index of needle in haystack, -1 if it isn't there (0 if m == 0)
+long simd_find(const char *haystack, size_t n, const char *needle, size_t m);
+// non-overlapping occurrences of needle, m > 0
+size_t simd_count(const char *haystack, size_t n, const char *needle, size_t m);
+
+#endif
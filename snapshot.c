@@ -0,0 +1,503 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "interp.h"
+#include "type.h"
+#include "int.h"
+#include "bool.h"
+#include "bytes.h"
+#include "tuple.h"
+#include "range.h"
+#include "func.h"
+#include "code.h"
+#include "cfunc.h"
+#include "memo.h"
+#include "dict.h"
+#include "list.h"
+
+// NOTE: an image is a header, then a blob holding every object and array
+// the globals reach (laid out as they are in memory, 8-byte aligned), then
+// a list of fixups - the blob offsets of every pointer in it. in the file a
+// pointer is a "ref": the blob offset of what it points at, or for a static
+// object (id << 3) | 1. loading maps the file privately and rewrites each
+// ref in place into a real pointer, and that's all - nothing is copied,
+// so startup cost depends on how many pointers there are, not on running
+// the script that made them. the mapping is never unmapped (nothing is
+// freed, yet)
+//
+// code objects go in fresh: no JIT code, no quickening counters, not
+// hot. --jit and quickening start over with them
+
+#define SNAPSHOT_MAGIC "spysnap"
+#define SNAPSHOT_VERSION 3 // for shape changes layout_hash can't see
+#define SNAPSHOT_MAX_STATICS 64
+#define SNAPSHOT_STATIC_TAG 1
+
+typedef unsigned long long Ref;
+
+typedef struct {
+  char magic[8];
+  unsigned int version;
+  unsigned int layout; // see layout_hash
+  unsigned long long blob_size;
+  unsigned long long num_fixups;
+  unsigned long long globals; // blob offset of (name, value) ref pairs
+  unsigned long long num_globals;
+} SnapshotHeader;
+
+// objects that aren't copied, just referred to - the same list on both
+// sides, so the ids match as long as it's the same binary
+static int static_objects(PyObject **objects) {
+  int n = 0;
+  PyTypeObject *types[] = {
+    &py_type_type, &py_type_int, &py_type_bool, &py_type_bytes, &py_type_tuple,
+    &py_type_range_iterator, &py_type_func, &py_type_code, &py_type_cfunc, &py_type_memo,
+    &py_type_dict, &py_type_list,
+  };
+  for (int i=0; i<sizeof(types) / sizeof(types[0]); i++) {
+    objects[n++] = (PyObject *) types[i];
+  }
+  objects[n++] = (PyObject *) &py_true;
+  objects[n++] = (PyObject *) &py_false;
+  objects[n++] = py_bytes_empty();
+  objects[n++] = py_tuple_new(0);
+  int num_builtins;
+  const PyCFuncObject *builtins = py_interp_builtins(&num_builtins);
+  for (int i=0; i<num_builtins; i++) {
+    objects[n++] = (PyObject *) &builtins[i];
+  }
+  return n;
+}
+
+// changes if an object we copy changes shape
+static unsigned int layout_hash(int num_statics) {
+  unsigned int sizes[] = {
+    sizeof(PyIntObject), sizeof(PyBytesObject), sizeof(PyTupleObject), sizeof(PyRangeIterObject),
+    sizeof(PyFuncObject), sizeof(PyCodeObject), sizeof(PyMemoObject), sizeof(MemoEntry),
+    sizeof(PyDictObject), sizeof(Entry), sizeof(PyListObject), NUM_METHOD_SLOTS, num_statics,
+  };
+  unsigned int h = 2166136261u;
+  for (int i=0; i<sizeof(sizes) / sizeof(sizes[0]); i++) {
+    h = (h ^ sizes[i]) * 16777619u;
+  }
+  return h;
+}
+
+// SAVING
+
+typedef struct {
+  char *data; // the blob
+  size_t length;
+  size_t size;
+  unsigned long long *fixups;
+  size_t num_fixups;
+  size_t fixups_size;
+  // objects already copied: pointer -> blob offset, open addressing
+  PyObject **seen;
+  Ref *seen_at;
+  size_t seen_mask;
+  size_t num_seen;
+  PyObject *statics[SNAPSHOT_MAX_STATICS];
+  int num_statics;
+  const char *error; // first thing we couldn't copy
+} Snapshot;
+
+// NOTE: the blob moves as it grows - only ever hold offsets into it
+#define AT(snap, offset, T) ((T *) ((snap)->data + (offset)))
+
+// zeroed, 8-byte aligned space in the blob
+static size_t reserve(Snapshot *snap, size_t size) {
+  size_t offset = snap->length;
+  size = (size + 7) & ~(size_t) 7;
+  if (offset + size > snap->size) {
+    while (offset + size > snap->size) snap->size *= 2;
+    snap->data = realloc(snap->data, snap->size);
+  }
+  memset(snap->data + offset, 0, size);
+  snap->length += size;
+  return offset;
+}
+
+// store a ref at `offset`, remembering it for the loader to fix up
+static void set_ref(Snapshot *snap, size_t offset, Ref ref) {
+  *AT(snap, offset, Ref) = ref;
+  if (ref == 0) {
+    return;
+  }
+  if (snap->num_fixups == snap->fixups_size) {
+    snap->fixups_size *= 2;
+    snap->fixups = realloc(snap->fixups, snap->fixups_size * sizeof(unsigned long long));
+  }
+  snap->fixups[snap->num_fixups++] = offset;
+}
+
+static Ref put_data(Snapshot *snap, const void *data, size_t size) {
+  if (data == NULL) {
+    return 0;
+  }
+  size_t offset = reserve(snap, size);
+  memcpy(snap->data + offset, data, size);
+  return offset;
+}
+
+static Ref put_string(Snapshot *snap, const char *s) {
+  return s != NULL ? put_data(snap, s, strlen(s) + 1) : 0;
+}
+
+static size_t seen_slot(Snapshot *snap, PyObject *obj) {
+  size_t slot = ((size_t) obj >> 3) & snap->seen_mask;
+  while (snap->seen[slot] != NULL && snap->seen[slot] != obj) {
+    slot = (slot + 1) & snap->seen_mask;
+  }
+  return slot;
+}
+
+static void mark_seen(Snapshot *snap, PyObject *obj, Ref at) {
+  if (2 * (snap->num_seen + 1) > snap->seen_mask + 1) {
+    PyObject **old = snap->seen;
+    Ref *old_at = snap->seen_at;
+    size_t old_slots = snap->seen_mask + 1;
+    snap->seen_mask = 2 * old_slots - 1;
+    snap->seen = calloc(2 * old_slots, sizeof(PyObject *));
+    snap->seen_at = malloc(2 * old_slots * sizeof(Ref));
+    for (size_t i=0; i<old_slots; i++) {
+      if (old[i] != NULL) {
+        size_t slot = seen_slot(snap, old[i]);
+        snap->seen[slot] = old[i];
+        snap->seen_at[slot] = old_at[i];
+      }
+    }
+    free(old);
+    free(old_at);
+  }
+  size_t slot = seen_slot(snap, obj);
+  snap->seen[slot] = obj;
+  snap->seen_at[slot] = at;
+  snap->num_seen++;
+}
+
+static Ref static_ref(Snapshot *snap, PyObject *obj) {
+  for (int i=0; i<snap->num_statics; i++) {
+    if (snap->statics[i] == obj) {
+      return ((Ref) i << 3) | SNAPSHOT_STATIC_TAG;
+    }
+  }
+  return 0;
+}
+
+// copy the first `size` bytes of an object, its type as a static ref. it's
+// marked as seen before anything it points at is copied, so cycles are fine
+static size_t copy_object(Snapshot *snap, PyObject *obj, size_t size) {
+  size_t offset = reserve(snap, size);
+  memcpy(snap->data + offset, obj, size);
+  mark_seen(snap, obj, offset);
+  set_ref(snap, offset + offsetof(PyObject, type), static_ref(snap, (PyObject *) obj->type));
+  return offset;
+}
+
+static Ref put_object(Snapshot *snap, PyObject *obj);
+
+static size_t put_code(Snapshot *snap, PyCodeObject *code) {
+  int argc = 0;
+  while (code->argnames[argc] != NULL) argc++;
+  size_t offset = copy_object(snap, (PyObject *) code, sizeof(PyCodeObject) + (argc + 1) * sizeof(char *));
+  AT(snap, offset, PyCodeObject)->hotness = 0;
+  AT(snap, offset, PyCodeObject)->jit = NULL;
+  AT(snap, offset, PyCodeObject)->quicken = NULL;
+  AT(snap, offset, PyCodeObject)->inline_version = 0;
+
+  int length = 0;
+  while (code->bytecode[length] != NULL) length++;
+  size_t bytecode = reserve(snap, (length + 1) * sizeof(char *));
+  set_ref(snap, offset + offsetof(PyCodeObject, bytecode), bytecode);
+  for (int i=0; i<length; i++) {
+    set_ref(snap, bytecode + i * sizeof(char *), put_string(snap, code->bytecode[i]));
+  }
+  Ref consts = 0;
+  if (code->num_consts > 0) {
+    consts = reserve(snap, code->num_consts * sizeof(PyObject *));
+  }
+  set_ref(snap, offset + offsetof(PyCodeObject, consts), consts);
+  for (int i=0; i<code->num_consts; i++) {
+    set_ref(snap, consts + i * sizeof(PyObject *), put_object(snap, code->consts[i]));
+  }
+  set_ref(snap, offset + offsetof(PyCodeObject, name), put_string(snap, code->name));
+  set_ref(snap, offset + offsetof(PyCodeObject, linetable), put_data(snap, code->linetable, code->linetable_length));
+  for (int i=0; i<argc; i++) {
+    set_ref(snap, offset + offsetof(PyCodeObject, argnames) + i * sizeof(char *), put_string(snap, code->argnames[i]));
+  }
+  return offset;
+}
+
+// NOTE: in_image is set in the image, so the first grow copies the tables
+// out rather than reallocating them
+static size_t put_memo(Snapshot *snap, PyMemoObject *memo) {
+  size_t offset = copy_object(snap, (PyObject *) memo, sizeof(PyMemoObject));
+  AT(snap, offset, PyMemoObject)->next_memo = NULL;
+  AT(snap, offset, PyMemoObject)->in_image = 1;
+  set_ref(snap, offset + offsetof(PyMemoObject, func), put_object(snap, memo->func));
+  size_t entries = reserve(snap, memo->capacity * sizeof(MemoEntry));
+  memcpy(snap->data + entries, memo->entries, memo->count * sizeof(MemoEntry));
+  set_ref(snap, offset + offsetof(PyMemoObject, entries), entries);
+  for (int i=0; i<memo->count; i++) {
+    size_t entry = entries + i * sizeof(MemoEntry);
+    for (int j=0; j<memo->entries[i].key.nargs; j++) {
+      set_ref(snap, entry + offsetof(MemoEntry, key.args) + j * sizeof(PyObject *), put_object(snap, memo->entries[i].key.args[j]));
+    }
+    set_ref(snap, entry + offsetof(MemoEntry, value), put_object(snap, memo->entries[i].value));
+  }
+  set_ref(snap, offset + offsetof(PyMemoObject, index), put_data(snap, memo->index, (memo->index_mask + 1) * sizeof(int)));
+  return offset;
+}
+
+// NOTE: allocated is 0 in the image, so the first append copies the items
+// out rather than growing them in place
+static size_t put_list(Snapshot *snap, PyListObject *list) {
+  size_t offset = copy_object(snap, (PyObject *) list, sizeof(PyListObject));
+  AT(snap, offset, PyListObject)->allocated = 0;
+  if (list->size == 0) {
+    AT(snap, offset, PyListObject)->items = NULL;
+    return offset;
+  }
+  size_t items = reserve(snap, list->size * sizeof(PyObject *));
+  set_ref(snap, offset + offsetof(PyListObject, items), items);
+  for (int i=0; i<list->size; i++) {
+    set_ref(snap, items + i * sizeof(PyObject *), put_object(snap, list->items[i]));
+  }
+  return offset;
+}
+
+// NOTE: the index and entries go in as they are, so the keys have to hash
+// the same in the process that loads them - ints, bools and strs do, but a
+// key hashed by its address wouldn't. the loaded index lives in the image,
+// so the table knows not to free it when it grows
+static size_t put_dict(Snapshot *snap, PyDictObject *dict) {
+  size_t offset = copy_object(snap, (PyObject *) dict, sizeof(PyDictObject));
+  HashTable *table = &dict->table;
+  if (table->index == NULL) {
+    return offset;
+  }
+  AT(snap, offset, PyDictObject)->table.in_image = 1;
+  size_t index_bytes = (size_t) table->index_size * table->index_width;
+  size_t index = reserve(snap, index_bytes + HASHTABLE_USABLE(table->index_size) * sizeof(Entry));
+  memcpy(snap->data + index, table->index, index_bytes + table->used * sizeof(Entry));
+  set_ref(snap, offset + offsetof(PyDictObject, table.index), index);
+  set_ref(snap, offset + offsetof(PyDictObject, table.entries), index + index_bytes);
+  for (int i=0; i<table->used; i++) {
+    PyObject *key = table->entries[i].key;
+    if (key != NULL && key->type != &py_type_int && key->type != &py_type_bool && key->type != &py_type_bytes) {
+      if (snap->error == NULL) {
+        snap->error = key->type->name;
+      }
+      continue;
+    }
+    size_t entry = index + index_bytes + i * sizeof(Entry);
+    set_ref(snap, entry + offsetof(Entry, key), put_object(snap, key));
+    set_ref(snap, entry + offsetof(Entry, object), put_object(snap, table->entries[i].object));
+  }
+  return offset;
+}
+
+static Ref put_object(Snapshot *snap, PyObject *obj) {
+  if (obj == NULL) {
+    return 0;
+  }
+  Ref ref = static_ref(snap, obj);
+  if (ref != 0) {
+    return ref;
+  }
+  size_t slot = seen_slot(snap, obj);
+  if (snap->seen[slot] == obj) {
+    return snap->seen_at[slot];
+  }
+  size_t offset;
+  PyTypeObject *type = obj->type;
+  if (type == &py_type_int) {
+    PyIntObject *n = (PyIntObject *) obj;
+    offset = copy_object(snap, obj, sizeof(PyIntObject));
+    int num_digits = n->size < 0 ? -n->size : n->size;
+    set_ref(snap, offset + offsetof(PyIntObject, digits), put_data(snap, n->digits, num_digits * sizeof(unsigned int)));
+  } else if (type == &py_type_bytes) {
+    // NOTE: ropes go in flat
+    int size = ((PyBytesObject *) obj)->size;
+    const char *data = py_bytes_data(obj);
+    offset = reserve(snap, sizeof(PyBytesObject) + size + 1);
+    mark_seen(snap, obj, offset);
+    set_ref(snap, offset + offsetof(PyObject, type), static_ref(snap, (PyObject *) type));
+    AT(snap, offset, PyBytesObject)->size = size;
+    memcpy(AT(snap, offset, PyBytesObject)->data, data, size + 1);
+  } else if (type == &py_type_tuple) {
+    PyTupleObject *tuple = (PyTupleObject *) obj;
+    offset = copy_object(snap, obj, sizeof(PyTupleObject) + tuple->size * sizeof(PyObject *));
+    for (int i=0; i<tuple->size; i++) {
+      set_ref(snap, offset + offsetof(PyTupleObject, elements) + i * sizeof(PyObject *), put_object(snap, tuple->elements[i]));
+    }
+  } else if (type == &py_type_range_iterator) {
+    offset = copy_object(snap, obj, sizeof(PyRangeIterObject));
+  } else if (type == &py_type_func) {
+    offset = copy_object(snap, obj, sizeof(PyFuncObject));
+    set_ref(snap, offset + offsetof(PyFuncObject, code), put_object(snap, (PyObject *) ((PyFuncObject *) obj)->code));
+  } else if (type == &py_type_code) {
+    offset = put_code(snap, (PyCodeObject *) obj);
+  } else if (type == &py_type_memo) {
+    offset = put_memo(snap, (PyMemoObject *) obj);
+  } else if (type == &py_type_dict) {
+    offset = put_dict(snap, (PyDictObject *) obj);
+  } else if (type == &py_type_list) {
+    offset = put_list(snap, (PyListObject *) obj);
+  } else {
+    if (snap->error == NULL) {
+      snap->error = type->name;
+    }
+    return 0;
+  }
+  return offset;
+}
+
+static int is_builtin(Snapshot *snap, const char *name, PyObject *value) {
+  return value->type == &py_type_cfunc && static_ref(snap, value) != 0
+    && strcmp(((PyCFuncObject *) value)->name, name) == 0;
+}
+
+int snapshot_save(HashTable *globals, const char *path) {
+  Snapshot snap;
+  snap.size = 4096;
+  snap.data = malloc(snap.size);
+  snap.length = 0;
+  snap.fixups_size = 256;
+  snap.fixups = malloc(snap.fixups_size * sizeof(unsigned long long));
+  snap.num_fixups = 0;
+  snap.seen_mask = 255;
+  snap.seen = calloc(snap.seen_mask + 1, sizeof(PyObject *));
+  snap.seen_at = malloc((snap.seen_mask + 1) * sizeof(Ref));
+  snap.num_seen = 0;
+  snap.num_statics = static_objects(snap.statics);
+  snap.error = NULL;
+  // NOTE: offset 0 would read as NULL, so nothing goes there
+  reserve(&snap, sizeof(Ref));
+
+  // builtins are already in every interpreter's globals
+  int num_globals = 0;
+  int pos = 0;
+  Entry *e;
+  while (hashtable_next(globals, &pos, &e)) {
+    num_globals += !is_builtin(&snap, e->key, e->object);
+  }
+  size_t pairs = reserve(&snap, num_globals * 2 * sizeof(Ref));
+  int k = 0;
+  pos = 0;
+  while (hashtable_next(globals, &pos, &e)) {
+    if (is_builtin(&snap, e->key, e->object)) {
+      continue;
+    }
+    set_ref(&snap, pairs + k * 2 * sizeof(Ref), put_string(&snap, e->key));
+    set_ref(&snap, pairs + (k * 2 + 1) * sizeof(Ref), put_object(&snap, e->object));
+    k++;
+  }
+
+  int status = 0;
+  FILE *f;
+  if (snap.error != NULL) {
+    printf("error: can't snapshot a '%s' object\n", snap.error);
+    status = -1;
+  } else if ((f = fopen(path, "wb")) == NULL) {
+    printf("error: can't write snapshot '%s'\n", path);
+    status = -1;
+  } else {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.layout = layout_hash(snap.num_statics);
+    header.blob_size = snap.length;
+    header.num_fixups = snap.num_fixups;
+    header.globals = pairs;
+    header.num_globals = num_globals;
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(snap.data, 1, snap.length, f);
+    fwrite(snap.fixups, sizeof(unsigned long long), snap.num_fixups, f);
+    if (fclose(f) != 0) {
+      printf("error: can't write snapshot '%s'\n", path);
+      status = -1;
+    }
+  }
+  free(snap.data);
+  free(snap.fixups);
+  free(snap.seen);
+  free(snap.seen_at);
+  return status;
+}
+
+// LOADING
+
+int snapshot_load(HashTable *globals, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("error: can't open snapshot '%s'\n", path);
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(SnapshotHeader)) {
+    printf("error: '%s' isn't a snapshot\n", path);
+    close(fd);
+    return -1;
+  }
+  // NOTE: private, so fixups (and later quickening) don't touch the file
+  char *image = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    printf("error: can't map snapshot '%s'\n", path);
+    return -1;
+  }
+
+  PyObject *statics[SNAPSHOT_MAX_STATICS];
+  int num_statics = static_objects(statics);
+  SnapshotHeader *header = (SnapshotHeader *) image;
+  char *blob = image + sizeof(SnapshotHeader);
+  unsigned long long *fixups = (unsigned long long *) (blob + header->blob_size);
+  if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+      || header->version != SNAPSHOT_VERSION || header->layout != layout_hash(num_statics)
+      || header->blob_size % 8 != 0 || header->blob_size > (unsigned long long) st.st_size
+      || sizeof(SnapshotHeader) + header->blob_size + header->num_fixups * sizeof(unsigned long long) != (unsigned long long) st.st_size
+      || header->globals + header->num_globals * 2 * sizeof(Ref) > header->blob_size) {
+    printf("error: '%s' isn't a snapshot from this build\n", path);
+    munmap(image, st.st_size);
+    return -1;
+  }
+
+  for (unsigned long long i=0; i<header->num_fixups; i++) {
+    unsigned long long at = fixups[i];
+    if (at % 8 != 0 || at >= header->blob_size) {
+      printf("error: snapshot '%s' is corrupt\n", path);
+      return -1;
+    }
+    Ref *slot = (Ref *) (blob + at);
+    Ref ref = *slot;
+    if (ref & SNAPSHOT_STATIC_TAG) {
+      if ((ref >> 3) >= num_statics) {
+        printf("error: snapshot '%s' is corrupt\n", path);
+        return -1;
+      }
+      *(PyObject **) slot = statics[ref >> 3];
+    } else {
+      if (ref >= header->blob_size) {
+        printf("error: snapshot '%s' is corrupt\n", path);
+        return -1;
+      }
+      *(char **) slot = blob + ref;
+    }
+  }
+
+  void **pairs = (void **) (blob + header->globals);
+  for (unsigned long long i=0; i<header->num_globals; i++) {
+    hashtable_insert(globals, pairs[2 * i], pairs[2 * i + 1]);
+  }
+  return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "hash-table.h"
+
+// --snapshot-out/--snapshot-in: save the globals a script left behind (and
+// everything they reach - functions, their code, constants) to an image
+// file, and map that image straight back in at startup instead of running
+// the script again. see snapshot.c for the format
+//
+// an image is only good for the binary that wrote it - it refers to static
+// objects (types, True/False, builtins) by number, and checks that object
+// layouts haven't changed
+
+// both print an "error: ..." line and return -1 if they fail
+int snapshot_save(HashTable *globals, const char *path);
+int snapshot_load(HashTable *globals, const char *path); // adds to globals
+
+#endif
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "stats.h"
+#include "memo.h"
+
+#define STATS_MAX_FUNCTIONS 256
+#define STATS_TOP_PAIRS 10
+
+typedef struct {
+  const char *name;
+  long calls;
+} FunctionStats;
+
+typedef struct {
+  const char *callee;
+  const char *caller;
+  int sites;
+} InlineStats;
+
+int stats_enabled = 0;
+int stats_timing = 0;
+
+static long instruction_count = 0;
+static long opcode_counts[NUM_OPCODES];
+static unsigned long long opcode_ticks[NUM_OPCODES];
+static long pair_counts[NUM_OPCODES][NUM_OPCODES];
+static OpCode previous_opcode = OP_UNKNOWN;
+static FunctionStats functions[STATS_MAX_FUNCTIONS];
+static int num_functions = 0;
+static long other_calls = 0; // once the function table is full
+static long frames_created = 0;
+static long lookups = 0;
+static long probes_total = 0;
+static InlineStats inlined[STATS_MAX_FUNCTIONS];
+static int num_inlined = 0;
+
+// rdtsc where we have it, otherwise nanoseconds
+unsigned long long stats_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+void stats_count_instruction(OpCode opcode) {
+  if (opcode < 0) {
+    return;
+  }
+  instruction_count++;
+  opcode_counts[opcode]++;
+  if (previous_opcode >= 0) {
+    pair_counts[previous_opcode][opcode]++;
+  }
+  previous_opcode = opcode;
+}
+
+void stats_count_call(const char *name, int new_frame) {
+  if (new_frame) {
+    frames_created++;
+  }
+  for (int i=0; i<num_functions; i++) {
+    if (functions[i].name == name || strcmp(functions[i].name, name) == 0) {
+      functions[i].calls++;
+      return;
+    }
+  }
+  if (num_functions == STATS_MAX_FUNCTIONS) {
+    other_calls++;
+    return;
+  }
+  functions[num_functions].name = name;
+  functions[num_functions].calls = 1;
+  num_functions++;
+}
+
+void stats_count_probes(int probes) {
+  lookups++;
+  probes_total += probes;
+}
+
+void stats_count_inline(const char *callee, const char *caller) {
+  for (int i=0; i<num_inlined; i++) {
+    if (strcmp(inlined[i].callee, callee) == 0 && strcmp(inlined[i].caller, caller) == 0) {
+      inlined[i].sites++;
+      return;
+    }
+  }
+  if (num_inlined < STATS_MAX_FUNCTIONS) {
+    inlined[num_inlined].callee = callee;
+    inlined[num_inlined].caller = caller;
+    inlined[num_inlined].sites = 1;
+    num_inlined++;
+  }
+}
+
+void stats_add_time(OpCode opcode, unsigned long long ticks) {
+  if (opcode >= 0) {
+    opcode_ticks[opcode] += ticks;
+  }
+}
+
+static int compare_functions(const void *a, const void *b) {
+  long diff = ((const FunctionStats *) b)->calls - ((const FunctionStats *) a)->calls;
+  return (diff > 0) - (diff < 0);
+}
+
+static void stats_report(void) {
+  FILE *out = stderr;
+  fprintf(out, "\nstats: %ld instructions\n", instruction_count);
+
+  // opcodes, most frequent first
+  int order[NUM_OPCODES];
+  for (int i=0; i<NUM_OPCODES; i++) {
+    order[i] = i;
+  }
+  for (int i=1; i<NUM_OPCODES; i++) {
+    for (int j=i; j>0 && opcode_counts[order[j]] > opcode_counts[order[j-1]]; j--) {
+      int tmp = order[j]; order[j] = order[j-1]; order[j-1] = tmp;
+    }
+  }
+  const char *unit = "cycles";
+#if !defined(__x86_64__) && !defined(__i386__)
+  unit = "ns";
+#endif
+  fprintf(out, "  %-20s %12s %7s", "opcode", "count", "%");
+  if (stats_timing) {
+    fprintf(out, " %14s %10s", unit, "per op");
+  }
+  fprintf(out, "\n");
+  for (int i=0; i<NUM_OPCODES && opcode_counts[order[i]] > 0; i++) {
+    int op = order[i];
+    fprintf(out, "  %-20s %12ld %6.2f%%", opcode_table[op], opcode_counts[op],
+            100.0 * opcode_counts[op] / instruction_count);
+    if (stats_timing) {
+      fprintf(out, " %14llu %10.1f", opcode_ticks[op], (double) opcode_ticks[op] / opcode_counts[op]);
+    }
+    fprintf(out, "\n");
+  }
+
+  // top pairs - repeated selection is fine at NUM_OPCODES^2
+  fprintf(out, "\ntop opcode pairs:\n");
+  static int taken[NUM_OPCODES][NUM_OPCODES];
+  for (int k=0; k<STATS_TOP_PAIRS; k++) {
+    int best_a = -1, best_b = -1;
+    for (int a=0; a<NUM_OPCODES; a++) {
+      for (int b=0; b<NUM_OPCODES; b++) {
+        if (!taken[a][b] && pair_counts[a][b] > 0 &&
+            (best_a < 0 || pair_counts[a][b] > pair_counts[best_a][best_b])) {
+          best_a = a;
+          best_b = b;
+        }
+      }
+    }
+    if (best_a < 0) {
+      break;
+    }
+    taken[best_a][best_b] = 1;
+    fprintf(out, "  %-20s -> %-20s %12ld\n", opcode_table[best_a], opcode_table[best_b], pair_counts[best_a][best_b]);
+  }
+
+  fprintf(out, "\ncalls:\n");
+  qsort(functions, num_functions, sizeof(FunctionStats), compare_functions);
+  for (int i=0; i<num_functions; i++) {
+    fprintf(out, "  %-20s %12ld\n", functions[i].name, functions[i].calls);
+  }
+  if (other_calls > 0) {
+    fprintf(out, "  %-20s %12ld\n", "(others)", other_calls);
+  }
+  if (num_inlined > 0) {
+    fprintf(out, "\ninlined:\n");
+    for (int i=0; i<num_inlined; i++) {
+      fprintf(out, "  %-20s into %-20s %4d site%s\n", inlined[i].callee, inlined[i].caller,
+              inlined[i].sites, inlined[i].sites == 1 ? "" : "s");
+    }
+  }
+  py_memo_report(out);
+  fprintf(out, "\nframes created: %ld\n", frames_created);
+  fprintf(out, "hash-table probes: %ld over %ld lookups", probes_total, lookups);
+  if (lookups > 0) {
+    fprintf(out, " (%.2f per lookup)", (double) probes_total / lookups);
+  }
+  fprintf(out, "\n");
+}
+
+void stats_enable(int timing) {
+  stats_enabled = 1;
+  stats_timing = timing;
+  atexit(stats_report);
+}
@@ -0,0 +1,20 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "opcode.h"
+
+// NOTE: --stats counters. nothing here is called unless the mode is on -
+// main() picks an instrumented copy of the interpreter loop up front, and
+// turns stats on before compiling so the compiler can report what it did
+extern int stats_enabled;
+extern int stats_timing; // also time each opcode (--stats=cycles)
+
+void stats_enable(int timing); // report is printed to stderr at exit
+void stats_count_instruction(OpCode opcode);
+void stats_count_call(const char *name, int new_frame);
+void stats_count_probes(int probes);
+void stats_count_inline(const char *callee, const char *caller); // at compile time
+void stats_add_time(OpCode opcode, unsigned long long ticks);
+unsigned long long stats_clock(void);
+
+#endif
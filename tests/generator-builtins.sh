@@ -0,0 +1,59 @@
+#!/bin/sh
+# sum(), min() and max() run a generator to the end through the eval loop,
+# folding each yield in as it comes - in every mode, since the JIT hands the
+# call back to the interpreter
+spython=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cat > "$dir/main.py" <<'PY'
+def squares(n):
+    for i in range(n):
+        yield i * i
+
+def countdown(n):
+    while n > 0:
+        yield n
+        n = n - 1
+
+def big(n):
+    for i in range(n):
+        yield 4611686018427387904
+
+def words(n):
+    yield "pear"
+    yield "apple"
+    yield "fig"
+
+def nested(n):
+    for i in range(n):
+        yield sum(squares(i))
+
+print(sum(squares(10)), min(squares(10)), max(squares(10)), sum(squares(5), 100))
+g = countdown(5)
+print(next(g), sum(g), sum(g))
+print(sum(nested(5)), max(nested(5)))
+print(sum(big(4)), min(words(0)), max(words(0)))
+print(min(countdown(0)))
+PY
+expected='285 0 81 130
+5 10 0
+20 14
+18446744073709551616 apple pear
+ValueError: min() arg is an empty sequence'
+
+modes="--no-quicken --tail-calls --no-inline"
+[ "$(uname -m)" = x86_64 ] && modes="$modes --jit-threshold=1"
+for mode in "" $modes; do
+  jit=
+  [ "$mode" = --jit-threshold=1 ] && jit=--jit
+  out=$("$spython" $jit $mode "$dir/main.py")
+  [ "$out" = "$expected" ] || { echo "with '$mode' it printed:"; echo "$out"; exit 1; }
+done
+
+# each call is made, and counted, once
+calls=$("$spython" --stats "$dir/main.py" 2>&1 | grep -E '^  (sum|min|max) ')
+expected='  sum                            16
+  min                             3
+  max                             3'
+[ "$calls" = "$expected" ] || { echo "--stats counted:"; echo "$calls"; exit 1; }
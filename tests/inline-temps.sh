@@ -0,0 +1,38 @@
+#!/bin/sh
+# an inlined call's arguments are evaluated once, into the frame's temps -
+# nested calls don't trip over each other's, and nothing lands in the
+# module's globals (so nothing hidden gets written to a snapshot)
+spython=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cat > "$dir/main.py" <<'PY'
+def add(a, b):
+    return a + b
+
+def sq(x):
+    return x * x
+
+t = 0
+for i in range(100):
+    t = add(sq(i + 1), add(i * 2, sq(i)))
+print(t)
+print(add(add(1, 2) + 3, sq(sq(2) + 1)))
+PY
+expected='19999
+31'
+
+modes="--no-inline --no-quicken --tail-calls"
+[ "$(uname -m)" = x86_64 ] && modes="$modes --jit-threshold=1"
+for mode in "" $modes; do
+  jit=
+  [ "$mode" = --jit-threshold=1 ] && jit=--jit
+  out=$("$spython" $jit $mode "$dir/main.py")
+  [ "$out" = "$expected" ] || { echo "with '$mode' it printed:"; echo "$out"; exit 1; }
+done
+
+"$spython" --snapshot-out="$dir/main.snap" "$dir/main.py" > /dev/null || exit 1
+if grep -q 'sq\.x\|add\.a' "$dir/main.snap"; then
+  echo "the snapshot has an inlined call's argument in it"
+  exit 1
+fi
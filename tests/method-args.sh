@@ -0,0 +1,25 @@
+#!/bin/sh
+# a method call's slot and argument count survive the JIT, however many
+# arguments there are
+spython=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cat > "$dir/main.py" <<'PY'
+def probe(s):
+    print(s.find("an"), s.count("a"), s.startswith("ba"))
+    print(s.find("a", 1, 2, 3, 4, 5, 6, 7))
+
+probe("banana")
+PY
+expected='1 3 True
+TypeError: find() takes exactly one argument (8 given)'
+
+modes="--no-quicken"
+[ "$(uname -m)" = x86_64 ] && modes="$modes --jit-threshold=1"
+for mode in "" $modes; do
+  jit=
+  [ "$mode" = --jit-threshold=1 ] && jit=--jit
+  out=$("$spython" $jit $mode "$dir/main.py" 2>&1)
+  [ "$out" = "$expected" ] || { echo "with '$mode' it printed:"; echo "$out"; exit 1; }
+done
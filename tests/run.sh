@@ -0,0 +1,16 @@
+#!/bin/sh
+# usage: tests/run.sh SPYTHON
+# runs each tests/*.sh against the given interpreter - a test exits non-zero
+# (and says why) if it fails
+spython=$1
+failed=0
+for test in "$(dirname "$0")"/*.sh; do
+  [ "$(basename "$test")" = run.sh ] && continue
+  if sh "$test" "$spython"; then
+    echo "ok   $(basename "$test" .sh)"
+  else
+    echo "FAIL $(basename "$test" .sh)"
+    failed=1
+  fi
+done
+exit $failed
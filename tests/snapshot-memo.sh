@@ -0,0 +1,31 @@
+#!/bin/sh
+# a memoize() wrapper loaded from a snapshot keeps its tables in the image -
+# growing them has to copy them out, not realloc them (and saving it again
+# has to work from either place)
+spython=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cat > "$dir/prelude.py" <<'PY'
+def sq(x):
+    return x * x
+
+small = memoize(sq, 100)
+small(1)
+full = memoize(sq, 20)
+full(1)
+PY
+cat > "$dir/main.py" <<'PY'
+total = 0
+for i in range(50):
+    total = total + small(i)
+for i in range(100):
+    total = total + full(i % 30)
+print(total)
+PY
+
+"$spython" --snapshot-out="$dir/a.snap" "$dir/prelude.py" || exit 1
+out=$("$spython" --snapshot-in="$dir/a.snap" --snapshot-out="$dir/b.snap" "$dir/main.py") || exit 1
+[ "$out" = 66375 ] || { echo "first run printed '$out', expected 66375"; exit 1; }
+out=$("$spython" --snapshot-in="$dir/b.snap" "$dir/main.py") || exit 1
+[ "$out" = 66375 ] || { echo "second run printed '$out', expected 66375"; exit 1; }
@@ -0,0 +1,31 @@
+#!/bin/sh
+# `if x:` goes by type - a bignum is true, zero and empty containers false
+spython=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cat > "$dir/main.py" <<'PY'
+def truth(x):
+    if x:
+        return 1
+    return 0
+
+big = 1
+for i in range(30):
+    big = big * 1000
+print(truth(4294967296), truth(big), truth(0 - big), truth(0), truth(0 - 7))
+print(truth(""), truth("a"), truth([]), truth([0]), truth({}), truth({1: 2}))
+print(truth(1 == 1), truth(1 == 2), truth(truth))
+PY
+expected='1 1 1 0 1
+0 1 0 1 0 1
+1 0 1'
+
+modes="--no-quicken"
+[ "$(uname -m)" = x86_64 ] && modes="$modes --jit-threshold=1"
+for mode in "" $modes; do
+  jit=
+  [ "$mode" = --jit-threshold=1 ] && jit=--jit
+  out=$("$spython" $jit $mode "$dir/main.py")
+  [ "$out" = "$expected" ] || { echo "with '$mode' it printed:"; echo "$out"; exit 1; }
+done
@@ -4,8 +4,24 @@
 #include "type.h"
 
 PyTypeObject py_type_tuple = {
-  .base = { .type = &py_type_tuple },
+  .base = { .type = &py_type_type },
   .name = "tuple",
-  .method_defs = NULL,
+  .basic_size = sizeof(PyTupleObject),
+  .item_size = sizeof(PyObject *),
   .methods = NULL,
 };
+
+// NOTE: shared - every zero-length tuple is this one
+static PyTupleObject empty_tuple = {
+  .base = { .type = &py_type_tuple },
+  .size = 0
+};
+
+PyObject *py_tuple_new(int size) {
+  if (size == 0) {
+    return (PyObject *) &empty_tuple;
+  }
+  PyTupleObject *result = (PyTupleObject *) py_type_alloc_var(&py_type_tuple, size);
+  result->size = size;
+  return (PyObject *) result;
+}
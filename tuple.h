@@ -5,4 +5,6 @@
 
 extern PyTypeObject py_type_tuple;
 
+PyObject *py_tuple_new(int size); // elements left for the caller to fill
+
 #endif
@@ -1,34 +1,69 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "type.h"
 #include "cfunc.h"
 #include "hash-table.h"
+#include "error.h"
+#include "memstats.h"
 
 PyTypeObject py_type_type = {
   .base = { .type = &py_type_type },
   .name = "type",
-  .method_defs = NULL,
+  .basic_size = sizeof(PyTypeObject),
+  .item_size = 0,
   .methods = NULL,
 };
 
-// initialisation - run for all built-ins
-void py_type_init(PyTypeObject *py_type_obj) {
-  // create methods hash-table from method_defs 
-  HashTable *methods = malloc(sizeof(HashTable)); 
-  hashtable_init(methods); 
-  
-  // for each method definition...
-  for (int i=0; py_type_obj->method_defs[i].name != NULL; i++) {
-    // allocate the cfunc object
-    PyCFuncObject *_method = malloc(sizeof(PyCFuncObject));
-    _method->base.type = &py_type_cfunc;  
-    _method->function = py_type_obj->method_defs[i].method;
-    // and insert
-    hashtable_insert(methods, py_type_obj->method_defs[i].name, (PyObject *) _method);
+#define PY_METHOD_NAME(slot, name) [SLOT_##slot] = name,
+const char *const py_method_names[NUM_METHOD_SLOTS] = {
+  PY_METHOD_SLOTS(PY_METHOD_NAME)
+};
+#undef PY_METHOD_NAME
+
+int py_method_slot(const char *name) {
+  for (int slot=0; slot<NUM_METHOD_SLOTS; slot++) {
+    if (strcmp(py_method_names[slot], name) == 0) {
+      return slot;
+    }
   }
+  return -1;
+}
 
-  // and attach 
-  py_type_obj->methods = methods;
-  return;
+// allocate an instance with its header filled in
+PyObject *py_type_alloc(PyTypeObject *type) {
+  return py_type_alloc_var(type, 0);
 }
 
+// allocate an instance with `num_items` trailing inline items, so the
+// header and its payload share one allocation
+PyObject *py_type_alloc_var(PyTypeObject *type, int num_items) {
+  size_t size = type->basic_size + (size_t) num_items * type->item_size;
+  PyObject *result = malloc(size);
+  if (result == NULL) {
+    py_error("MemoryError");
+  }
+  result->type = type;
+  if (memstats_enabled) {
+    memstats_record(type->name, 1, size);
+  }
+  return result;
+}
+
+// grow, shrink or (at size 0) free a buffer an instance of `type` owns, so
+// --memstats can put it down to the type - data NULL to allocate a new one
+void *py_type_realloc_data(PyTypeObject *type, void *data, size_t old_size, size_t size) {
+  if (memstats_enabled) {
+    memstats_record(type->name, 0, (long long) size - (long long) old_size);
+  }
+  if (size == 0) {
+    free(data);
+    return NULL;
+  }
+  data = realloc(data, size);
+  if (data == NULL) {
+    py_error("MemoryError");
+  }
+  return data;
+}
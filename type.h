@@ -3,7 +3,19 @@
 
 #include "hash-table.h"
 
-void py_type_init(PyTypeObject *py_type_obj);
+// NULL if the type doesn't have it
+static inline const PyCFuncObject *py_type_method(const PyTypeObject *type, MethodSlot slot) {
+  if (type->methods == NULL || type->methods[slot].function == NULL) {
+    return NULL;
+  }
+  return &type->methods[slot];
+}
+
+extern const char *const py_method_names[NUM_METHOD_SLOTS]; // "__add__" etc.
+int py_method_slot(const char *name); // -1 if no type has a method called that
+PyObject *py_type_alloc(PyTypeObject *type);
+PyObject *py_type_alloc_var(PyTypeObject *type, int num_items);
+void *py_type_realloc_data(PyTypeObject *type, void *data, size_t old_size, size_t size);
 extern PyTypeObject py_type_type;
 
 #endif
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "writer.h"
+
+void writer_init(Writer *w, int fd, int size) {
+  w->fd = fd;
+  w->data = malloc(size);
+  w->length = 0;
+  w->size = size;
+  w->line_buffered = isatty(fd);
+  w->limit = 0;
+  w->overflowed = 0;
+}
+
+void writer_init_capture(Writer *w, int size, int limit) {
+  writer_init(w, -1, size);
+  w->line_buffered = 0;
+  w->limit = limit;
+}
+
+// capturing: grow the buffer instead of flushing it
+static void capture(Writer *w, const char *data, int size) {
+  if (size > w->limit - w->length) {
+    size = w->limit - w->length;
+    w->overflowed = 1;
+  }
+  if (w->length + size > w->size) {
+    while (w->length + size > w->size) w->size = w->size > 0 ? 2 * w->size : 64;
+    w->data = realloc(w->data, w->size);
+  }
+  memcpy(w->data + w->length, data, size);
+  w->length += size;
+}
+
+// write all of `data`, retrying short writes
+static void write_all(int fd, const char *data, int size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return; // nowhere left to report it
+    }
+    data += written;
+    size -= written;
+  }
+}
+
+// write the buffered bytes and then `data` in as few syscalls as we can
+static void writev_all(int fd, const char *buffered, int buffered_size, const char *data, int size) {
+  struct iovec iov[2] = {
+    { .iov_base = (void *) buffered, .iov_len = buffered_size },
+    { .iov_base = (void *) data, .iov_len = size },
+  };
+  struct iovec *next = iov;
+  int count = 2;
+  while (count > 0) {
+    ssize_t written = writev(fd, next, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    // skip whatever went out, possibly part way through an iovec
+    while (count > 0 && written >= (ssize_t) next->iov_len) {
+      written -= next->iov_len;
+      next++;
+      count--;
+    }
+    if (count > 0) {
+      next->iov_base = (char *) next->iov_base + written;
+      next->iov_len -= written;
+    }
+  }
+}
+
+void writer_flush(Writer *w) {
+  if (w->fd < 0) {
+    return; // capturing - the owner takes the data
+  }
+  write_all(w->fd, w->data, w->length);
+  w->length = 0;
+}
+
+void writer_write(Writer *w, const char *data, int size) {
+  if (w->fd < 0) {
+    capture(w, data, size);
+    return;
+  }
+  if (size >= w->size / 2) {
+    // big writes go out as they are, behind whatever is buffered - copying
+    // them in would only mean flushing a buffer's worth at a time
+    writev_all(w->fd, w->data, w->length, data, size);
+    w->length = 0;
+    return;
+  }
+  if (w->length + size > w->size) {
+    writer_flush(w);
+  }
+  memcpy(w->data + w->length, data, size);
+  w->length += size;
+  if (w->line_buffered && memchr(data, '\n', size) != NULL) {
+    writer_flush(w);
+  }
+}
+
+void writer_puts(Writer *w, const char *s) {
+  writer_write(w, s, strlen(s));
+}
+
+void writer_printf(Writer *w, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  va_list args_copy;
+  va_copy(args_copy, args);
+  // try formatting straight into the buffer first
+  int available = w->size - w->length;
+  int needed = vsnprintf(w->data + w->length, available, fmt, args);
+  va_end(args);
+  if (needed < available && w->fd >= 0) {
+    w->length += needed;
+    if (w->line_buffered && memchr(w->data + w->length - needed, '\n', needed) != NULL) {
+      writer_flush(w);
+    }
+  } else {
+    char *tmp = malloc(needed + 1);
+    vsnprintf(tmp, needed + 1, fmt, args_copy);
+    writer_write(w, tmp, needed);
+    free(tmp);
+  }
+  va_end(args_copy);
+}
+
+static const char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+// decimal without printf - two digits per division, filled in from the end
+void writer_long(Writer *w, long long value) {
+  char buf[20];
+  char *p = buf + sizeof(buf);
+  // NOTE: negate as unsigned so LLONG_MIN doesn't overflow
+  unsigned long long n = value < 0 ? -(unsigned long long) value : (unsigned long long) value;
+  while (n >= 100) {
+    const char *pair = digit_pairs + 2 * (n % 100);
+    n /= 100;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  if (n >= 10) {
+    *--p = digit_pairs[2 * n + 1];
+    *--p = digit_pairs[2 * n];
+  } else {
+    *--p = '0' + n;
+  }
+  if (value < 0) {
+    *--p = '-';
+  }
+  writer_write(w, p, buf + sizeof(buf) - p);
+}
+
+void writer_spaces(Writer *w, int n) {
+  static const char spaces[] = "                                ";
+  const int chunk = sizeof(spaces) - 1;
+  while (n > chunk) {
+    writer_write(w, spaces, chunk);
+    n -= chunk;
+  }
+  writer_write(w, spaces, n);
+}
+
+// flush and release the buffer
+void writer_free(Writer *w) {
+  writer_flush(w);
+  free(w->data);
+  w->data = NULL;
+}
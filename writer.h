@@ -0,0 +1,27 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+// buffered output straight to a file descriptor - bypasses stdio
+// NOTE: line-buffered if the fd is a terminal, block-buffered otherwise.
+// a capturing writer (fd -1) just keeps everything, up to `limit` bytes
+typedef struct {
+  int fd;
+  char *data;
+  int length;
+  int size;
+  int line_buffered;
+  int limit; // capturing only
+  int overflowed; // something past `limit` was dropped
+} Writer;
+
+void writer_init(Writer *w, int fd, int size);
+void writer_init_capture(Writer *w, int size, int limit);
+void writer_write(Writer *w, const char *data, int size);
+void writer_puts(Writer *w, const char *s);
+void writer_printf(Writer *w, const char *fmt, ...);
+void writer_long(Writer *w, long long value);
+void writer_spaces(Writer *w, int n);
+void writer_flush(Writer *w);
+void writer_free(Writer *w); // flushes first
+
+#endif